@@ -0,0 +1,115 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "constants.h"
+#include "cpu.h"
+#include "memory.h"
+#include "display.h"
+#include "keypad.h"
+#include "quirks.h"
+
+// Ahead-of-time translation: chip8_aot turns a ROM into a C++ source file
+// with one function per basic block, compiled into the binary like any other
+// code (see chip8_add_aot_rom in CMakeLists.txt). Unlike the JIT this needs
+// no writable executable memory and has no warm-up
+//
+// Blocks only cover code reachable by following jumps, calls and skips from
+// START_ADDRESS in the classic 4 KB. Everything else (computed BNNN targets,
+// code the translation missed, code above 4 KB) is interpreted, and so is any
+// block whose bytes in memory no longer match the ROM it was translated from,
+// which covers self-modifying code and a different ROM being loaded
+
+// What generated code sees of the machine: the registers it reads and writes
+// inline, and the interpreter for every instruction it doesn't translate
+struct AotContext
+{
+    AotContext(Cpu& cpu, Memory& memory, Display& display, Keypad& keypad);
+
+    std::array<uint8_t, NUMBER_OF_REGISTERS>& V;
+    uint16_t& I;
+
+    Cpu& cpu;
+    Memory& memory;
+    Display& display;
+    Keypad& keypad;
+
+    // Execute the instruction at address through the interpreter; returns
+    // the program counter it leaves
+    uint16_t interpret(uint16_t address);
+};
+
+// A generated basic block; returns the address to continue at
+using AotBlockFn = uint16_t (*)(AotContext& context);
+
+struct AotBlock
+{
+    uint16_t address;
+    uint16_t length; // Instructions executed (every path through a block executes them all)
+    uint16_t size;   // ROM bytes the block was translated from, starting at address
+    AotBlockFn code;
+};
+
+// One translated ROM, as emitted by chip8_aot
+struct AotProgram
+{
+    const char* name;
+
+    // Profile the quirky instructions were translated for; a machine
+    // following another profile interprets everything
+    QuirkProfile quirks;
+
+    // The program as translated, loaded at START_ADDRESS
+    const uint8_t* rom;
+    size_t rom_size;
+
+    const AotBlock* blocks; // Sorted by address
+    size_t block_count;
+};
+
+// Generated files register their program at startup, so a runner can pick
+// the one for the ROM it was given
+struct AotRegistration
+{
+    explicit AotRegistration(const AotProgram& program);
+};
+
+// Translated program for these exact ROM bytes; nullptr if none was compiled in
+const AotProgram* find_aot_program(const uint8_t* rom, size_t size);
+
+// Every program compiled in, in registration order
+const std::vector<const AotProgram*>& get_aot_programs();
+
+class Aot
+{
+public:
+    explicit Aot(const AotProgram& program);
+
+    const AotProgram& get_program() const;
+
+    void run(Cpu& cpu, Memory& memory, Display& display, Keypad& keypad, uint64_t cycles);
+
+    // Re-check every block against memory before it next runs (e.g. after
+    // a reset or loading a save state)
+    void flush();
+
+private:
+    // Compare the blocks overlapping the written chunks against the ROM,
+    // enabling the ones that match and disabling the rest
+    void verify(Memory& memory, uint64_t chunks);
+
+    const AotProgram& program;
+
+    // Translated block starting at each address (nullptr if none, or if its
+    // bytes in memory differ from the ROM)
+    std::vector<const AotBlock*> entries;
+
+    // Chunks (as in Memory::take_written_chunks) each block covers
+    std::vector<uint64_t> block_chunks;
+
+    // Chunks written since blocks were last verified; all of them to begin with
+    uint64_t stale_chunks;
+};
@@ -1,29 +1,181 @@
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include "cpu.h"
 #include "memory.h"
 #include "display.h"
 #include "keypad.h"
+#include "jit.h"
+#include "aot.h"
+#include "save_state.h"
+#include "input_log.h"
+#include "tracer.h"
+#include "frame_capture.h"
+#include "rom_store.h"
 
 class Chip8
 {
 public:
     Chip8();
 
+    Chip8(Chip8&&) = default;
+    Chip8& operator=(Chip8&&) = default;
+
+    // fork()-style copy of a machine at its current point: CPU, timers,
+    // display, keys, cycle count and random generator state all carry over,
+    // so both continue identically given the same input. Memory pages are
+    // shared copy-on-write, so a clone costs a few kilobytes until it
+    // writes to memory. A clone isn't recording, and has the JIT (with an
+    // empty code cache) or ahead-of-time program enabled if the original did
+    Chip8 clone() const;
+
+    // Return to the power-on state (font loaded, no ROM, unseeded, not
+    // recording) so one instance can be reused for many runs
+    void reset();
     void load_font_set();
-    void load_rom(std::string filename);
+
+    // Load a ROM file at START_ADDRESS; returns false (leaving memory as it
+    // was) if it can't be read or doesn't fit in the quirk profile's memory
+    // (max_rom_size() in quirks.h), so set the quirks first
+    bool load_rom(std::string filename);
+
+    // Copy a program already in memory to START_ADDRESS; same size limit
+    bool load_program(const uint8_t* data, size_t size);
+
+    // Set memory to a RomStore image (font set plus program) in one copy;
+    // the fast way to start many machines on the same ROM. Same size limit
+    bool load_rom_image(const RomImage& image);
     void cycle_cpu();
+    void run(uint64_t cycles);
+
+    // Same as run(), but the 60 Hz timers tick in emulated time: once every
+    // CPU_HZ / TIMER_HZ cycles counted from reset, however the cycles are
+    // split into calls
+    void run_timed(uint64_t cycles);
+
+    // Whether the last run ended in an idle loop, so running on changes
+    // nothing until the next timer tick or key event (see Cpu::is_idle).
+    // Always false with the JIT or AOT enabled
+    bool is_idle() const;
+
+    // Idle loops are skipped by default; with skipping off every cycle run
+    // really executes, which throughput measurements need. Configuration, so
+    // it survives reset() like the quirk profile
+    void set_idle_skipping(bool enabled);
+
+    // Execute through the JIT instead of the interpreter; returns false (and
+    // stays on the interpreter) if the host doesn't support it
+    bool enable_jit();
+
+    // Execute through a ROM translated ahead of time by chip8_aot (see
+    // aot.h) instead; replaces the JIT if it was enabled. Returns false in
+    // instrumented builds, where everything must go through the interpreter
+    bool enable_aot(const AotProgram& program);
+
     void decrement_timers();
+
+    // Deterministic mode: with a fixed seed, the same ROM and the same input
+    // at the same cycles, every run is identical
+    void seed(uint64_t value);
+
+    // Interpreter whose quirks to follow (see quirks.h); this is machine
+    // configuration rather than state, so it survives reset() and isn't part
+    // of save states
+    void set_quirks(QuirkProfile profile);
+    QuirkProfile get_quirks() const;
+
+    // Cycles executed since power-on / reset
+    uint64_t get_cycle_count() const;
+
+    // While recording, key events and timer ticks are appended to the log
+    // stamped with the cycle they arrived at
+    void start_recording(InputLog& log);
+    void stop_recording();
+
+    // While tracing, every instruction executed is recorded into tracer,
+    // which must be open (see tracer.h). Tracing runs always use the
+    // interpreter, never the JIT or AOT code, and don't skip idle loops.
+    // reset() stops tracing, and clones don't trace
+    void start_tracing(Tracer& tracer);
+    void stop_tracing();
+
+    // While capturing, the display is handed to capture, which must be open
+    // (see frame_capture.h), at every timer tick: once per frame, whether
+    // the frames come from run_timed(), replay() or a caller that ticks the
+    // timers itself. reset() stops capturing, and clones don't capture
+    void start_capture(FrameCapture& capture);
+    void stop_capture();
+
+    // Re-run a recording from the state it was started in (e.g. right after
+    // load_rom); executes the recorded number of cycles
+    void replay(const InputLog& log);
+
     void keyup(uint8_t key);
     void keydown(uint8_t key);
     void clear_key_events();
-    const uint32_t* get_display_buffer() const;
+
+    // The display (resolution, planes and packed rows); it's a plain value,
+    // so a copy is a snapshot of the screen
+    const Display& get_display() const;
+
+    // Packed plane 0 rows (one bit per pixel, MSB = leftmost pixel); one
+    // word per row in low resolution, two in high resolution
+    const uint64_t* get_display_rows() const;
+
+    // Fingerprint of the current display contents
+    uint64_t get_display_hash() const;
+
+    const std::array<uint8_t, NUMBER_OF_REGISTERS>& get_registers() const;
+    uint16_t get_program_counter() const;
+    uint16_t get_index_register() const;
+
+    // Expand the display into RGBA pixels at its current resolution (up to
+    // HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HEIGHT)
+    void render_display(uint32_t* pixels) const;
+
+    // Instrumentation counters (see probe.h); only collected in builds with
+    // CHIP8_INSTRUMENT, where the JIT is unavailable so every instruction
+    // goes through the counting interpreter
+    const CpuProbe& get_probe() const;
+    void reset_probe();
+
+    // Snapshot the whole machine into a fixed-layout SaveState, or restore
+    // one (e.g. straight from a MappedSaveState); load_state returns false
+    // and leaves the machine untouched if the state's header doesn't match
+    // or a field is out of range (see is_valid_save_state). Emulated time
+    // comes back too, so timers tick on the same cycles as before the save
+    void save_state(SaveState& state) const;
+    bool load_state(const SaveState& state);
 
 private:
+    // Used by clone(); everything but the JIT / AOT state, recording,
+    // tracing and capture
+    Chip8(const Chip8& other);
+
     Cpu cpu;
     Memory memory;
     Display display;
     Keypad keypad;
+
+    // Only allocated when enabled; compiled code is per-instance. At most
+    // one of them is set
+    std::unique_ptr<Jit> jit;
+    std::unique_ptr<Aot> aot;
+
+    uint64_t cycle_count;
+
+    // Timer ticks issued by run_timed() since reset
+    uint64_t timer_ticks;
+
+    // Active recording, if any, and the cycle it started at
+    InputLog* recording;
+    uint64_t recording_start;
+
+    // Active trace, if any
+    Tracer* tracer;
+
+    // Active frame capture, if any
+    FrameCapture* capture;
 };
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "decoder.h"
+#include "quirks.h"
+#include "random.h"
+#include "rom_store.h"
+
+// Lockstep batch engine: N independent CHIP-8 machines stored as structure of
+// arrays (V0 of every machine side by side, then V1, ...), so lanes executing
+// the same instruction run it together in SIMD registers. Each cycle, lanes
+// are grouped by program counter and opcode in one pass; a fully converged
+// batch runs as one group, larger groups of a diverged batch run masked over
+// just the lane blocks they touch, and small groups and stragglers fall back
+// to scalar execution, one lane at a time
+//
+// The interface mirrors Chip8 with an extra lane index, so code that steps N
+// Chip8 objects can switch to one Chip8Batch
+//
+// Each lane is a classic CHIP-8: 4 KB of memory (CLASSIC_MEMORY_SIZE) and a
+// 64x32 single-plane display. SUPER-CHIP / XO-CHIP instructions are ignored
+// (DXY0 draws nothing, whatever the quirk profile), so those ROMs need Chip8;
+// under the VIP and CHIP-48 profiles, which lack them too, a lane runs any
+// ROM exactly as Chip8 does
+
+class Chip8Batch
+{
+public:
+    explicit Chip8Batch(size_t lanes);
+
+    size_t size() const;
+
+    void reset();
+    // Same as Chip8, but with the classic size limit: false if the ROM
+    // can't be read or is larger than CLASSIC_MAX_ROM_SIZE
+    bool load_rom(std::string filename);
+    bool load_rom_image(const RomImage& image);
+    void cycle_cpu();
+    void run(uint64_t cycles);
+    void decrement_timers();
+
+    // Seed every lane's CXNN generator with the same value (lanes then stay
+    // in lockstep through random draws), or one lane's; a lane seeded like a
+    // Chip8 runs identically to it
+    void seed(uint64_t value);
+    void seed(size_t lane, uint64_t value);
+
+    // Quirk profile shared by every lane; kept across reset()
+    void set_quirks(QuirkProfile profile);
+    QuirkProfile get_quirks() const;
+
+    void keyup(size_t lane, uint8_t key);
+    void keydown(size_t lane, uint8_t key);
+    void clear_key_events();
+
+    const uint64_t* get_display_rows(size_t lane) const;
+    uint64_t get_display_hash(size_t lane) const;
+    void render_display(size_t lane, uint32_t* pixels) const;
+
+    std::array<uint8_t, NUMBER_OF_REGISTERS> get_registers(size_t lane) const;
+    uint16_t get_program_counter(size_t lane) const;
+    uint16_t get_index_register(size_t lane) const;
+
+private:
+    // Lanes are processed in blocks of this many; the lane count is padded up
+    // to a multiple so every block is full (padding lanes are never active)
+    static const size_t LANE_BLOCK = 32;
+
+    // A group runs as a masked pass over the blocks it touches only if it
+    // has at least this many lanes per block; thinner groups run lane by lane
+    static const size_t MIN_LANES_PER_BLOCK = 2;
+
+    // Most cycles a lane runs on its own before rejoining the batch, where
+    // it can converge with the others again
+    static const uint64_t MAX_RUN_AHEAD = 64;
+
+    static const uint32_t NO_GROUP = UINT32_MAX;
+
+    // Lanes executing one instruction together: their indices in lane order,
+    // and the first lane of each block they fall in, for the branch-free
+    // loops under the active mask. A lane run on its own is its own "block"
+    // of one
+    struct LaneGroup
+    {
+        const uint32_t* members;
+        size_t count;
+        const uint32_t* blocks;
+        size_t block_count;
+    };
+
+    // Scheduling record for one group in step()
+    struct GroupInfo
+    {
+        uint16_t address;
+        uint16_t opcode;
+        size_t count;
+        size_t offset; // Into group_members
+    };
+
+    // One lockstep cycle, with remaining cycles left in this run (this one
+    // included); first_cycle is run()'s first, the one that sees key events
+    void step(uint64_t remaining, bool first_cycle);
+
+    // Run a lane that has no group worth running together for this cycle,
+    // starting with instruction, and on for the next cycles - 1 cycles of the
+    // run: one machine at a time keeps the host's branch prediction on its
+    // side. The lane then sits out the steps it has already done
+    void run_lane(size_t lane, const Instruction& instruction, uint64_t cycles, bool first_cycle);
+
+    uint16_t fetch(size_t lane, uint16_t address) const;
+
+    // scalar: the group is a single lane, so the active mask isn't consulted
+    // and the branch-free loops collapse to one iteration
+    template <bool scalar>
+    void execute(const Instruction& instruction, const LaneGroup& group);
+
+    template <bool scalar>
+    uint8_t is_active(size_t lane) const { return scalar ? 1 : active[lane]; }
+
+    // Call body(lane) for every lane in the group's blocks
+    template <bool scalar, typename Body>
+    void for_each_block_lane(const LaneGroup& group, Body body);
+
+    // Apply op(vx, vy, new_vx, new_vf) to every lane in the group, in
+    // SIMD-friendly blocks; VF is only written back if sets_flag
+    template <bool scalar, typename Operation>
+    void alu(uint8_t X, uint8_t Y, bool sets_flag, const LaneGroup& group, Operation op);
+
+    // Add 2 to PC in every lane of the group where condition(lane) holds
+    template <bool scalar, typename Condition>
+    void skip_if(const LaneGroup& group, Condition condition);
+
+    template <bool scalar>
+    void increment_index(uint8_t X, const LaneGroup& group);
+    void write_memory(size_t lane, uint16_t address, uint8_t value);
+    void mark_written(const LaneGroup& group, uint16_t length);
+
+    uint8_t* V(uint8_t reg) { return &registers[reg * padded_lanes]; }
+    uint8_t* lane_memory(size_t lane) { return &memory[lane * CLASSIC_MEMORY_SIZE]; }
+    const uint8_t* lane_memory(size_t lane) const { return &memory[lane * CLASSIC_MEMORY_SIZE]; }
+    uint64_t* lane_display(size_t lane) { return &display[lane * DISPLAY_HEIGHT]; }
+
+    size_t lanes;
+    size_t padded_lanes;
+    QuirkProfile quirks;
+
+    // CPU state, one array element per lane
+    std::vector<uint8_t> registers; // [register][lane]
+    std::vector<uint16_t> program_counter;
+    std::vector<uint16_t> index_register;
+    std::vector<uint16_t> stack; // [depth][lane]
+    std::vector<uint8_t> stack_pointer;
+    std::vector<uint8_t> delay_timer;
+    std::vector<uint8_t> sound_timer;
+    std::vector<int8_t> last_key_pressed;
+    std::vector<Random> random;
+
+    // Memory and display, contiguous per lane
+    std::vector<uint8_t> memory; // [lane][address]
+    std::vector<uint64_t> display; // [lane][row]
+
+    // Keypad state as 16-bit masks (bit n = key n)
+    std::vector<uint16_t> keys_pressed;
+    std::vector<uint16_t> keys_pressed_this_loop;
+    std::vector<uint16_t> keys_released_this_loop;
+
+    // Memory chunks (MEMORY_CHUNK_SIZE bytes) whose contents may differ
+    // between lanes; opcodes fetched from these are compared per lane
+    uint64_t divergent_chunks;
+
+    // Per-cycle scheduling: lanes in the group being executed (0 or 1 each),
+    // each lane's group, every group's lanes and blocks back to back, and the
+    // group last made for each address. every_lane and every_block describe
+    // the converged batch
+    std::vector<uint8_t> active;
+    std::vector<uint32_t> lane_group;
+    std::vector<uint8_t> ahead; // Steps each lane has already run on its own
+    std::vector<uint32_t> group_members;
+    std::vector<uint32_t> group_blocks;
+    std::vector<GroupInfo> groups;
+    std::vector<uint32_t> address_group;
+    std::vector<uint32_t> every_lane;
+    std::vector<uint32_t> every_block;
+    bool all_lanes_active;
+};
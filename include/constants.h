@@ -1,8 +1,6 @@
 #pragma once
 
 #include <cstdint>
-#include <map>
-#include <SDL3/SDL_scancode.h>
 
 // CHIP-8 config
 const double CPU_HZ = 700.0; // Clock speed (cycles per second)
@@ -10,29 +8,65 @@ const double DISPLAY_HZ = 60.0; // Refresh rate (frames per second)
 
 const double TIMER_HZ = 60.0;
 
-const bool CLASSIC_MODE = false;
-
 // Calculated cycle/frame durations (ms)
 const double CYCLE_DURATION_MS = 1000.0 / CPU_HZ;
 const double FRAME_DURATION_MS = 1000.0 / DISPLAY_HZ;
 const double TIMER_DURATION_MS = 1000.0 / TIMER_HZ;
 
 // General constants
-const unsigned int MEMORY_SIZE = 4096;
+
+// XO-CHIP's 64 KB address space; classic CHIP-8 programs only ever touch the
+// first 4 KB, and untouched pages cost nothing (see Memory)
+const unsigned int MEMORY_SIZE = 65536;
+const unsigned int CLASSIC_MEMORY_SIZE = 4096;
+const unsigned int MEMORY_CHUNK_SIZE = CLASSIC_MEMORY_SIZE / 64; // Granularity of write tracking (JIT-visible range only)
+const unsigned int MEMORY_PAGE_SIZE = 256; // Granularity of copy-on-write sharing
+const unsigned int MEMORY_PAGE_COUNT = MEMORY_SIZE / MEMORY_PAGE_SIZE;
+
+// Low resolution (CHIP-8) and SUPER-CHIP / XO-CHIP high resolution modes
 const unsigned int DISPLAY_WIDTH = 64;
 const unsigned int DISPLAY_HEIGHT = 32;
+const unsigned int HIRES_DISPLAY_WIDTH = 128;
+const unsigned int HIRES_DISPLAY_HEIGHT = 64;
 const unsigned int DISPLAY_SCALE = 10;
 
+// XO-CHIP bitplanes; a pixel's color is picked by which planes are lit
+const unsigned int DISPLAY_PLANES = 2;
+
 const uint32_t PIXEL_OFF = 0x00000000;
 const uint32_t PIXEL_ON = 0xFFFFFFFF;
+const uint32_t PIXEL_PLANE_2 = 0xFF0080FF; // Orange (RGBA bytes in memory)
+const uint32_t PIXEL_BOTH_PLANES = 0xFF004080; // Dark orange
+
+// Indexed by color: bit n set if plane n is lit
+const uint32_t PIXEL_PALETTE[1 << DISPLAY_PLANES] = { PIXEL_OFF, PIXEL_ON, PIXEL_PLANE_2, PIXEL_BOTH_PLANES };
+
+// Fraction of its brightness a pixel keeps per frame after it goes off (see
+// Presenter); enough that XOR flicker reads as a slight dimming
+const double PHOSPHOR_DECAY = 0.6;
 
 const unsigned int NUMBER_OF_REGISTERS = 16;
 const unsigned int MAX_CALLSTACK = 16;
+const int NUMBER_OF_KEYS = 16;
 
 // The original CHIP-8 interpreter was loaded into RAM from 0x000 to 0x1FF
 // Program ROMS were loaded into the unreserved memory starting at 0x200 
 const unsigned int START_ADDRESS = 0x200;
 
+// Largest program that fits between START_ADDRESS and the end of memory, and
+// the largest a classic (4 KB) machine can take: Chip8Batch, or Chip8 under
+// any profile but XO-CHIP (see max_rom_size() in quirks.h)
+const unsigned int MAX_ROM_SIZE = MEMORY_SIZE - START_ADDRESS;
+const unsigned int CLASSIC_MAX_ROM_SIZE = CLASSIC_MEMORY_SIZE - START_ADDRESS;
+
+// SUPER-CHIP persistent "RPL user flags" (FX75 / FX85); XO-CHIP has 16
+const unsigned int NUMBER_OF_FLAGS = 16;
+
+// XO-CHIP audio: a 128-bit (16 byte) pattern buffer played back at a rate
+// set by FX3A, 64 being 4000 Hz
+const unsigned int AUDIO_PATTERN_SIZE = 16;
+const uint8_t DEFAULT_AUDIO_PITCH = 64;
+
 // Built-in fonts are placed inside the block of memory reserved for the
 // interpreter, conventionally from 0x050 to 0x09F
 const unsigned int FONT_SET_START_ADDRESS = 0x050;
@@ -69,37 +103,26 @@ const uint8_t FONT_SET[80] = {
     0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
-// Most computers that ran the original CHIP-8 interpreter had hexadecimal
-// keypads; the COSMAC VIP keypad looked like this:
-
-// +---+---+---+---+
-// | 1 | 2 | 3 | C |
-// |---+---+---+---|
-// | 4 | 5 | 6 | D |
-// |---+---+---+---|
-// | 7 | 8 | 9 | E |
-// |---+---+---+---|
-// | A | 0 | B | F |
-// +---+---+---+---+
-
-// We'll map these keys to the 16 alphanums on the left side of the keyboard
-// The keymap uses keyboard scancodes, not ASCII character codes
-
-const std::map<SDL_Scancode, uint8_t> KEYMAP{
-    {SDL_SCANCODE_1, 0x1},
-    {SDL_SCANCODE_2, 0x2},
-    {SDL_SCANCODE_3, 0x3},
-    {SDL_SCANCODE_4, 0xC},
-    {SDL_SCANCODE_Q, 0x4},
-    {SDL_SCANCODE_W, 0x5},
-    {SDL_SCANCODE_E, 0x6},
-    {SDL_SCANCODE_R, 0xD},
-    {SDL_SCANCODE_A, 0x7},
-    {SDL_SCANCODE_S, 0x8},
-    {SDL_SCANCODE_D, 0x9},
-    {SDL_SCANCODE_F, 0xE},
-    {SDL_SCANCODE_Z, 0xA},
-    {SDL_SCANCODE_X, 0x0},
-    {SDL_SCANCODE_C, 0xB},
-    {SDL_SCANCODE_V, 0xF},
+// SUPER-CHIP's large 8x10 digits (FX30), placed right after the small font.
+// XO-CHIP adds A-F
+const unsigned int BIG_FONT_SET_START_ADDRESS = FONT_SET_START_ADDRESS + sizeof(FONT_SET);
+const unsigned int BYTES_PER_BIG_FONT_SPRITE = 10;
+
+const uint8_t BIG_FONT_SET[160] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
 };
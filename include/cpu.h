@@ -6,7 +6,14 @@
 #include "memory.h"
 #include "display.h"
 #include "keypad.h"
+#include "decoder.h"
 #include "constants.h"
+#include "save_state.h"
+#include "random.h"
+#include "probe.h"
+#include "quirks.h"
+
+class Tracer;
 
 class Cpu
 {
@@ -14,11 +21,182 @@ public:
     Cpu();
 
     void tick(Memory& memory, Display& display, Keypad& keypad);
+    void run(Memory& memory, Display& display, Keypad& keypad, uint64_t cycles);
     void decrement_timers();
 
+    // Whether the last run() ended in an idle loop: a jump to itself, FX0A
+    // waiting for a key, or a short loop polling the delay timer or keys.
+    // More cycles change nothing until the next timer decrement or key
+    // event, so run() skips straight to its end once it finds one
+    bool is_idle() const;
+
+    // Idle loop skipping is on by default; turn it off where every cycle
+    // must really execute, e.g. to measure interpreter throughput
+    void set_idle_skipping(bool enabled);
+    bool get_idle_skipping() const;
+
+    // Which interpreter's quirks to follow; takes effect from the next tick
+    // or run, which then uses the dispatch loop compiled for that profile
+    void set_quirks(QuirkProfile profile);
+    QuirkProfile get_quirks() const;
+
+    // Seed the CXNN generator; two machines with the same seed, ROM and
+    // input run identically
+    void seed(uint64_t value);
+    uint64_t get_random_state() const;
+    void set_random_state(uint64_t state);
+
+    // Record every instruction executed from now on into tracer (nullptr to
+    // stop). Tracing runs use a separate instance of the dispatch loop, so
+    // untraced runs don't pay for it, and don't skip idle loops
+    void set_tracer(Tracer* tracer);
+
+    // Instrumentation counters (empty unless built with CHIP8_INSTRUMENT)
+    const CpuProbe& get_probe() const;
+    void reset_probe();
+
+    const std::array<uint8_t, NUMBER_OF_REGISTERS>& get_registers() const;
+    uint16_t get_program_counter() const;
+    uint16_t get_index_register() const;
+
+    // Copy this subsystem's part of a save state out / in; load_state trusts
+    // the state, so check it with is_valid_save_state first
+    void save_state(SaveState& state) const;
+    void load_state(const SaveState& state);
+
 private:
-    void fetch_instruction(Memory& memory);
-    void decode_and_execute(Memory&, Display& display, Keypad& keypad);
+    // The JIT reads and writes CPU state directly from generated code, as
+    // does code translated ahead of time (through AotContext)
+    friend class Jit;
+    friend class Aot;
+    friend struct AotContext;
+
+    Instruction fetch_instruction(Memory& memory);
+    void decode_and_execute(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+
+    // The interpreter loop for one quirk profile, with or without tracing;
+    // run() picks the instance
+    template <bool traced>
+    void run_traced(Memory& memory, Display& display, Keypad& keypad, uint64_t cycles);
+    template <QuirkProfile profile, bool traced>
+    void run_with_quirks(Memory& memory, Display& display, Keypad& keypad, uint64_t cycles);
+
+    // Hand the instruction at address, just executed, to the tracer
+    void trace(uint16_t address, const Instruction& instruction);
+
+    // Idle loop detection, called by the dispatch loop after the 1NNN /
+    // FX0A at address with remaining cycles left in the run; return how
+    // many of them can be skipped without changing the outcome.
+    // may_close_idle_loop is the inline filter in front of skip_idle_loop
+    bool may_close_idle_loop(uint16_t address, uint16_t target) const;
+    uint64_t skip_idle_loop(uint16_t address, Memory& memory, Display& display, Keypad& keypad, uint64_t remaining);
+    uint64_t skip_key_wait(uint16_t address, int8_t waiting_for, uint64_t remaining);
+
+    // One handler per operation; indexed by Op in table dispatch mode. Each
+    // profile has its own table, with the quirky handlers instantiated for it
+    using Handler = void (Cpu::*)(const Instruction&, Memory&, Display&, Keypad&);
+
+    template <QuirkProfile profile>
+    static const Handler handlers[OP_COUNT];
+
+    static const Handler* const handler_tables[QUIRK_PROFILE_COUNT];
+
+    void op_invalid(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_00E0(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_00EE(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00CN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00DN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00FB(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00FC(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00FD(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00FE(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_00FF(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_1NNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_2NNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_3XNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_4XNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_5XY0(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_5XY2(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_5XY3(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_6XNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_7XNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_8XY0(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_8XY1(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_8XY2(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_8XY3(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_8XY4(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_8XY5(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_8XY6(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_8XY7(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_8XYE(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_9XY0(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_ANNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_BNNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_CXNN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_DXYN(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_DXY0(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_EX9E(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_EXA1(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_F000(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FN01(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_F002(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_FX07(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_FX0A(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_FX15(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_FX18(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX1E(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_FX29(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX30(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    void op_FX33(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX3A(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX55(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX65(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX75(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+    template <QuirkProfile profile>
+    void op_FX85(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad);
+
+    // Skip the next instruction; with the long_skips quirk that's all 4
+    // bytes of an F000 NNNN
+    template <QuirkProfile profile>
+    void skip(Memory& memory);
+
+    // DXYN / DXY0: draw height rows at (VX, VY), 16 pixels wide if wide
+    // Takes the register numbers by value so the dispatch loop can keep the
+    // current instruction in registers rather than on the stack
+    template <QuirkProfile profile>
+    void draw(uint8_t X, uint8_t Y, Memory& memory, Display& display, unsigned int height, bool wide);
 
     // General-purpose variable registers V0 to VF
     std::array<uint8_t, NUMBER_OF_REGISTERS> registers;
@@ -38,9 +216,42 @@ private:
     uint8_t delay_timer;
     uint8_t sound_timer; // Plays tone while not 0
 
-    // Slot to store current instruction
-    uint16_t opcode;
-
     // Slot to store latest keypress for FX0A instruction
     int8_t last_key_pressed;
+
+    // Source of CXNN random numbers; seeded from the OS unless seed() is called
+    Random random;
+
+    // SUPER-CHIP "RPL user flags" (FX75 / FX85)
+    std::array<uint8_t, NUMBER_OF_FLAGS> flags;
+
+    // XO-CHIP sound: the 1-bit pattern played while the sound timer runs,
+    // and its playback rate (F002 / FX3A). Kept as machine state; there is
+    // no audio output yet
+    std::array<uint8_t, AUDIO_PATTERN_SIZE> audio_pattern;
+    uint8_t audio_pitch;
+
+    QuirkProfile quirks;
+
+    // The short loop idle detection last looked at in this run(): the jump
+    // closing it, whether its body is all idle-safe operations, and the
+    // registers the last time round; the loop may be idle if they're the
+    // same the next time
+    struct IdleLoop
+    {
+        bool valid;
+        bool safe;
+        uint16_t jump;
+        std::array<uint8_t, NUMBER_OF_REGISTERS> registers;
+        uint16_t index_register;
+    };
+    IdleLoop idle_loop;
+    bool idle;
+    bool idle_skipping;
+
+    // Where executed instructions are recorded, if anywhere
+    Tracer* tracer;
+
+    // Last so the instrumentation build doesn't move the JIT-visible fields
+    CpuProbe probe;
 };
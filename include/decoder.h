@@ -0,0 +1,252 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Every distinct CHIP-8 operation gets its own id so the CPU can jump straight
+// to its handler instead of walking a chain of comparisons on the opcode
+enum Op : uint8_t
+{
+    OP_INVALID, // Unknown opcodes (and 0NNN machine code calls) are ignored
+    OP_00E0,
+    OP_00EE,
+    OP_00CN, // SUPER-CHIP: scroll down N rows
+    OP_00DN, // XO-CHIP: scroll up N rows
+    OP_00FB, // SUPER-CHIP: scroll right 4 pixels
+    OP_00FC, // SUPER-CHIP: scroll left 4 pixels
+    OP_00FD, // SUPER-CHIP: exit the interpreter
+    OP_00FE, // SUPER-CHIP: low resolution
+    OP_00FF, // SUPER-CHIP: high resolution
+    OP_1NNN,
+    OP_2NNN,
+    OP_3XNN,
+    OP_4XNN,
+    OP_5XY0,
+    OP_5XY2, // XO-CHIP: store VX..VY at I
+    OP_5XY3, // XO-CHIP: load VX..VY from I
+    OP_6XNN,
+    OP_7XNN,
+    OP_8XY0,
+    OP_8XY1,
+    OP_8XY2,
+    OP_8XY3,
+    OP_8XY4,
+    OP_8XY5,
+    OP_8XY6,
+    OP_8XY7,
+    OP_8XYE,
+    OP_9XY0,
+    OP_ANNN,
+    OP_BNNN,
+    OP_CXNN,
+    OP_DXYN,
+    OP_DXY0, // SUPER-CHIP: 16x16 sprite
+    OP_EX9E,
+    OP_EXA1,
+    OP_F000, // XO-CHIP: I = the 16-bit word that follows
+    OP_FN01, // XO-CHIP: select drawing planes N
+    OP_F002, // XO-CHIP: load the audio pattern from I
+    OP_FX07,
+    OP_FX0A,
+    OP_FX15,
+    OP_FX18,
+    OP_FX1E,
+    OP_FX29,
+    OP_FX30, // SUPER-CHIP: I = large digit VX
+    OP_FX33,
+    OP_FX3A, // XO-CHIP: audio pitch
+    OP_FX55,
+    OP_FX65,
+    OP_FX75, // SUPER-CHIP: save V0..VX to the flags
+    OP_FX85, // SUPER-CHIP: load V0..VX from the flags
+    OP_COUNT
+};
+
+// A decoded instruction: the operation id plus its operands, pre-extracted
+// from the raw opcode
+struct Instruction
+{
+    uint16_t opcode;
+    uint16_t NNN;
+    Op op;
+    uint8_t X;
+    uint8_t Y;
+    uint8_t NN;
+};
+
+namespace decoder_detail
+{
+    using SecondaryTable = std::array<Op, 256>;
+
+    constexpr SecondaryTable fill(Op op)
+    {
+        SecondaryTable table{};
+        for (auto& entry : table)
+        {
+            entry = op;
+        }
+        return table;
+    }
+
+    // 0x00E0, 0x00EE and the SUPER-CHIP / XO-CHIP scroll and mode
+    // instructions; anything else in the 0x0 group is a machine code call
+    constexpr SecondaryTable build_group_0()
+    {
+        SecondaryTable table = fill(OP_INVALID);
+        for (int n = 0; n < 16; ++n)
+        {
+            table[0xC0 | n] = OP_00CN;
+            table[0xD0 | n] = OP_00DN;
+        }
+        table[0xE0] = OP_00E0;
+        table[0xEE] = OP_00EE;
+        table[0xFB] = OP_00FB;
+        table[0xFC] = OP_00FC;
+        table[0xFD] = OP_00FD;
+        table[0xFE] = OP_00FE;
+        table[0xFF] = OP_00FF;
+        return table;
+    }
+
+    // 0x5XY2 / 0x5XY3 are XO-CHIP's register range stores; every other N
+    // means 5XY0. Profiles without XO-CHIP run 5XY2 / 5XY3 as 5XY0 too (see
+    // effective_op() in quirks.h)
+    constexpr SecondaryTable build_group_5()
+    {
+        SecondaryTable table{};
+        for (int nn = 0; nn < 256; ++nn)
+        {
+            const int n = nn & 0x0F;
+            table[nn] = n == 2 ? OP_5XY2 : n == 3 ? OP_5XY3 : OP_5XY0;
+        }
+        return table;
+    }
+
+    // DXY0 draws a 16x16 sprite instead of nothing (under the big_sprites quirk)
+    constexpr SecondaryTable build_group_D()
+    {
+        SecondaryTable table{};
+        for (int nn = 0; nn < 256; ++nn)
+        {
+            table[nn] = (nn & 0x0F) == 0 ? OP_DXY0 : OP_DXYN;
+        }
+        return table;
+    }
+
+    // 0x8XYN is keyed on N only, so every NN with the same low nibble maps to
+    // the same operation
+    constexpr SecondaryTable build_group_8()
+    {
+        constexpr Op by_n[16] = {
+            OP_8XY0, OP_8XY1, OP_8XY2, OP_8XY3, OP_8XY4, OP_8XY5, OP_8XY6, OP_8XY7,
+            OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID, OP_INVALID, OP_8XYE, OP_INVALID
+        };
+
+        SecondaryTable table{};
+        for (int nn = 0; nn < 256; ++nn)
+        {
+            table[nn] = by_n[nn & 0x0F];
+        }
+        return table;
+    }
+
+    constexpr SecondaryTable build_group_E()
+    {
+        SecondaryTable table = fill(OP_INVALID);
+        table[0x9E] = OP_EX9E;
+        table[0xA1] = OP_EXA1;
+        return table;
+    }
+
+    constexpr SecondaryTable build_group_F()
+    {
+        SecondaryTable table = fill(OP_INVALID);
+        table[0x00] = OP_F000;
+        table[0x01] = OP_FN01;
+        table[0x02] = OP_F002;
+        table[0x07] = OP_FX07;
+        table[0x0A] = OP_FX0A;
+        table[0x15] = OP_FX15;
+        table[0x18] = OP_FX18;
+        table[0x1E] = OP_FX1E;
+        table[0x29] = OP_FX29;
+        table[0x30] = OP_FX30;
+        table[0x33] = OP_FX33;
+        table[0x3A] = OP_FX3A;
+        table[0x55] = OP_FX55;
+        table[0x65] = OP_FX65;
+        table[0x75] = OP_FX75;
+        table[0x85] = OP_FX85;
+        return table;
+    }
+
+    // Primary table is indexed by the high nibble; each entry is a secondary
+    // table indexed by the low byte (NN). Groups that don't depend on NN simply
+    // repeat the same operation across all 256 slots
+    inline constexpr std::array<SecondaryTable, 16> DECODE_TABLE{
+        build_group_0(),
+        fill(OP_1NNN),
+        fill(OP_2NNN),
+        fill(OP_3XNN),
+        fill(OP_4XNN),
+        build_group_5(),
+        fill(OP_6XNN),
+        fill(OP_7XNN),
+        build_group_8(),
+        fill(OP_9XY0),
+        fill(OP_ANNN),
+        fill(OP_BNNN),
+        fill(OP_CXNN),
+        build_group_D(),
+        build_group_E(),
+        build_group_F(),
+    };
+}
+
+inline Op decode_op(uint16_t opcode)
+{
+    const Op op = decoder_detail::DECODE_TABLE[opcode >> 12][opcode & 0x00FF];
+
+    // 00E0/00EE also require X and Y to be zero (e.g. 0x01E0 is a machine code call)
+    if ((opcode & 0xF000) == 0x0000 && (opcode & 0x0F00) != 0)
+    {
+        return OP_INVALID;
+    }
+
+    // Same for F000; FX00 with any other X isn't an instruction
+    if ((opcode & 0xF0FF) == 0xF000 && (opcode & 0x0F00) != 0)
+    {
+        return OP_INVALID;
+    }
+
+    return op;
+}
+
+inline Instruction decode(uint16_t opcode)
+{
+    Instruction instruction;
+    instruction.opcode = opcode;
+    instruction.NNN = opcode & 0x0FFF;
+    instruction.op = decode_op(opcode);
+    instruction.X = (opcode & 0x0F00) >> 8;
+    instruction.Y = (opcode & 0x00F0) >> 4;
+    instruction.NN = opcode & 0x00FF;
+    return instruction;
+}
+
+// Mnemonic-style name of an operation, for reports and disassembly
+inline const char* op_name(Op op)
+{
+    // Order must match the Op enum
+    static const char* const names[OP_COUNT] = {
+        "invalid",
+        "00E0", "00EE", "00CN", "00DN", "00FB", "00FC", "00FD", "00FE", "00FF",
+        "1NNN", "2NNN", "3XNN", "4XNN", "5XY0", "5XY2", "5XY3", "6XNN", "7XNN",
+        "8XY0", "8XY1", "8XY2", "8XY3", "8XY4", "8XY5", "8XY6", "8XY7", "8XYE",
+        "9XY0", "ANNN", "BNNN", "CXNN", "DXYN", "DXY0", "EX9E", "EXA1",
+        "F000", "FN01", "F002", "FX07", "FX0A", "FX15", "FX18", "FX1E", "FX29", "FX30",
+        "FX33", "FX3A", "FX55", "FX65", "FX75", "FX85",
+    };
+
+    return op < OP_COUNT ? names[op] : "invalid";
+}
@@ -3,17 +3,118 @@
 #include <cstdint>
 
 #include "constants.h"
+#include "save_state.h"
 
+// Up to two packed bitplanes, in either the 64x32 low resolution or the
+// SUPER-CHIP / XO-CHIP 128x64 high resolution
+//
+// Rows are stored as whole 64-bit words (one per low resolution row, two per
+// high resolution row), so drawing, scrolling and collision checks work a
+// row at a time with shifts and masks rather than pixel by pixel. A low
+// resolution screen's plane 0 has exactly the layout the display always had:
+// DISPLAY_HEIGHT consecutive words
 class Display
 {
 public:
     Display();
 
-    uint32_t set_pixel(int x, int y);
+    // XOR a sprite onto every selected plane with its top-left pixel at
+    // (x, y), which must already be on screen. Each plane takes height rows
+    // of 8 pixels, or of 16 pixels (2 bytes a row) if wide, with the next
+    // selected plane's rows following in sprite. Pixels past the edges are
+    // cut off if clip is set, otherwise they wrap around to the other side
+    // Returns true if any lit pixel was turned off (collision)
+    bool draw_sprite(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height, bool wide, bool clip)
+    {
+        // Nearly every sprite is a classic one, 8 pixels wide onto plane 0
+        // of the low resolution screen; that goes straight to the row loop
+        if (!hires && !wide && selected_planes == 1)
+        {
+            return draw_plane<1, false>(planes[0], x, y, sprite, height, clip);
+        }
+        return draw_sprite_planes(x, y, sprite, height, wide, clip);
+    }
+
+    // Clear the selected planes
     void clear();
-    const uint32_t* get_display_buffer() const;
+
+    // Scroll the selected planes; pixels scrolled in are off
+    void scroll_down(unsigned int rows);
+    void scroll_up(unsigned int rows);
+    void scroll_right(); // 4 pixels
+    void scroll_left(); // 4 pixels
+
+    // SUPER-CHIP 00FF / 00FE; either way the whole screen is cleared
+    void set_hires(bool enabled);
+
+    // Defined here so every sprite drawn doesn't pay for calls to them
+    bool is_hires() const
+    {
+        return hires;
+    }
+
+    unsigned int get_width() const
+    {
+        return hires ? HIRES_DISPLAY_WIDTH : DISPLAY_WIDTH;
+    }
+
+    unsigned int get_height() const
+    {
+        return hires ? HIRES_DISPLAY_HEIGHT : DISPLAY_HEIGHT;
+    }
+
+    // XO-CHIP FN01: planes (bit n = plane n) that clear, scroll and draw act
+    // on; plane 0 alone by default
+    void select_planes(uint8_t mask);
+    uint8_t get_selected_planes() const;
+
+    unsigned int get_selected_plane_count() const
+    {
+        return (selected_planes & 1) + ((selected_planes >> 1) & 1);
+    }
+
+    // Color of a pixel: bit n set if it's lit on plane n
+    unsigned int get_pixel(unsigned int x, unsigned int y) const;
+
+    // Plane 0 / plane n's packed rows (1 word per row in low resolution, 2
+    // in high resolution); the most significant bit is the leftmost pixel
+    const uint64_t* get_rows() const;
+    const uint64_t* get_plane(unsigned int plane) const;
+
+    // Fingerprint of the current display contents; a low resolution screen
+    // using only plane 0 hashes the same as it always has
+    uint64_t hash() const;
+
+    // Expand the display into get_width() * get_height() RGBA pixels
+    void expand_rgba(uint32_t* pixels) const;
+
+    // Expand only rows [first_row, first_row + row_count) of the full-size
+    // RGBA buffer
+    void expand_rgba_rows(uint32_t* pixels, unsigned int first_row, unsigned int row_count) const;
+
+    // Same, for low resolution plane 0 rows stored outside a Display (e.g.
+    // the batch engine); DISPLAY_WIDTH pixels a row
+    static void expand_rgba_rows(const uint64_t* rows, uint32_t* pixels, unsigned int first_row, unsigned int row_count);
+
+    // Bitmask of rows that differ from another display (every row if the
+    // resolution differs), e.g. a copy of what was last presented
+    uint64_t diff_rows(const Display& other) const;
+
+    // Copy this subsystem's part of a save state out / in
+    void save_state(SaveState& state) const;
+    void load_state(const SaveState& state);
 
 private:
-    uint32_t buffer[DISPLAY_WIDTH * DISPLAY_HEIGHT];
-    bool draw_flag;
+    bool draw_sprite_planes(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height, bool wide, bool clip);
+
+    template <unsigned int ROW_WORDS, bool WIDE>
+    bool draw_plane(uint64_t* words, unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height, bool clip);
+
+    unsigned int get_row_words() const;
+    uint64_t all_rows() const;
+
+    uint64_t planes[DISPLAY_PLANES][HIRES_DISPLAY_HEIGHT * HIRES_DISPLAY_WIDTH / 64];
+
+    bool hires;
+    uint8_t selected_planes;
 };
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <thread>
+
+#include "chip8.h"
+#include "constants.h"
+#include "frame_scheduler.h"
+#include "spsc_queue.h"
+#include "triple_buffer.h"
+
+// Runs a Chip8 on a thread of its own, paced by a FrameScheduler, so a slow
+// present or vsync wait on the UI thread never delays CPU cycles or timers
+//
+// The UI thread talks to it only through lock-free structures: key events go
+// in through an SPSC queue, finished frames come out through a triple buffer.
+// Neither side ever blocks the other. Between start() and stop() the Chip8
+// must not be touched from any other thread
+
+struct DisplayFrame
+{
+    Display display; // Snapshot of the screen
+    uint64_t frame_number;
+};
+
+class EmulationThread
+{
+public:
+    explicit EmulationThread(Chip8& chip8);
+    ~EmulationThread();
+
+    EmulationThread(const EmulationThread&) = delete;
+    EmulationThread& operator=(const EmulationThread&) = delete;
+
+    void start();
+    void stop();
+
+    // UI thread: queue a key event that happened at time (by the scheduler's
+    // clock; defaults to now). The next frame applies it at the cycle that
+    // corresponds to that time, so a burst of events keeps its spacing in
+    // emulated time rather than all landing on the frame's first cycle.
+    // Returns false if the queue is full and the event was dropped
+    bool keydown(uint8_t key, FrameScheduler::Clock::time_point time = FrameScheduler::Clock::now());
+    bool keyup(uint8_t key, FrameScheduler::Clock::time_point time = FrameScheduler::Clock::now());
+
+    // Turbo runs frames back to back instead of at DISPLAY_HZ; timers still
+    // tick in emulated time, so the game just runs faster
+    void set_turbo(bool enabled);
+
+    // Called on the emulation thread after each frame is published, e.g. to
+    // wake a UI thread blocked waiting for events; set before start()
+    void set_frame_callback(std::function<void()> callback);
+
+    // UI thread: pick up the newest finished frame, if there is one since
+    // the last call
+    bool update_frame();
+    const DisplayFrame& get_frame() const;
+
+    // Frames emulated since start() (any thread)
+    uint64_t get_frame_count() const;
+
+private:
+    struct KeyEvent
+    {
+        uint8_t key;
+        bool down;
+        FrameScheduler::Clock::time_point time;
+    };
+
+    void run();
+
+    // Run cycles standing for the real time from start to end, applying
+    // queued key events at their cycles along the way
+    void run_frame(uint64_t cycles, FrameScheduler::Clock::time_point start, FrameScheduler::Clock::time_point end);
+
+    Chip8& chip8;
+    FrameScheduler scheduler;
+
+    SpscQueue<KeyEvent, 256> key_events;
+    TripleBuffer<DisplayFrame> frames;
+    std::function<void()> frame_callback;
+
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<bool> turbo;
+    std::atomic<uint64_t> frame_count;
+};
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+#include "display.h"
+
+// Frame capture: records the display at every frame (each timer tick, so
+// DISPLAY_HZ in emulated time) to a video file, for QA and training data
+//
+// The emulation thread copies the display into a preallocated ring and a
+// background thread encodes and writes it. A frame identical to the last one
+// isn't copied at all, just counted, and neither is one that arrives while
+// the ring is full: capturing never waits for the writer. A dropped frame
+// shows up in the video as a repeat of the one before, so the video keeps
+// its length and timing, and is counted (get_dropped_count)
+//
+// The format comes from the file name:
+// - .avi: uncompressed 24-bit RGB AVI. Repeats are stored as empty chunks,
+//   which players show as the previous frame, so idle screens cost ~24 bytes
+//   a frame. AVI files stop growing at 2 GB (see is_truncated)
+// - .y4m: YUV4MPEG2, 4:4:4 (no chroma subsampling to smear the pixels)
+// - anything else: raw RGB24 frames back to back, no header, e.g.
+//   ffmpeg -f rawvideo -pixel_format rgb24 -video_size 128x64 -framerate 60 -i FILE
+// Y4M and raw have no way to say "same again", so the writer repeats the
+// bytes it already encoded for the previous frame
+//
+// Every frame is HIRES_DISPLAY_WIDTH x HIRES_DISPLAY_HEIGHT times the scale;
+// low resolution pixels are doubled
+
+enum class CaptureFormat
+{
+    RAW,
+    Y4M,
+    AVI,
+};
+
+class FrameCapture
+{
+public:
+    // capacity is in frames, rounded up to a power of two
+    explicit FrameCapture(size_t capacity = DEFAULT_CAPACITY);
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // Start writing to filename (truncating it) and start the writer
+    // thread; false if the file can't be opened
+    bool open(const std::string& filename, unsigned int scale = DEFAULT_SCALE);
+
+    // Write every frame captured and finish the file; call from the thread
+    // that captures (or once it has stopped)
+    void close();
+    bool is_open() const;
+
+    // Emulation thread: one frame showing display
+    void capture(const Display& display);
+
+    // Frames captured, and how many of them were repeats of the frame
+    // before (not copied) or were dropped because the writer was behind
+    uint64_t get_frame_count() const;
+    uint64_t get_repeat_count() const;
+    uint64_t get_dropped_count() const;
+
+    // Whether frames were left out of an AVI file that reached its size
+    // limit; valid after close()
+    bool is_truncated() const;
+
+    CaptureFormat get_format() const;
+    unsigned int get_width() const;
+    unsigned int get_height() const;
+
+    // About a second of distinct frames at DISPLAY_HZ
+    static const size_t DEFAULT_CAPACITY = 64;
+    static const unsigned int DEFAULT_SCALE = 1;
+
+private:
+    struct Slot
+    {
+        Display display;
+        uint64_t repeats; // Times to repeat the previous frame before this one
+    };
+
+    void write_loop();
+
+    // Writer thread (or close(), once it has stopped)
+    void write_header();
+    void write_frame(const Display& display);
+    void write_repeats(uint64_t count);
+    void finish();
+
+    // Fill encoded with display's frame in the output format (for AVI,
+    // with its chunk header)
+    void encode(const Display& display);
+
+    std::vector<Slot> ring;
+    uint64_t mask;
+
+    // Emulation thread's side: next slot, repeats not yet handed over, and
+    // the counts
+    alignas(64) uint64_t position;
+    uint64_t pending_repeats;
+    uint64_t frames;
+    uint64_t repeats;
+    uint64_t dropped;
+
+    // Frames handed over / written, on separate cache lines
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+
+    // Writer thread's side
+    alignas(64) std::ofstream out;
+    CaptureFormat format;
+    unsigned int scale;
+    unsigned int width;
+    unsigned int height;
+
+    // Each palette color in the output format: RGB, BGR or Y/Cb/Cr
+    std::array<std::array<uint8_t, 3>, 1 << DISPLAY_PLANES> colors;
+
+    // The last frame as written, and one output row's palette colors
+    std::vector<uint8_t> encoded;
+    std::vector<uint8_t> row_colors;
+
+    // AVI bookkeeping: bytes written, frames (chunks) written, the idx1
+    // entries, and whether the size limit was reached
+    uint64_t file_size;
+    uint64_t written_frames;
+    std::vector<uint8_t> index;
+    bool truncated;
+
+    std::thread writer;
+    std::atomic<bool> running;
+};
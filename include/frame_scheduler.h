@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+// Paces emulation against the host's monotonic clock: frames are due every
+// 1 / frame_hz seconds, and each due frame is worth cycles_per_frame CPU
+// cycles (fractions carry over, so 700 Hz / 60 Hz averages out exactly)
+//
+// Deadlines are absolute, so a late wake-up doesn't push every later frame
+// back. After a host stall (debugger, suspend, a slow present) at most
+// max_catch_up_frames are run back to back; anything older is dropped and
+// the schedule restarts from now instead of fast-forwarding the game
+
+class FrameScheduler
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    FrameScheduler(double frame_hz, double cycles_per_frame, unsigned int max_catch_up_frames = 5);
+
+    // Begin the schedule; the first frame is due one period from now
+    void start();
+
+    // Frames whose deadline has passed (bounded by max_catch_up_frames) and
+    // the CPU cycles they're worth; both are consumed by the call
+    unsigned int take_due_frames();
+    uint64_t take_cycles(unsigned int frames);
+
+    // Time left until the next frame is due (zero if one is already due)
+    Clock::duration time_until_next_frame() const;
+
+    // Frames skipped by stall recovery since start()
+    uint64_t get_dropped_frames() const;
+
+private:
+    Clock::duration frame_period;
+    double cycles_per_frame;
+    unsigned int max_catch_up_frames;
+
+    Clock::time_point next_frame;
+    double cycle_budget;
+    uint64_t dropped_frames;
+};
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Everything that reaches a machine from outside during a run (key presses
+// and releases, timer ticks), stamped with the CPU cycle it arrived at
+// Together with the generator state at the start of the recording this is
+// enough to replay a run bit-exactly, regardless of how fast the host was
+//
+// On disk, events are stored as a varint cycle delta plus one byte of type
+// and key, so a typical event takes 2-3 bytes
+
+class InputLog
+{
+public:
+    enum EventType : uint8_t
+    {
+        KEY_DOWN,
+        KEY_UP,
+        TIMER_TICK,
+    };
+
+    struct Event
+    {
+        uint64_t cycle; // Cycles executed since the recording started
+        EventType type;
+        uint8_t key;
+    };
+
+    InputLog();
+
+    // Start a new recording from the given generator state
+    void clear(uint64_t random_state);
+    void record(uint64_t cycle, EventType type, uint8_t key = 0);
+
+    // Length of the recorded run; replay executes this many cycles
+    void set_cycle_count(uint64_t cycles);
+    uint64_t get_cycle_count() const;
+
+    uint64_t get_random_state() const;
+    const std::vector<Event>& get_events() const;
+
+    bool save(const std::string& filename) const;
+    bool load(const std::string& filename);
+
+private:
+    uint64_t random_state;
+    uint64_t cycle_count;
+    std::vector<Event> events;
+};
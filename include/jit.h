@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "cpu.h"
+#include "memory.h"
+#include "display.h"
+#include "keypad.h"
+#include "quirks.h"
+
+// Dynamic recompiler: translates straight-line runs of CHIP-8 instructions
+// (basic blocks) into native x86-64 code and caches them by start address.
+// Anything it can't translate (drawing, key/timer reads, memory stores, ...)
+// is handed back to the Cpu interpreter one instruction at a time, as is any
+// code above the classic 4 KB (CLASSIC_MEMORY_SIZE)
+
+class Jit
+{
+public:
+    Jit();
+    ~Jit();
+
+    Jit(const Jit&) = delete;
+    Jit& operator=(const Jit&) = delete;
+
+    // False on hosts that aren't x86-64 or refuse writable+executable memory
+    bool is_available() const;
+
+    void run(Cpu& cpu, Memory& memory, Display& display, Keypad& keypad, uint64_t cycles);
+
+    // Drop every compiled block
+    void flush();
+
+private:
+    using BlockFn = void (*)(Cpu* cpu);
+
+    struct Block
+    {
+        BlockFn code;
+
+        // Memory chunks the block was translated from
+        uint64_t chunks;
+
+        // Number of CHIP-8 instructions the block executes; 0 if the block
+        // hasn't been compiled yet or its first instruction can't be compiled
+        uint16_t length;
+        bool compiled;
+    };
+
+    const Block& compile(uint16_t address, Memory& memory);
+    void invalidate(uint64_t chunks);
+
+    // Blocks indexed by start address
+    std::vector<Block> blocks;
+
+    // Union of all compiled blocks' chunks
+    uint64_t compiled_chunks;
+
+    // Quirk profile the cached blocks were translated for; blocks are thrown
+    // away when the Cpu switches profile
+    QuirkProfile quirks;
+
+    // Executable code buffer (bump allocated; flushed when full)
+    uint8_t* code_buffer;
+    size_t code_capacity;
+    size_t code_used;
+};
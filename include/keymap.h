@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <SDL3/SDL_scancode.h>
+
+// Most computers that ran the original CHIP-8 interpreter had hexadecimal
+// keypads; the COSMAC VIP keypad looked like this:
+
+// +---+---+---+---+
+// | 1 | 2 | 3 | C |
+// |---+---+---+---|
+// | 4 | 5 | 6 | D |
+// |---+---+---+---|
+// | 7 | 8 | 9 | E |
+// |---+---+---+---|
+// | A | 0 | B | F |
+// +---+---+---+---+
+
+// We'll map these keys to the 16 alphanums on the left side of the keyboard
+// The keymap uses keyboard scancodes, not ASCII character codes
+
+struct KeyBinding
+{
+    SDL_Scancode scancode;
+    uint8_t key;
+};
+
+constexpr KeyBinding KEY_BINDINGS[]{
+    {SDL_SCANCODE_1, 0x1},
+    {SDL_SCANCODE_2, 0x2},
+    {SDL_SCANCODE_3, 0x3},
+    {SDL_SCANCODE_4, 0xC},
+    {SDL_SCANCODE_Q, 0x4},
+    {SDL_SCANCODE_W, 0x5},
+    {SDL_SCANCODE_E, 0x6},
+    {SDL_SCANCODE_R, 0xD},
+    {SDL_SCANCODE_A, 0x7},
+    {SDL_SCANCODE_S, 0x8},
+    {SDL_SCANCODE_D, 0x9},
+    {SDL_SCANCODE_F, 0xE},
+    {SDL_SCANCODE_Z, 0xA},
+    {SDL_SCANCODE_X, 0x0},
+    {SDL_SCANCODE_C, 0xB},
+    {SDL_SCANCODE_V, 0xF},
+};
+
+// Marks scancodes that aren't bound to a CHIP-8 key
+constexpr uint8_t UNMAPPED_KEY = 0xFF;
+
+// KEY_BINDINGS as a table indexed by scancode, built at compile time, so a
+// key event costs one array load instead of a map lookup
+constexpr std::array<uint8_t, SDL_SCANCODE_COUNT> make_keymap()
+{
+    std::array<uint8_t, SDL_SCANCODE_COUNT> keymap{};
+    for (auto& key : keymap)
+    {
+        key = UNMAPPED_KEY;
+    }
+    for (const KeyBinding& binding : KEY_BINDINGS)
+    {
+        keymap[binding.scancode] = binding.key;
+    }
+    return keymap;
+}
+
+inline constexpr std::array<uint8_t, SDL_SCANCODE_COUNT> KEYMAP = make_keymap();
+
+// CHIP-8 key for a scancode, or UNMAPPED_KEY
+inline uint8_t map_scancode(SDL_Scancode scancode)
+{
+    return static_cast<unsigned int>(scancode) < KEYMAP.size() ? KEYMAP[scancode] : UNMAPPED_KEY;
+}
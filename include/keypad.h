@@ -2,7 +2,7 @@
 
 #include <cstdint>
 
-#include <SDL3/SDL_scancode.h>
+#include "save_state.h"
 
 class Keypad
 {
@@ -14,13 +14,24 @@ public:
     void keyup(uint8_t key);
     void clear_key_events();
 
-    // Get key state
-    bool is_pressed(uint8_t key);
-    bool is_pressed_this_loop(uint8_t key);
-    bool is_released_this_loop(uint8_t key);
+    // Get key state. Keys are 4 bits; like the VIP, only the low nibble of a
+    // larger value counts. These are single bit tests, inline so EX9E / EXA1
+    // in the dispatch loop don't pay for a call
+    bool is_pressed(uint8_t key) const { return (pressed >> (key & 0xF)) & 1; }
+    bool is_pressed_this_loop(uint8_t key) const { return (pressed_this_loop >> (key & 0xF)) & 1; }
+    bool is_released_this_loop(uint8_t key) const { return (released_this_loop >> (key & 0xF)) & 1; }
+
+    // The lowest key pressed this loop, or -1 if none was (what FX0A picks)
+    int8_t first_pressed_this_loop() const;
+
+    // Copy this subsystem's part of a save state out / in
+    void save_state(SaveState& state) const;
+    void load_state(const SaveState& state);
 
 private:
-    bool pressed[16];
-    bool pressed_this_loop[16];
-    bool released_this_loop[16];
+    // Key state as 16-bit masks (bit n = key n), the same as in save states
+    // and Chip8Batch
+    uint16_t pressed;
+    uint16_t pressed_this_loop;
+    uint16_t released_this_loop;
 };
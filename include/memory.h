@@ -1,15 +1,124 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 
 #include "constants.h"
+#include "decoder.h"
+#include "save_state.h"
+
+// MEMORY_PAGE_SIZE bytes of memory with their decoded instructions
+// Pages are reference counted and shared between Memory objects until one of
+// them writes to the page (copy-on-write). Pages nobody has written to are
+// all the same zero page, so the 64 KB address space only costs memory for
+// the parts a program actually uses
+struct alignas(64) MemoryPage
+{
+    // Decoded instruction cache with one entry per even address, so the CPU
+    // doesn't have to re-assemble and re-decode opcodes on every fetch
+    Instruction decoded[MEMORY_PAGE_SIZE / 2];
+    uint8_t data[MEMORY_PAGE_SIZE];
+
+    std::atomic<uint32_t> references;
+};
 
 class Memory
 {
 public:
-    uint8_t read(uint16_t address);
+    Memory();
+    ~Memory();
+
+    // Copying is cheap: the copy shares every page with the original, and
+    // whichever of them writes to a page first gets its own copy of it
+    // (fork()-style). The original must not be running on another thread
+    Memory(const Memory& other);
+    Memory& operator=(const Memory& other);
+
+    // Addresses wrap at the end of the address space: MEMORY_SIZE unless
+    // set smaller. A classic machine's 4 KB repeats over the whole 64 KB, the
+    // way it did on hardware that only decoded 12 address lines. Load()
+    // copies in, and save states see, the full 64 KB regardless
+    void set_address_space(unsigned int size) { address_mask = static_cast<uint16_t>(size - 1); }
+
+    uint8_t read(uint16_t address)
+    {
+        address &= address_mask;
+        return pages[address / MEMORY_PAGE_SIZE]->data[address % MEMORY_PAGE_SIZE];
+    }
+
+    // The length bytes from address, read in place if they're all on one
+    // page (nullptr if they aren't); saves sprite drawing a lookup per byte
+    const uint8_t* read_span(uint16_t address, unsigned int length)
+    {
+        address &= address_mask;
+        if (address % MEMORY_PAGE_SIZE + length > MEMORY_PAGE_SIZE)
+        {
+            return nullptr;
+        }
+
+        return pages[address / MEMORY_PAGE_SIZE]->data + address % MEMORY_PAGE_SIZE;
+    }
+
     void write(uint16_t address, uint8_t value);
 
+    // Copy a block in, re-decoding only the entries it covers; the block
+    // must fit below MEMORY_SIZE
+    void load(uint16_t address, const uint8_t* block, size_t size);
+
+    // Get the decoded instruction starting at address
+    // Inline, since it's on the interpreter's critical path
+    Instruction fetch(uint16_t address)
+    {
+        // Instructions are normally 2-byte aligned, but nothing stops a
+        // program from jumping to an odd address; those are decoded on the spot
+        if (address & 1)
+        {
+            return fetch_unaligned(address);
+        }
+
+        address &= address_mask;
+        return pages[address / MEMORY_PAGE_SIZE]->decoded[(address % MEMORY_PAGE_SIZE) / 2];
+    }
+
+    // Bitmask of the chunks (CLASSIC_MEMORY_SIZE / 64 bytes each) written
+    // since the last call; lets the JIT find compiled code that is no longer
+    // valid. Only the first CLASSIC_MEMORY_SIZE bytes, the range the JIT
+    // compiles, are tracked
+    uint64_t take_written_chunks();
+
+    // Pages this object doesn't share with any other
+    unsigned int get_private_page_count() const;
+
+    // Copy this subsystem's part of a save state out / in; loading
+    // rebuilds the decoded instruction cache and counts as writing every chunk
+    void save_state(SaveState& state) const;
+    void load_state(const SaveState& state);
+
 private:
-    uint8_t data[MEMORY_SIZE];
+    // The page at index, copied first if it's shared
+    MemoryPage* writable_page(unsigned int index)
+    {
+        if ((private_pages[index / 64] >> (index % 64)) & 1)
+        {
+            return pages[index];
+        }
+        return make_private(index);
+    }
+
+    Instruction fetch_unaligned(uint16_t address);
+    MemoryPage* make_private(unsigned int index);
+    void share_pages(const Memory& other);
+    void release_pages();
+
+    MemoryPage* pages[MEMORY_PAGE_COUNT];
+
+    // Bit n set if page n is known to be ours alone, so writes to it can
+    // skip the reference count; cleared in both objects when they're copied
+    mutable uint64_t private_pages[(MEMORY_PAGE_COUNT + 63) / 64];
+
+    uint64_t written_chunks;
+
+    // Address space size - 1; kept by copies
+    uint16_t address_mask;
 };
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+#include "display.h"
+#include "triple_buffer.h"
+
+// Present stage: turns display snapshots into the RGBA image the frontend
+// shows, on a worker thread of its own
+//
+// CHIP-8 draws by XOR, so a moving sprite is erased and redrawn every frame
+// and flickers. Each frame is blended into a phosphor "glow" buffer at the
+// display's own resolution: lit pixels light up at once, pixels that go off
+// fade by a fixed fraction per frame, so a sprite that's off for a frame
+// only dims. The result goes through the palette and is scaled up by the
+// largest whole factor that fits the output size
+//
+// The UI thread hands displays in with submit() and picks finished images up
+// with update_image(); neither waits for the other (the latest display and
+// image win). The emulation thread isn't involved at all. While pixels are
+// still fading the worker keeps rendering at DISPLAY_HZ on its own, so the
+// fade finishes even if the emulation stops publishing frames (idle)
+
+// How many images back PresentedImage keeps track of changed rows for
+const unsigned int PRESENTED_ROW_HISTORY = 4;
+
+// A finished image; width * height RGBA pixels (bytes in memory), the size
+// depending on the output size and the display's resolution
+struct PresentedImage
+{
+    std::vector<uint32_t> pixels;
+    unsigned int width;
+    unsigned int height;
+    unsigned int scale;
+
+    // Images are numbered from 1 as they're rendered. Bit y of
+    // changed_rows[i] is set if display row y (image rows y * scale up to
+    // (y + 1) * scale) differs from image sequence - 1 - i
+    uint64_t sequence{ 0 };
+    std::array<uint64_t, PRESENTED_ROW_HISTORY> changed_rows{};
+
+    // Display rows that differ from image number earlier; every row if it's
+    // too far back (or 0, nothing) to tell, e.g. to update a texture that
+    // holds image earlier with only the bands that changed
+    uint64_t rows_changed_since(uint64_t earlier) const;
+};
+
+class Presenter
+{
+public:
+    Presenter();
+    ~Presenter();
+
+    Presenter(const Presenter&) = delete;
+    Presenter& operator=(const Presenter&) = delete;
+
+    // Settings; any thread, taking effect from the next frame rendered
+    // decay is the fraction of its brightness an unlit pixel keeps per
+    // frame: 0 turns the blending off, 0.99 is the longest trail
+    void set_phosphor_decay(double decay);
+    void set_palette(const std::array<uint32_t, 1 << DISPLAY_PLANES>& palette);
+
+    // Size the image should fit in, e.g. the window's size in pixels
+    void set_output_size(unsigned int width, unsigned int height);
+
+    // Called on the worker after each image is published, e.g. to wake a UI
+    // thread blocked waiting for events; set before start()
+    void set_image_callback(std::function<void()> callback);
+
+    void start();
+    void stop();
+
+    // UI thread: hand over the newest display snapshot
+    void submit(const Display& display);
+
+    // UI thread: pick up the newest finished image, if there is one since
+    // the last call
+    bool update_image();
+    const PresentedImage& get_image() const;
+
+    // The stage itself, run synchronously (the worker calls it per frame):
+    // blend display in and write image. Returns false, leaving image alone,
+    // if the image would be the same as the last one rendered
+    bool render(const Display& display, PresentedImage& image);
+
+    // Whether pixels are still fading, i.e. render() with the same display
+    // would change the image
+    bool is_fading() const;
+
+private:
+    void run();
+
+    // Settings, guarded by mutex; render() takes a copy per frame
+    struct Settings
+    {
+        uint16_t decay; // Fraction kept per frame, in 65536ths
+        std::array<uint32_t, 1 << DISPLAY_PLANES> palette;
+        unsigned int output_width;
+        unsigned int output_height;
+    };
+
+    // Worker-side kernels; n is in pixels. expand() keeps a lookup table for
+    // the palette it was last called with
+    void expand(const Display& display, const std::array<uint32_t, 1 << DISPLAY_PLANES>& palette, uint32_t* pixels);
+    static bool blend(const uint32_t* target, uint16_t* glow, uint16_t decay, uint32_t* pixels, size_t n);
+    static void upscale(const uint32_t* source, unsigned int width, unsigned int height, unsigned int scale, uint64_t rows, uint32_t* pixels);
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    Settings settings;
+    Display pending; // Latest display from submit()
+    bool fresh; // pending hasn't been rendered yet
+    bool running;
+
+    // Worker's state: the glow buffer (4 channels per pixel, 8.8 fixed
+    // point), this frame's palette colors and blended pixels, what the last
+    // image was made from, and the rows each of the last few images changed
+    // (newest first)
+    std::vector<uint16_t> glow;
+    std::vector<uint32_t> target;
+    std::vector<uint32_t> blended;
+    std::vector<uint32_t> shown;
+    unsigned int shown_width;
+    unsigned int shown_height;
+    unsigned int shown_scale;
+    uint64_t sequence;
+    std::array<uint64_t, PRESENTED_ROW_HISTORY> row_history;
+    std::atomic<bool> fading;
+
+    // expand()'s table: the 8 pixels of every byte of plane 1 with plane 2
+    // off, in expansion_palette's colors
+    std::vector<std::array<uint32_t, 8>> expansion;
+    std::array<uint32_t, 1 << DISPLAY_PLANES> expansion_palette;
+
+    TripleBuffer<PresentedImage> images;
+    std::function<void()> image_callback;
+    std::thread thread;
+};
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "constants.h"
+#include "decoder.h"
+
+// Instrumentation policies for Cpu, chosen at build time with the
+// CHIP8_INSTRUMENT CMake option
+//
+// The CPU calls the same hooks either way. With NullProbe they are empty
+// inline functions and compile away completely, so a normal build is
+// unaffected; CountingProbe records what ROMs actually spend their cycles on
+
+// Does nothing; the default
+class NullProbe
+{
+public:
+    static const bool ENABLED = false;
+
+    void on_instruction(uint16_t /*address*/, Op /*op*/) {}
+    void on_draw_row(unsigned int /*x*/, uint8_t /*sprite_data*/, unsigned int /*screen_width*/) {}
+    void on_draw(bool /*collision*/) {}
+    void on_key_wait(bool /*done*/) {}
+
+    void reset() {}
+    void write_json(std::ostream& out) const;
+    void write_csv(std::ostream& out) const;
+};
+
+// Counts executed operations, per-address execution (a PC heat map), sprite
+// draws and FX0A spinning
+class CountingProbe
+{
+public:
+    static const bool ENABLED = true;
+
+    CountingProbe();
+
+    void on_instruction(uint16_t address, Op op)
+    {
+        ++op_counts[op];
+        ++pc_counts[address & (MEMORY_SIZE - 1)];
+    }
+
+    // One byte (8 pixels) of a sprite row; only pixels that land on screen
+    // count as drawn
+    void on_draw_row(unsigned int x, uint8_t sprite_data, unsigned int screen_width)
+    {
+        const unsigned int clipped = x >= screen_width ? 8 : x + 8 > screen_width ? x + 8 - screen_width : 0;
+        pixels_drawn += clipped < 8 ? popcount(sprite_data >> clipped) : 0;
+        ++rows_drawn;
+    }
+
+    void on_draw(bool collision)
+    {
+        ++draws;
+        collisions += collision;
+    }
+
+    // Every FX0A execution; done is false while it's still waiting
+    void on_key_wait(bool done)
+    {
+        key_wait_cycles += !done;
+        key_waits_completed += done;
+    }
+
+    void reset();
+    void write_json(std::ostream& out) const;
+    void write_csv(std::ostream& out) const;
+
+    uint64_t get_op_count(Op op) const { return op_counts[op]; }
+    uint64_t get_pc_count(uint16_t address) const { return pc_counts[address & (MEMORY_SIZE - 1)]; }
+
+private:
+    static unsigned int popcount(uint8_t bits)
+    {
+        unsigned int count = 0;
+        for (; bits; bits &= bits - 1)
+        {
+            ++count;
+        }
+        return count;
+    }
+
+    uint64_t op_counts[OP_COUNT];
+    std::vector<uint64_t> pc_counts; // MEMORY_SIZE entries; too big to keep inline in Cpu
+
+    uint64_t draws;
+    uint64_t rows_drawn;
+    uint64_t pixels_drawn;
+    uint64_t collisions;
+
+    uint64_t key_wait_cycles; // Cycles spent re-executing FX0A
+    uint64_t key_waits_completed;
+};
+
+#ifdef CHIP8_INSTRUMENT
+using CpuProbe = CountingProbe;
+#else
+using CpuProbe = NullProbe;
+#endif
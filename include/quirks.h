@@ -0,0 +1,130 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "constants.h"
+#include "decoder.h"
+
+// CHIP-8 interpreters disagree about a handful of instructions ("quirks"),
+// and ROMs are written against one of them. Each profile below is the set of
+// behaviors of one well-known interpreter
+//
+// Cpu compiles a separate dispatch loop per profile with the choices folded
+// in as constants, and picks the loop when it starts running; the JIT and
+// Chip8Batch read the same table when translating / executing
+
+enum QuirkProfile : uint8_t
+{
+    QUIRKS_VIP,    // COSMAC VIP, the original interpreter
+    QUIRKS_CHIP48, // CHIP-48 on the HP 48 calculators
+    QUIRKS_SCHIP,  // SUPER-CHIP 1.1 (what most modern ROMs expect)
+    QUIRKS_XOCHIP, // XO-CHIP, as implemented by Octo
+    QUIRK_PROFILE_COUNT
+};
+
+// How FX55 / FX65 leave the index register
+enum IndexIncrement : uint8_t
+{
+    INDEX_UNCHANGED,
+    INDEX_PLUS_X,       // I += X
+    INDEX_PLUS_X_PLUS_1 // I += X + 1, pointing past the last register
+};
+
+struct Quirks
+{
+    bool vf_reset;       // 8XY1 / 8XY2 / 8XY3 clear VF
+    bool shift_uses_vy;  // 8XY6 / 8XYE shift VY into VX, rather than VX in place
+    bool jump_uses_v0;   // BNNN jumps to NNN + V0, rather than XNN + VX
+    IndexIncrement load_store_index;
+    bool index_overflow; // FX1E sets VF when I goes past 0xFFF (Amiga interpreter)
+    bool clip_sprites;   // Sprites are cut off at the screen edges, rather than wrapped
+    bool long_skips;     // Skips step over XO-CHIP's 4-byte F000 NNNN as a whole
+    bool big_sprites;    // DXY0 draws a 16x16 sprite, rather than nothing
+    bool schip_ops;      // SUPER-CHIP's scrolling, resolution, exit, big digit and flag instructions exist
+    bool xochip_ops;     // XO-CHIP's instructions exist (5XY2 / 5XY3, F000, FN01, F002, FX3A, 00DN)
+};
+
+// Indexed by QuirkProfile
+constexpr Quirks QUIRK_PROFILES[QUIRK_PROFILE_COUNT] = {
+    // vf_reset, shift_uses_vy, jump_uses_v0, load_store_index, index_overflow, clip_sprites, long_skips, big_sprites,
+    // schip_ops, xochip_ops
+    { true, true, true, INDEX_PLUS_X_PLUS_1, false, true, false, false, false, false },
+    { false, false, false, INDEX_PLUS_X, false, true, false, false, false, false },
+
+    // FX1E keeps setting VF on overflow; the emulator always did this, and
+    // Spacefight 2091! relies on it
+    { false, false, false, INDEX_UNCHANGED, true, true, false, true, true, false },
+
+    { false, false, false, INDEX_PLUS_X_PLUS_1, false, false, true, true, true, true },
+};
+
+// Address space under these quirks: XO-CHIP's 64 KB, or the classic 4 KB
+// everything before it had. Addresses wrap at its end, and a ROM has to fit
+// between START_ADDRESS and it
+constexpr unsigned int memory_size(const Quirks& quirks)
+{
+    return quirks.xochip_ops ? MEMORY_SIZE : CLASSIC_MEMORY_SIZE;
+}
+
+constexpr unsigned int max_rom_size(const Quirks& quirks)
+{
+    return memory_size(quirks) - START_ADDRESS;
+}
+
+// What an instruction decoded as op does under these quirks. The decoder
+// knows every extension; an interpreter without one runs its instructions
+// the way it would have anyway: 5XY2 / 5XY3 compare like 5XY0 (the VIP
+// never looked at N), and the rest are machine code calls or unknown
+// opcodes, which do nothing
+constexpr Op effective_op(const Quirks& quirks, Op op)
+{
+    switch (op)
+    {
+    case OP_00CN:
+    case OP_00FB:
+    case OP_00FC:
+    case OP_00FD:
+    case OP_00FE:
+    case OP_00FF:
+    case OP_FX30:
+    case OP_FX75:
+    case OP_FX85:
+        return quirks.schip_ops ? op : OP_INVALID;
+    case OP_5XY2:
+    case OP_5XY3:
+        return quirks.xochip_ops ? op : OP_5XY0;
+    case OP_00DN:
+    case OP_F000:
+    case OP_FN01:
+    case OP_F002:
+    case OP_FX3A:
+        return quirks.xochip_ops ? op : OP_INVALID;
+    default:
+        return op;
+    }
+}
+
+// What a Chip8 starts with; matches the emulator's behavior from before
+// quirks were selectable
+const QuirkProfile DEFAULT_QUIRK_PROFILE = QUIRKS_SCHIP;
+
+inline const char* quirk_profile_name(QuirkProfile profile)
+{
+    static const char* const names[QUIRK_PROFILE_COUNT] = { "vip", "chip48", "schip", "xochip" };
+    return profile < QUIRK_PROFILE_COUNT ? names[profile] : "unknown";
+}
+
+// Accepts the names above (as used by the tools' --quirks option)
+inline bool parse_quirk_profile(const char* name, QuirkProfile& profile)
+{
+    for (int i = 0; i < QUIRK_PROFILE_COUNT; ++i)
+    {
+        if (std::strcmp(name, quirk_profile_name(static_cast<QuirkProfile>(i))) == 0)
+        {
+            profile = static_cast<QuirkProfile>(i);
+            return true;
+        }
+    }
+    return false;
+}
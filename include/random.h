@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+
+// Small per-instance PRNG (xorshift64*) for CXNN
+// Each machine owns one, so there is no shared libc rand() state to contend
+// on between threads, and a seeded machine produces the same sequence on
+// every run
+
+class Random
+{
+public:
+    explicit Random(uint64_t seed_value = 0)
+    {
+        seed(seed_value);
+    }
+
+    void seed(uint64_t value)
+    {
+        // Scramble the seed (splitmix64 finalizer) so nearby seeds such as
+        // 0, 1, 2 start far apart; xorshift gets stuck on an all-zero state
+        value += 0x9E3779B97F4A7C15;
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EB;
+        value ^= value >> 31;
+
+        state = value != 0 ? value : 1;
+    }
+
+    uint64_t next()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return state * 0x2545F4914F6CDD1D;
+    }
+
+    uint8_t next_byte()
+    {
+        // The high bits are the best mixed
+        return next() >> 56;
+    }
+
+    // Raw generator state, for save states and input logs
+    uint64_t get_state() const
+    {
+        return state;
+    }
+
+    void set_state(uint64_t value)
+    {
+        state = value != 0 ? value : 1;
+    }
+
+private:
+    uint64_t state;
+};
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "constants.h"
+#include "decoder.h"
+#include "memory.h"
+#include "quirks.h"
+
+// A ROM file read in full and checked to fit in memory above START_ADDRESS
+class RomFile
+{
+public:
+    // max_size: the most bytes that fit above START_ADDRESS on the machine
+    // it's for (see max_rom_size() in quirks.h)
+    explicit RomFile(const std::string& filename, size_t max_size = MAX_ROM_SIZE);
+
+    // False if the file couldn't be read, is empty or is too large; the
+    // reason is in get_error()
+    bool is_valid() const;
+    const std::string& get_error() const;
+
+    const uint8_t* data() const;
+    size_t size() const;
+
+private:
+    std::vector<uint8_t> bytes; // Sized to the file
+    bool valid;
+    std::string error;
+};
+
+// A ROM ready to start from: the whole power-on memory (font set plus
+// program, already decoded). Machines started from it share its pages
+// copy-on-write, so starting one copies nothing and only the pages a
+// program writes to are ever duplicated
+struct RomImage
+{
+    uint64_t hash; // FNV-1a of the program bytes
+    size_t size;   // Program size in bytes
+
+    // Flat copy, for engines that keep their own memory (Chip8Batch)
+    uint8_t bytes[MEMORY_SIZE];
+
+    // Shared pages; never written after the image is built
+    Memory memory;
+};
+
+// Content-addressed cache of RomImages: each distinct program is read,
+// validated and decoded once, however many machines or jobs use it, and
+// files with identical contents share one image
+//
+// Images live as long as the store; it's safe to load from several threads.
+// Files are assumed not to change while the store is in use
+class RomStore
+{
+public:
+    // nullptr (with a message on stderr) if the file isn't a valid ROM, or
+    // is too large for the memory of a machine with this quirk profile
+    const RomImage* load(const std::string& filename, QuirkProfile profile);
+
+    // Image for a program already in memory; nullptr if it's empty or too
+    // large for the profile
+    const RomImage* add(const uint8_t* data, size_t size, QuirkProfile profile);
+
+    // Number of distinct images
+    size_t size() const;
+
+private:
+    const RomImage* add_locked(const uint8_t* data, size_t size);
+
+    mutable std::mutex mutex;
+    std::unordered_map<uint64_t, std::vector<std::unique_ptr<RomImage>>> images; // By content hash
+    std::unordered_map<std::string, const RomImage*> paths;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <type_traits>
+
+#include "constants.h"
+
+// Snapshot of a whole machine in one fixed-layout block, so saving and
+// restoring is a struct copy and a state file is just these bytes on disk
+// (host byte order, which is little-endian on every platform we build for)
+//
+// Bump SAVE_STATE_VERSION whenever the layout changes; old files are rejected
+// rather than misread
+
+const uint32_t SAVE_STATE_MAGIC = 0x53533843; // "C8SS"
+const uint32_t SAVE_STATE_VERSION = 4;
+
+struct SaveState
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size; // sizeof(SaveState), catches truncated files
+
+    // Cpu
+    uint16_t program_counter;
+    uint16_t index_register;
+    uint64_t random_state; // CXNN generator
+    uint16_t stack[MAX_CALLSTACK];
+    uint8_t registers[NUMBER_OF_REGISTERS];
+    uint8_t stack_pointer;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    int8_t last_key_pressed;
+
+    // Keypad, one bit per key
+    uint16_t keys_pressed;
+    uint16_t keys_pressed_this_loop;
+    uint16_t keys_released_this_loop;
+
+    // Display mode and FN01 plane selection
+    uint8_t display_hires;
+    uint8_t display_selected_planes;
+
+    // Cpu, SUPER-CHIP / XO-CHIP extras
+    uint8_t audio_pitch;
+    uint8_t reserved[3]; // Zero; pads the display planes to 8 bytes
+    uint8_t flags[NUMBER_OF_FLAGS];
+    uint8_t audio_pattern[AUDIO_PATTERN_SIZE];
+
+    // Chip8, emulated time: cycles run and timer ticks so far, so run_timed
+    // picks up at the same point between ticks
+    uint64_t cycle_count;
+    uint64_t timer_ticks;
+
+    // Display, packed rows of each plane (see Display)
+    uint64_t display_planes[DISPLAY_PLANES][HIRES_DISPLAY_HEIGHT * HIRES_DISPLAY_WIDTH / 64];
+
+    // Memory
+    uint8_t memory[MEMORY_SIZE];
+};
+
+static_assert(std::is_trivially_copyable<SaveState>::value, "SaveState must be copyable with memcpy");
+static_assert(offsetof(SaveState, display_planes) % 8 == 0, "Display rows must be 8-byte aligned in the file");
+static_assert(sizeof(SaveState) == 136 + DISPLAY_PLANES * HIRES_DISPLAY_HEIGHT * HIRES_DISPLAY_WIDTH / 8 + MEMORY_SIZE,
+    "SaveState layout changed; bump SAVE_STATE_VERSION");
+
+// True if the header matches this build's magic, version and size and every
+// field with a limited range (stack pointer, pending FX0A key, display mode
+// and planes) is within it
+bool is_valid_save_state(const SaveState& state);
+
+// Write a state to disk in a single write; returns false on I/O error
+bool write_save_state(const std::string& filename, const SaveState& state);
+
+// Read-only view of a state file; mapped straight from disk where mmap is
+// available, so opening a state doesn't copy it
+class MappedSaveState
+{
+public:
+    explicit MappedSaveState(const std::string& filename);
+    ~MappedSaveState();
+
+    MappedSaveState(const MappedSaveState&) = delete;
+    MappedSaveState& operator=(const MappedSaveState&) = delete;
+
+    // nullptr if the file couldn't be opened or isn't a valid state
+    const SaveState* get() const;
+
+private:
+    void release();
+
+    const SaveState* state;
+    bool mapped;
+};
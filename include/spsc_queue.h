@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single-producer/single-consumer ring buffer of fixed capacity
+// Pushing to a full queue and popping from an empty one fail immediately
+// instead of waiting
+//
+// Capacity must be a power of two; one slot is kept free to tell full from
+// empty, so it holds Capacity - 1 items
+
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() :
+        items{},
+        head{ 0 },
+        tail{ 0 }
+    {
+    }
+
+    // Producer only
+    bool try_push(const T& item)
+    {
+        const size_t position = tail.load(std::memory_order_relaxed);
+        const size_t next = (position + 1) & (Capacity - 1);
+
+        if (next == head.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        items[position] = item;
+        tail.store(next, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer only
+    bool try_pop(T& item)
+    {
+        const size_t position = head.load(std::memory_order_relaxed);
+
+        if (position == tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+
+        item = items[position];
+        head.store((position + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+private:
+    T items[Capacity];
+
+    // Kept on separate cache lines so the two threads don't false-share
+    alignas(64) std::atomic<size_t> head; // Next item to pop
+    alignas(64) std::atomic<size_t> tail; // Next free slot
+};
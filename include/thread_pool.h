@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Runs a fixed set of independent jobs on a pool of worker threads. Each
+// worker owns a deque of job indices and works from its back; a worker whose
+// deque runs dry steals from the front of the others', so long jobs on one
+// thread don't leave the rest idle
+
+class WorkStealingPool
+{
+public:
+    // thread_count 0 means one thread per hardware core
+    explicit WorkStealingPool(size_t thread_count = 0);
+
+    size_t get_thread_count() const;
+
+    // Calls job(job_index, worker_index) for every job in [0, job_count) and
+    // returns once all of them have finished. worker_index is stable per
+    // thread, so callers can keep reusable per-worker state
+    void run(size_t job_count, const std::function<void(size_t, size_t)>& job);
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+
+    bool pop(size_t worker, size_t& job);
+    bool steal(size_t thief, size_t& job);
+
+    size_t thread_count;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+};
@@ -0,0 +1,174 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "constants.h"
+
+// Execution tracer: one fixed-size record per executed instruction (cycle,
+// address, opcode and the CPU state after it), written by the emulation
+// thread into a ring buffer and flushed to disk by a background thread
+//
+// Recording is a 32-byte store and an index bump; everything else (working
+// out which registers changed, encoding, file I/O) happens on the writer
+// thread. If the writer falls a whole ring behind, the emulation waits for
+// it rather than dropping records, so a trace never has gaps. A machine
+// that isn't tracing doesn't touch any of this (see Chip8::start_tracing)
+//
+// On disk, each record is a flags byte, the address, opcode and VF, then
+// only what changed: the cycle delta if it isn't 1, I, and the other
+// registers that changed (a mask and their new values). A typical
+// instruction takes 6-9 bytes. chip8_trace decodes and disassembles it
+
+// What the emulation thread writes per instruction
+struct TraceRecord
+{
+    uint64_t cycle; // Cycles executed before this instruction
+    uint16_t address;
+    uint16_t opcode;
+    uint16_t index_register; // I after the instruction
+    uint16_t unused;
+    std::array<uint8_t, NUMBER_OF_REGISTERS> registers; // V0..VF after the instruction
+};
+
+static_assert(sizeof(TraceRecord) == 32, "TraceRecord should stay two to a cache line");
+
+class Tracer
+{
+public:
+    // capacity is in records, rounded up to a power of two
+    explicit Tracer(size_t capacity = DEFAULT_CAPACITY);
+    ~Tracer();
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    // Start writing to filename (truncating it) and start the writer thread;
+    // false if the file can't be opened
+    bool open(const std::string& filename);
+
+    // Flush every record and stop the writer thread; call from the thread
+    // that records (or once it has stopped)
+    void close();
+    bool is_open() const;
+
+    // Cycle number of the next record; Chip8 sets it when tracing starts
+    void set_cycle(uint64_t cycle);
+
+    // Emulation thread: append one record. Publishes to the writer thread
+    // every PUBLISH_INTERVAL records; publish() hands over the rest (Cpu
+    // calls it at the end of every run)
+    void record(uint16_t address, uint16_t opcode, uint16_t index_register,
+        const std::array<uint8_t, NUMBER_OF_REGISTERS>& registers)
+    {
+        if (position == limit)
+        {
+            wait_for_space();
+        }
+
+        TraceRecord& entry = ring[position & mask];
+        entry.cycle = cycle++;
+        entry.address = address;
+        entry.opcode = opcode;
+        entry.index_register = index_register;
+        entry.registers = registers;
+
+        if ((++position & (PUBLISH_INTERVAL - 1)) == 0)
+        {
+            head.store(position, std::memory_order_release);
+        }
+    }
+
+    void publish()
+    {
+        head.store(position, std::memory_order_release);
+    }
+
+    // Records traced so far, and how often recording had to wait for the
+    // writer (a sign the ring is too small or the disk too slow)
+    uint64_t get_record_count() const;
+    uint64_t get_stall_count() const;
+
+    static const size_t DEFAULT_CAPACITY = 1 << 18;
+    static const uint64_t PUBLISH_INTERVAL = 256;
+
+private:
+    void wait_for_space();
+    void write_loop();
+
+    // Encode ring entries [from, to) and write them out
+    void flush(uint64_t from, uint64_t to);
+
+    std::vector<TraceRecord> ring;
+    uint64_t mask;
+
+    // Emulation thread's side: next record's slot and cycle, and how far it
+    // may write before it has to check on the writer again. Written every
+    // record, so kept off the cache lines the writer reads
+    alignas(64) uint64_t position;
+    uint64_t limit;
+    uint64_t cycle;
+    uint64_t stalls;
+
+    // Records published by the emulation thread / consumed by the writer;
+    // on separate cache lines so the two threads don't share one
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+
+    // Writer thread's side
+    alignas(64) std::ofstream out;
+    std::vector<uint8_t> buffer;
+    size_t pending; // Encoded bytes in buffer not yet written
+    uint64_t previous_cycle;
+    uint16_t previous_index;
+    std::array<uint8_t, NUMBER_OF_REGISTERS> previous_registers;
+
+    std::thread writer;
+    std::atomic<bool> running;
+};
+
+// One decoded trace record, as chip8_trace sees it
+struct TraceEntry
+{
+    uint64_t cycle;
+    uint16_t address;
+    uint16_t opcode;
+    uint16_t index_register;
+    bool index_changed;
+    uint16_t changed; // Bit n set if Vn changed (VF included)
+    std::array<uint8_t, NUMBER_OF_REGISTERS> registers;
+};
+
+// Streams a trace file back one record at a time
+class TraceReader
+{
+public:
+    TraceReader();
+
+    bool open(const std::string& filename);
+
+    // False at the end of the file, or if it's truncated / corrupt (see
+    // is_corrupt)
+    bool next(TraceEntry& entry);
+    bool is_corrupt() const;
+
+private:
+    bool get_byte(uint8_t& byte);
+    bool get_u16(uint16_t& value);
+    bool get_varint(uint64_t& value);
+
+    std::ifstream in;
+    std::vector<char> buffer;
+    size_t buffered;
+    size_t offset;
+    bool corrupt;
+
+    uint64_t cycle;
+    uint16_t index_register;
+    std::array<uint8_t, NUMBER_OF_REGISTERS> registers;
+};
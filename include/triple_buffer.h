@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free single-producer/single-consumer triple buffer
+// The producer always has a slot of its own to write the next value into and
+// the consumer always has a slot of its own to read; the third slot sits in
+// the middle holding the most recent published value. Publishing and picking
+// up are single atomic exchanges, so neither side ever waits on the other,
+// and a slow consumer simply skips values it never got to
+
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer() :
+        slots{},
+        back{ 0 },
+        middle{ 1 },
+        front{ 2 }
+    {
+    }
+
+    // Producer: the slot to fill in before publish()
+    T& write_slot()
+    {
+        return slots[back];
+    }
+
+    // Producer: make the write slot the latest value
+    void publish()
+    {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Consumer: switch to the latest value if one was published since the
+    // last call; returns false (and keeps the old value) otherwise
+    bool update()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+        {
+            return false;
+        }
+
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    // Consumer: the value picked up by the last successful update()
+    const T& read_slot() const
+    {
+        return slots[front];
+    }
+
+private:
+    // The middle index carries a flag saying it holds a value the consumer
+    // hasn't seen yet
+    static const uint8_t FRESH = 0x4;
+    static const uint8_t INDEX_MASK = 0x3;
+
+    T slots[3];
+
+    uint8_t back; // Producer only
+    std::atomic<uint8_t> middle;
+    uint8_t front; // Consumer only
+};
@@ -2,12 +2,14 @@
 
 #include <chrono>
 
-double get_time_in_ms()
+// Milliseconds on the monotonic clock; only differences between calls are
+// meaningful (unlike system_clock, it never jumps when the wall clock is set)
+inline double get_time_in_ms()
 {
     using namespace std::chrono;
     using double_ms = duration<double, std::chrono::milliseconds::period>;
 
-    auto now = system_clock::now().time_since_epoch();
+    auto now = steady_clock::now().time_since_epoch();
     double now_ms = duration_cast<double_ms>(now).count();
 
     return now_ms;
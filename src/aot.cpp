@@ -0,0 +1,153 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "aot.h"
+
+namespace
+{
+    std::vector<const AotProgram*>& registry()
+    {
+        // Function-local, so generated files' static registrations can run
+        // in any order relative to this file's initialization
+        static std::vector<const AotProgram*> programs;
+        return programs;
+    }
+
+    // Chunks covering [address, address + size)
+    uint64_t chunk_range(uint16_t address, uint16_t size)
+    {
+        uint64_t chunks = 0;
+        const unsigned int last = std::min<unsigned int>(address + size, CLASSIC_MEMORY_SIZE) - 1;
+
+        for (unsigned int chunk = address / MEMORY_CHUNK_SIZE; chunk <= last / MEMORY_CHUNK_SIZE; ++chunk)
+        {
+            chunks |= uint64_t{ 1 } << chunk;
+        }
+        return chunks;
+    }
+}
+
+AotContext::AotContext(Cpu& cpu, Memory& memory, Display& display, Keypad& keypad) :
+    V{ cpu.registers },
+    I{ cpu.index_register },
+    cpu{ cpu },
+    memory{ memory },
+    display{ display },
+    keypad{ keypad }
+{
+}
+
+uint16_t AotContext::interpret(uint16_t address)
+{
+    cpu.program_counter = address;
+    cpu.tick(memory, display, keypad);
+    return cpu.program_counter;
+}
+
+AotRegistration::AotRegistration(const AotProgram& program)
+{
+    registry().push_back(&program);
+}
+
+const AotProgram* find_aot_program(const uint8_t* rom, size_t size)
+{
+    for (const AotProgram* program : registry())
+    {
+        if (program->rom_size == size && std::memcmp(program->rom, rom, size) == 0)
+        {
+            return program;
+        }
+    }
+    return nullptr;
+}
+
+const std::vector<const AotProgram*>& get_aot_programs()
+{
+    return registry();
+}
+
+Aot::Aot(const AotProgram& program) :
+    program{ program },
+    entries(CLASSIC_MEMORY_SIZE, nullptr),
+    block_chunks(program.block_count),
+    stale_chunks{ ~uint64_t{ 0 } }
+{
+    for (size_t i = 0; i < program.block_count; ++i)
+    {
+        block_chunks[i] = chunk_range(program.blocks[i].address, program.blocks[i].size);
+    }
+}
+
+const AotProgram& Aot::get_program() const
+{
+    return program;
+}
+
+void Aot::flush()
+{
+    stale_chunks = ~uint64_t{ 0 };
+}
+
+void Aot::verify(Memory& memory, uint64_t chunks)
+{
+    for (size_t i = 0; i < program.block_count; ++i)
+    {
+        if ((block_chunks[i] & chunks) == 0)
+        {
+            continue;
+        }
+
+        // The block stands only if memory still holds the bytes it was
+        // translated from
+        const AotBlock& block = program.blocks[i];
+        const uint8_t* expected = program.rom + (block.address - START_ADDRESS);
+        bool matches = true;
+
+        for (uint16_t offset = 0; offset < block.size && matches; ++offset)
+        {
+            matches = memory.read(block.address + offset) == expected[offset];
+        }
+
+        entries[block.address] = matches ? &block : nullptr;
+    }
+}
+
+void Aot::run(Cpu& cpu, Memory& memory, Display& display, Keypad& keypad, uint64_t cycles)
+{
+    // Translated for another profile's quirks
+    if (cpu.quirks != program.quirks)
+    {
+        cpu.run(memory, display, keypad, cycles);
+        return;
+    }
+
+    AotContext context(cpu, memory, display, keypad);
+
+    while (cycles > 0)
+    {
+        // Anything may have been written since the last run (e.g. a new ROM)
+        // or by the last block or instruction
+        const uint64_t written = stale_chunks | memory.take_written_chunks();
+        if (written != 0)
+        {
+            verify(memory, written);
+            stale_chunks = 0;
+        }
+
+        const uint16_t address = cpu.program_counter;
+        const AotBlock* block = address < CLASSIC_MEMORY_SIZE ? entries[address] : nullptr;
+
+        if (block && block->length <= cycles)
+        {
+            cpu.program_counter = block->code(context);
+            cycles -= block->length;
+        }
+        else
+        {
+            cpu.tick(memory, display, keypad);
+            --cycles;
+        }
+    }
+}
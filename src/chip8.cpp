@@ -1,73 +1,367 @@
+#include <algorithm>
+#include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <string>
-#include <fstream>
 #include <iostream>
 
 #include "chip8.h"
 
-Chip8::Chip8()
+Chip8::Chip8() :
+    cycle_count{ 0 },
+    timer_ticks{ 0 },
+    recording{ nullptr },
+    recording_start{ 0 },
+    tracer{ nullptr },
+    capture{ nullptr }
 {
+    memory.set_address_space(memory_size(QUIRK_PROFILES[cpu.get_quirks()]));
     load_font_set();
 }
 
-void Chip8::load_font_set()
+Chip8::Chip8(const Chip8& other) :
+    cpu{ other.cpu },
+    memory{ other.memory },
+    display{ other.display },
+    keypad{ other.keypad },
+    cycle_count{ other.cycle_count },
+    timer_ticks{ other.timer_ticks },
+    recording{ nullptr },
+    recording_start{ 0 },
+    tracer{ nullptr },
+    capture{ nullptr }
 {
-    for (int i = 0; i < sizeof(FONT_SET); ++i)
+    cpu.set_tracer(nullptr);
+
+    if (other.jit)
+    {
+        enable_jit();
+    }
+    else if (other.aot)
     {
-        memory.write(FONT_SET_START_ADDRESS + i, FONT_SET[i]);
+        enable_aot(other.aot->get_program());
     }
 }
 
-void Chip8::load_rom(std::string filename)
+Chip8 Chip8::clone() const
 {
-    // Load ROM as binary and position pointer at end of file
-    std::ifstream file_in(filename, std::ios::binary | std::ios::ate);
+    return Chip8(*this);
+}
 
-    if (!file_in.is_open())
+void Chip8::reset()
+{
+    const QuirkProfile quirks = cpu.get_quirks();
+    const bool idle_skipping = cpu.get_idle_skipping();
+    cpu = Cpu();
+    cpu.set_quirks(quirks);
+    cpu.set_idle_skipping(idle_skipping);
+    memory = Memory();
+    memory.set_address_space(memory_size(QUIRK_PROFILES[quirks]));
+    display = Display();
+    keypad = Keypad();
+
+    load_font_set();
+
+    cycle_count = 0;
+    timer_ticks = 0;
+    recording = nullptr;
+    tracer = nullptr;
+    capture = nullptr;
+
+    if (jit)
     {
-        std::cerr << "Failed to load ROM" << std::endl;
-        return;
+        jit->flush();
     }
+    if (aot)
+    {
+        aot->flush();
+    }
+}
 
-    // tellg() gets current pointer pointer
-    const int file_length = file_in.tellg();
+void Chip8::load_font_set()
+{
+    memory.load(FONT_SET_START_ADDRESS, FONT_SET, sizeof(FONT_SET));
+    memory.load(BIG_FONT_SET_START_ADDRESS, BIG_FONT_SET, sizeof(BIG_FONT_SET));
+}
+
+bool Chip8::load_rom(std::string filename)
+{
+    // Read into a buffer the size of the file, then copied in with a single
+    // bulk load
+    const RomFile rom(filename, max_rom_size(QUIRK_PROFILES[cpu.get_quirks()]));
+
+    if (!rom.is_valid())
+    {
+        std::cerr << rom.get_error() << std::endl;
+        return false;
+    }
 
-    // Return pointer to beginning of file
-    file_in.seekg(0, file_in.beg);
+    return load_program(rom.data(), rom.size());
+}
 
-    // Dynamic (heap) allocation since length not known at compile time
-    char* buffer = new char[file_length];
+bool Chip8::load_program(const uint8_t* data, size_t size)
+{
+    const unsigned int limit = max_rom_size(QUIRK_PROFILES[cpu.get_quirks()]);
+    if (size > limit)
+    {
+        std::cerr << "Program too large (" << size << " bytes; at most " << limit << " fit)" << std::endl;
+        return false;
+    }
 
-    // Read file contents into buffer
-    file_in.read(buffer, file_length);
-    file_in.close();
+    memory.load(START_ADDRESS, data, size);
+    return true;
+}
 
-    // Load buffer contents into memory
-    for (int i = 0; i < file_length; ++i)
+bool Chip8::load_rom_image(const RomImage& image)
+{
+    const Quirks& quirks = QUIRK_PROFILES[cpu.get_quirks()];
+    if (image.size > max_rom_size(quirks))
     {
-        memory.write(START_ADDRESS + i, buffer[i]);
+        return false;
     }
 
-    delete[] buffer;
+    // Shares the image's pages; nothing is copied until the program writes.
+    // The image is a full 64 KB; this machine may see less of it
+    memory = image.memory;
+    memory.set_address_space(memory_size(quirks));
+    return true;
 }
 
 void Chip8::cycle_cpu()
 {
     cpu.tick(memory, display, keypad);
+    ++cycle_count;
+}
+
+void Chip8::run(uint64_t cycles)
+{
+    if (cycles == 0)
+    {
+        return;
+    }
+
+    // Key events are only visible to the first cycle of the batch, same as
+    // calling cycle_cpu() and clear_key_events() in a loop
+    cycle_count += cycles;
+
+    cpu.tick(memory, display, keypad);
+    keypad.clear_key_events();
+
+    if (jit && !tracer)
+    {
+        jit->run(cpu, memory, display, keypad, cycles - 1);
+    }
+    else if (aot && !tracer)
+    {
+        aot->run(cpu, memory, display, keypad, cycles - 1);
+    }
+    else
+    {
+        cpu.run(memory, display, keypad, cycles - 1);
+    }
+}
+
+void Chip8::run_timed(uint64_t cycles)
+{
+    while (cycles > 0)
+    {
+        // Cycle at which the next tick is due; CPU_HZ / TIMER_HZ needn't be a
+        // whole number, so compute it from the tick count rather than adding
+        // a rounded period each time
+        const uint64_t next_tick = static_cast<uint64_t>(std::ceil((timer_ticks + 1) * CPU_HZ / TIMER_HZ));
+        const uint64_t until_tick = next_tick > cycle_count ? next_tick - cycle_count : 0;
+        const uint64_t batch = std::min(cycles, until_tick);
+
+        run(batch);
+        cycles -= batch;
+
+        if (cycle_count >= next_tick)
+        {
+            decrement_timers();
+            ++timer_ticks;
+        }
+    }
+}
+
+bool Chip8::is_idle() const
+{
+    return !jit && !aot && cpu.is_idle();
+}
+
+void Chip8::set_idle_skipping(bool enabled)
+{
+    cpu.set_idle_skipping(enabled);
+}
+
+bool Chip8::enable_jit()
+{
+    // Compiled blocks would bypass the instrumentation hooks
+    if (CpuProbe::ENABLED)
+    {
+        return false;
+    }
+
+    if (!jit)
+    {
+        jit = std::make_unique<Jit>();
+    }
+
+    if (!jit->is_available())
+    {
+        jit.reset();
+        return false;
+    }
+
+    aot.reset();
+    return true;
+}
+
+bool Chip8::enable_aot(const AotProgram& program)
+{
+    // Translated blocks would bypass the instrumentation hooks too
+    if (CpuProbe::ENABLED)
+    {
+        return false;
+    }
+
+    aot = std::make_unique<Aot>(program);
+    jit.reset();
+    return true;
 }
 
 void Chip8::decrement_timers()
 {
+    if (recording)
+    {
+        recording->record(cycle_count - recording_start, InputLog::TIMER_TICK);
+    }
+
     cpu.decrement_timers();
+
+    if (capture)
+    {
+        capture->capture(display);
+    }
+}
+
+void Chip8::seed(uint64_t value)
+{
+    cpu.seed(value);
+}
+
+void Chip8::set_quirks(QuirkProfile profile)
+{
+    cpu.set_quirks(profile);
+    memory.set_address_space(memory_size(QUIRK_PROFILES[cpu.get_quirks()]));
+}
+
+QuirkProfile Chip8::get_quirks() const
+{
+    return cpu.get_quirks();
+}
+
+uint64_t Chip8::get_cycle_count() const
+{
+    return cycle_count;
+}
+
+void Chip8::start_recording(InputLog& log)
+{
+    log.clear(cpu.get_random_state());
+    recording = &log;
+    recording_start = cycle_count;
+}
+
+void Chip8::start_tracing(Tracer& tracer)
+{
+    tracer.set_cycle(cycle_count);
+    this->tracer = &tracer;
+    cpu.set_tracer(&tracer);
+}
+
+void Chip8::stop_tracing()
+{
+    if (tracer)
+    {
+        tracer->publish();
+        tracer = nullptr;
+        cpu.set_tracer(nullptr);
+    }
+}
+
+void Chip8::start_capture(FrameCapture& capture)
+{
+    this->capture = &capture;
+}
+
+void Chip8::stop_capture()
+{
+    capture = nullptr;
+}
+
+void Chip8::stop_recording()
+{
+    if (recording)
+    {
+        recording->set_cycle_count(cycle_count - recording_start);
+        recording = nullptr;
+    }
+}
+
+void Chip8::replay(const InputLog& log)
+{
+    cpu.set_random_state(log.get_random_state());
+
+    // Events stamped with cycle c arrived after c cycles had executed; run()
+    // shows key edges to the first cycle after them, same as the frontend's
+    // cycle_cpu() + clear_key_events()
+    uint64_t executed = 0;
+
+    for (const InputLog::Event& event : log.get_events())
+    {
+        if (event.cycle > executed)
+        {
+            run(event.cycle - executed);
+            executed = event.cycle;
+        }
+
+        switch (event.type)
+        {
+        case InputLog::KEY_DOWN:
+            keydown(event.key);
+            break;
+        case InputLog::KEY_UP:
+            keyup(event.key);
+            break;
+        case InputLog::TIMER_TICK:
+            decrement_timers();
+            break;
+        }
+    }
+
+    if (log.get_cycle_count() > executed)
+    {
+        run(log.get_cycle_count() - executed);
+    }
 }
 
 void Chip8::keydown(uint8_t key)
 {
+    if (recording)
+    {
+        recording->record(cycle_count - recording_start, InputLog::KEY_DOWN, key);
+    }
+
     keypad.keydown(key);
 }
 
 void Chip8::keyup(uint8_t key)
 {
+    if (recording)
+    {
+        recording->record(cycle_count - recording_start, InputLog::KEY_UP, key);
+    }
+
     keypad.keyup(key);
 }
 
@@ -76,7 +370,89 @@ void Chip8::clear_key_events()
     keypad.clear_key_events();
 }
 
-const uint32_t* Chip8::get_display_buffer() const
+const Display& Chip8::get_display() const
+{
+    return display;
+}
+
+const uint64_t* Chip8::get_display_rows() const
+{
+    return display.get_rows();
+}
+
+uint64_t Chip8::get_display_hash() const
+{
+    return display.hash();
+}
+
+const std::array<uint8_t, NUMBER_OF_REGISTERS>& Chip8::get_registers() const
+{
+    return cpu.get_registers();
+}
+
+uint16_t Chip8::get_program_counter() const
 {
-    return display.get_display_buffer();
+    return cpu.get_program_counter();
+}
+
+uint16_t Chip8::get_index_register() const
+{
+    return cpu.get_index_register();
+}
+
+void Chip8::render_display(uint32_t* pixels) const
+{
+    display.expand_rgba(pixels);
+}
+
+const CpuProbe& Chip8::get_probe() const
+{
+    return cpu.get_probe();
+}
+
+void Chip8::reset_probe()
+{
+    cpu.reset_probe();
+}
+
+void Chip8::save_state(SaveState& state) const
+{
+    state.magic = SAVE_STATE_MAGIC;
+    state.version = SAVE_STATE_VERSION;
+    state.size = sizeof(SaveState);
+    std::memset(state.reserved, 0, sizeof(state.reserved));
+    state.cycle_count = cycle_count;
+    state.timer_ticks = timer_ticks;
+
+    cpu.save_state(state);
+    memory.save_state(state);
+    display.save_state(state);
+    keypad.save_state(state);
+}
+
+bool Chip8::load_state(const SaveState& state)
+{
+    if (!is_valid_save_state(state))
+    {
+        return false;
+    }
+
+    cpu.load_state(state);
+    memory.load_state(state);
+    display.load_state(state);
+    keypad.load_state(state);
+    cycle_count = state.cycle_count;
+    timer_ticks = state.timer_ticks;
+
+    // Compiled blocks belong to the old memory contents
+    if (jit)
+    {
+        jit->flush();
+    }
+    if (aot)
+    {
+        aot->flush();
+    }
+
+    return true;
 }
@@ -0,0 +1,917 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "chip8_batch.h"
+#include "constants.h"
+#include "decoder.h"
+#include "display.h"
+#include "hash.h"
+
+namespace
+{
+    // Bitmask of the memory chunks covered by [begin, end), within 4 KB
+    uint64_t chunk_range_mask(unsigned int begin, unsigned int end)
+    {
+        if (begin >= end)
+        {
+            return 0;
+        }
+
+        uint64_t mask = 0;
+        for (unsigned int chunk = begin / MEMORY_CHUNK_SIZE; chunk <= (end - 1) / MEMORY_CHUNK_SIZE; ++chunk)
+        {
+            mask |= uint64_t{ 1 } << chunk;
+        }
+        return mask;
+    }
+
+    // Bitmask of the memory chunks covered by [address, address + length).
+    // Stores wrap at the end of the 4 KB address space (see write_memory),
+    // so a range running past it carries on from address 0
+    uint64_t chunk_mask(uint16_t address, uint16_t length)
+    {
+        const unsigned int begin = address & (CLASSIC_MEMORY_SIZE - 1);
+        const unsigned int end = begin + length;
+
+        if (end > CLASSIC_MEMORY_SIZE)
+        {
+            return chunk_range_mask(begin, CLASSIC_MEMORY_SIZE) | chunk_range_mask(0, end - CLASSIC_MEMORY_SIZE);
+        }
+        return chunk_range_mask(begin, end);
+    }
+
+    // Branch-free select so lane loops compile to SIMD blends
+    template <typename T>
+    T select(uint8_t active, T if_active, T if_inactive)
+    {
+        const T mask = static_cast<T>(0) - static_cast<T>(active);
+        return static_cast<T>((if_active & mask) | (if_inactive & ~mask));
+    }
+}
+
+Chip8Batch::Chip8Batch(size_t lanes) :
+    lanes{ lanes },
+    padded_lanes{ (lanes + LANE_BLOCK - 1) / LANE_BLOCK * LANE_BLOCK },
+    quirks{ DEFAULT_QUIRK_PROFILE }
+{
+    reset();
+}
+
+size_t Chip8Batch::size() const
+{
+    return lanes;
+}
+
+void Chip8Batch::reset()
+{
+    registers.assign(NUMBER_OF_REGISTERS * padded_lanes, 0);
+    program_counter.assign(padded_lanes, START_ADDRESS);
+    index_register.assign(padded_lanes, 0);
+    stack.assign(MAX_CALLSTACK * padded_lanes, 0);
+    stack_pointer.assign(padded_lanes, 0);
+    delay_timer.assign(padded_lanes, 0);
+    sound_timer.assign(padded_lanes, 0);
+    last_key_pressed.assign(padded_lanes, -1);
+
+    std::random_device entropy;
+    random.clear();
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        random.emplace_back(entropy());
+    }
+
+    memory.assign(lanes * CLASSIC_MEMORY_SIZE, 0);
+    display.assign(lanes * DISPLAY_HEIGHT, 0);
+
+    keys_pressed.assign(lanes, 0);
+    keys_pressed_this_loop.assign(lanes, 0);
+    keys_released_this_loop.assign(lanes, 0);
+
+    divergent_chunks = 0;
+
+    active.assign(padded_lanes, 0);
+    all_lanes_active = false;
+
+    every_lane.resize(lanes);
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        every_lane[lane] = static_cast<uint32_t>(lane);
+    }
+    lane_group.assign(lanes, 0);
+    ahead.assign(lanes, 0);
+    group_members.assign(lanes, 0);
+    groups.assign(lanes, GroupInfo{});
+    group_blocks.assign(lanes, 0);
+
+    every_block.clear();
+    for (size_t base = 0; base < padded_lanes; base += LANE_BLOCK)
+    {
+        every_block.push_back(static_cast<uint32_t>(base));
+    }
+    address_group.assign(CLASSIC_MEMORY_SIZE, 0);
+
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        std::memcpy(lane_memory(lane) + FONT_SET_START_ADDRESS, FONT_SET, sizeof(FONT_SET));
+        std::memcpy(lane_memory(lane) + BIG_FONT_SET_START_ADDRESS, BIG_FONT_SET, sizeof(BIG_FONT_SET));
+    }
+}
+
+bool Chip8Batch::load_rom(std::string filename)
+{
+    const RomFile rom(filename);
+
+    if (!rom.is_valid())
+    {
+        std::cerr << rom.get_error() << std::endl;
+        return false;
+    }
+
+    // Every lane's memory is contiguous with the next, so this also keeps an
+    // oversized ROM from spilling into its neighbour
+    if (rom.size() > CLASSIC_MAX_ROM_SIZE)
+    {
+        std::cerr << "ROM " << filename << " is too large for the batch engine (more than "
+                  << CLASSIC_MAX_ROM_SIZE << " bytes)" << std::endl;
+        return false;
+    }
+
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        std::memcpy(lane_memory(lane) + START_ADDRESS, rom.data(), rom.size());
+    }
+
+    return true;
+}
+
+bool Chip8Batch::load_rom_image(const RomImage& image)
+{
+    if (image.size > CLASSIC_MAX_ROM_SIZE)
+    {
+        return false;
+    }
+
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        std::memcpy(lane_memory(lane), image.bytes, CLASSIC_MEMORY_SIZE);
+    }
+
+    // Every lane now holds the same bytes
+    divergent_chunks = 0;
+    return true;
+}
+
+void Chip8Batch::cycle_cpu()
+{
+    step(1, false);
+}
+
+void Chip8Batch::run(uint64_t cycles)
+{
+    if (cycles == 0)
+    {
+        return;
+    }
+
+    // Key events are only visible to the first cycle of the batch, same as
+    // Chip8::run
+    step(cycles, true);
+    clear_key_events();
+
+    for (uint64_t i = 1; i < cycles; ++i)
+    {
+        step(cycles - i, false);
+    }
+}
+
+void Chip8Batch::decrement_timers()
+{
+    for (size_t lane = 0; lane < padded_lanes; ++lane)
+    {
+        delay_timer[lane] -= delay_timer[lane] > 0;
+        sound_timer[lane] -= sound_timer[lane] > 0;
+    }
+}
+
+void Chip8Batch::seed(uint64_t value)
+{
+    for (Random& generator : random)
+    {
+        generator.seed(value);
+    }
+}
+
+void Chip8Batch::seed(size_t lane, uint64_t value)
+{
+    random[lane].seed(value);
+}
+
+void Chip8Batch::set_quirks(QuirkProfile profile)
+{
+    quirks = profile < QUIRK_PROFILE_COUNT ? profile : DEFAULT_QUIRK_PROFILE;
+}
+
+QuirkProfile Chip8Batch::get_quirks() const
+{
+    return quirks;
+}
+
+void Chip8Batch::keydown(size_t lane, uint8_t key)
+{
+    // Same as Keypad: only the low nibble names a key
+    const uint16_t bit = 1 << (key & 0xF);
+    keys_pressed[lane] |= bit;
+    keys_pressed_this_loop[lane] |= bit;
+}
+
+void Chip8Batch::keyup(size_t lane, uint8_t key)
+{
+    const uint16_t bit = 1 << (key & 0xF);
+    keys_pressed[lane] &= ~bit;
+    keys_released_this_loop[lane] |= bit;
+}
+
+void Chip8Batch::clear_key_events()
+{
+    std::fill(keys_pressed_this_loop.begin(), keys_pressed_this_loop.end(), 0);
+    std::fill(keys_released_this_loop.begin(), keys_released_this_loop.end(), 0);
+}
+
+const uint64_t* Chip8Batch::get_display_rows(size_t lane) const
+{
+    return &display[lane * DISPLAY_HEIGHT];
+}
+
+uint64_t Chip8Batch::get_display_hash(size_t lane) const
+{
+    return fnv1a_64(get_display_rows(lane), DISPLAY_HEIGHT * sizeof(uint64_t));
+}
+
+void Chip8Batch::render_display(size_t lane, uint32_t* pixels) const
+{
+    Display::expand_rgba_rows(get_display_rows(lane), pixels, 0, DISPLAY_HEIGHT);
+}
+
+std::array<uint8_t, NUMBER_OF_REGISTERS> Chip8Batch::get_registers(size_t lane) const
+{
+    std::array<uint8_t, NUMBER_OF_REGISTERS> values;
+    for (unsigned int reg = 0; reg < NUMBER_OF_REGISTERS; ++reg)
+    {
+        values[reg] = registers[reg * padded_lanes + lane];
+    }
+    return values;
+}
+
+uint16_t Chip8Batch::get_program_counter(size_t lane) const
+{
+    return program_counter[lane];
+}
+
+uint16_t Chip8Batch::get_index_register(size_t lane) const
+{
+    return index_register[lane];
+}
+
+void Chip8Batch::step(uint64_t remaining, bool first_cycle)
+{
+    // Fast path: every lane is at the same PC in shared code (and none has
+    // run ahead), so the whole batch is one group and the grouping below can
+    // be skipped
+    const uint16_t leader_address = program_counter[0];
+    uint16_t difference = 0;
+    uint8_t waiting = 0;
+
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        difference |= program_counter[lane] ^ leader_address;
+        waiting |= ahead[lane];
+    }
+
+    if (difference == 0 && waiting == 0 && (divergent_chunks & chunk_mask(leader_address, 2)) == 0)
+    {
+        if (!all_lanes_active)
+        {
+            std::fill(active.begin(), active.begin() + lanes, 1);
+            all_lanes_active = true;
+        }
+
+        const LaneGroup batch{ every_lane.data(), lanes, every_block.data(), every_block.size() };
+        execute<false>(decode(fetch(0, leader_address)), batch);
+        return;
+    }
+
+    if (all_lanes_active)
+    {
+        std::fill(active.begin(), active.begin() + lanes, 0);
+        all_lanes_active = false;
+    }
+
+    // One pass over the lanes puts each in the group for its PC and opcode.
+    // address_group remembers the group last made for each address (stale
+    // entries from earlier cycles are caught by checking the group's key)
+    size_t group_count = 0;
+
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        // Already ran this cycle on its own (see run_lane)
+        if (ahead[lane] > 0)
+        {
+            ahead[lane] -= 1;
+            lane_group[lane] = NO_GROUP;
+            continue;
+        }
+
+        const uint16_t address = program_counter[lane];
+        const uint16_t opcode = fetch(lane, address);
+        uint32_t& slot = address_group[address & (CLASSIC_MEMORY_SIZE - 1)];
+
+        size_t group = slot;
+        const bool slot_live = group < group_count &&
+            (groups[group].address & (CLASSIC_MEMORY_SIZE - 1)) == (address & (CLASSIC_MEMORY_SIZE - 1));
+
+        if (!slot_live || groups[group].address != address || groups[group].opcode != opcode)
+        {
+            // A new group; a PC that only matches modulo 4 KB, or the same PC
+            // holding different code in another lane, gets one of its own
+            // without taking over the slot
+            group = group_count++;
+            groups[group] = { address, opcode, 0, 0 };
+            if (!slot_live)
+            {
+                slot = static_cast<uint32_t>(group);
+            }
+        }
+
+        lane_group[lane] = static_cast<uint32_t>(group);
+        groups[group].count += 1;
+    }
+
+    // Lay each group's lanes out contiguously, in lane order
+    size_t offset = 0;
+    for (size_t group = 0; group < group_count; ++group)
+    {
+        groups[group].offset = offset;
+        offset += groups[group].count;
+    }
+
+    for (size_t lane = 0; lane < lanes; ++lane)
+    {
+        if (lane_group[lane] != NO_GROUP)
+        {
+            GroupInfo& info = groups[lane_group[lane]];
+            group_members[info.offset++] = static_cast<uint32_t>(lane);
+        }
+    }
+
+    const uint64_t run_ahead = std::min(remaining, uint64_t{ MAX_RUN_AHEAD });
+
+    size_t block_offset = 0;
+
+    for (size_t group = 0; group < group_count; ++group)
+    {
+        const GroupInfo& info = groups[group];
+        const uint32_t* members = &group_members[info.offset - info.count];
+        const Instruction instruction = decode(info.opcode);
+
+        // The blocks the group's lanes fall in; members are in lane order, so
+        // a block's lanes are next to each other
+        uint32_t* blocks = &group_blocks[block_offset];
+        size_t block_count = 0;
+
+        for (size_t i = 0; i < info.count; ++i)
+        {
+            const uint32_t base = members[i] / LANE_BLOCK * LANE_BLOCK;
+            if (block_count == 0 || blocks[block_count - 1] != base)
+            {
+                blocks[block_count++] = base;
+            }
+        }
+
+        // A masked pass over a block costs about as much as running one lane
+        // on its own, so a group spread thinner than that runs lane by lane
+        if (info.count < block_count * MIN_LANES_PER_BLOCK)
+        {
+            for (size_t i = 0; i < info.count; ++i)
+            {
+                run_lane(members[i], instruction, run_ahead, first_cycle);
+            }
+            continue;
+        }
+
+        block_offset += block_count;
+
+        for (size_t i = 0; i < info.count; ++i)
+        {
+            active[members[i]] = 1;
+        }
+
+        execute<false>(instruction, LaneGroup{ members, info.count, blocks, block_count });
+
+        for (size_t i = 0; i < info.count; ++i)
+        {
+            active[members[i]] = 0;
+        }
+    }
+}
+
+void Chip8Batch::run_lane(size_t lane, const Instruction& instruction, uint64_t cycles, bool first_cycle)
+{
+    const uint32_t member = static_cast<uint32_t>(lane);
+    const LaneGroup single{ &member, 1, &member, 1 };
+
+    execute<true>(instruction, single);
+
+    // The rest of the cycles come after the one key events are visible to
+    if (first_cycle && cycles > 1)
+    {
+        keys_pressed_this_loop[lane] = 0;
+        keys_released_this_loop[lane] = 0;
+    }
+
+    for (uint64_t cycle = 1; cycle < cycles; ++cycle)
+    {
+        execute<true>(decode(fetch(lane, program_counter[lane])), single);
+    }
+
+    ahead[lane] = static_cast<uint8_t>(cycles - 1);
+}
+
+uint16_t Chip8Batch::fetch(size_t lane, uint16_t address) const
+{
+    const uint8_t* code = lane_memory(lane);
+    return code[address & (CLASSIC_MEMORY_SIZE - 1)] << 8 | code[(address + 1) & (CLASSIC_MEMORY_SIZE - 1)];
+}
+
+template <bool scalar, typename Operation>
+void Chip8Batch::alu(uint8_t X, uint8_t Y, bool sets_flag, const LaneGroup& group, Operation op)
+{
+    if constexpr (scalar)
+    {
+        const size_t lane = group.members[0];
+        uint8_t new_vx = V(X)[lane];
+        uint8_t new_vf = V(0xF)[lane];
+        op(V(X)[lane], V(Y)[lane], new_vx, new_vf);
+
+        V(X)[lane] = new_vx;
+        if (sets_flag)
+        {
+            V(0xF)[lane] = new_vf;
+        }
+        return;
+    }
+
+    // Work on copies so the compiler knows VX, VY and VF don't alias, even
+    // when X, Y or F name the same register
+    uint8_t vx[LANE_BLOCK];
+    uint8_t vy[LANE_BLOCK];
+    uint8_t vf[LANE_BLOCK];
+
+    for (size_t block = 0; block < group.block_count; ++block)
+    {
+        const size_t base = group.blocks[block];
+        std::memcpy(vx, V(X) + base, LANE_BLOCK);
+        std::memcpy(vy, V(Y) + base, LANE_BLOCK);
+        std::memcpy(vf, V(0xF) + base, LANE_BLOCK);
+        const uint8_t* mask = &active[base];
+
+        for (size_t i = 0; i < LANE_BLOCK; ++i)
+        {
+            uint8_t new_vx = vx[i];
+            uint8_t new_vf = vf[i];
+            op(vx[i], vy[i], new_vx, new_vf);
+
+            vx[i] = select(mask[i], new_vx, vx[i]);
+            vf[i] = select(mask[i], new_vf, vf[i]);
+        }
+
+        // VX first, then VF, so VF wins when X is F (same as the interpreter)
+        std::memcpy(V(X) + base, vx, LANE_BLOCK);
+        if (sets_flag)
+        {
+            std::memcpy(V(0xF) + base, vf, LANE_BLOCK);
+        }
+    }
+}
+
+template <bool scalar, typename Body>
+void Chip8Batch::for_each_block_lane(const LaneGroup& group, Body body)
+{
+    // A constant trip count per block, so the loops vectorize
+    constexpr size_t width = scalar ? 1 : LANE_BLOCK;
+
+    for (size_t block = 0; block < group.block_count; ++block)
+    {
+        const size_t base = group.blocks[block];
+        for (size_t lane = base; lane < base + width; ++lane)
+        {
+            body(lane);
+        }
+    }
+}
+
+template <bool scalar>
+void Chip8Batch::increment_index(uint8_t X, const LaneGroup& group)
+{
+    // FX55 / FX65 side effect on I, per the quirk profile
+    uint16_t amount = 0;
+
+    switch (QUIRK_PROFILES[quirks].load_store_index)
+    {
+    case INDEX_PLUS_X:
+        amount = X;
+        break;
+    case INDEX_PLUS_X_PLUS_1:
+        amount = X + 1;
+        break;
+    default:
+        return;
+    }
+
+    for_each_block_lane<scalar>(group, [&](size_t lane)
+    {
+        index_register[lane] += is_active<scalar>(lane) * amount;
+    });
+}
+
+template <bool scalar, typename Condition>
+void Chip8Batch::skip_if(const LaneGroup& group, Condition condition)
+{
+    for_each_block_lane<scalar>(group, [&](size_t lane)
+    {
+        program_counter[lane] += (is_active<scalar>(lane) & condition(lane)) << 1;
+    });
+}
+
+void Chip8Batch::write_memory(size_t lane, uint16_t address, uint8_t value)
+{
+    lane_memory(lane)[address & (CLASSIC_MEMORY_SIZE - 1)] = value;
+}
+
+void Chip8Batch::mark_written(const LaneGroup& group, uint16_t length)
+{
+    // A store keeps memory identical across lanes only if every lane made it,
+    // at the same address, with the same bytes
+    const uint16_t address = index_register[group.members[0]];
+    bool uniform = group.count == lanes && address + length <= CLASSIC_MEMORY_SIZE;
+
+    for (size_t lane = 1; uniform && lane < lanes; ++lane)
+    {
+        uniform = index_register[lane] == address &&
+            std::memcmp(lane_memory(lane) + address, lane_memory(0) + address, length) == 0;
+    }
+
+    if (uniform)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < group.count; ++i)
+    {
+        divergent_chunks |= chunk_mask(index_register[group.members[i]], length);
+    }
+}
+
+template <bool scalar>
+void Chip8Batch::execute(const Instruction& instruction, const LaneGroup& group)
+{
+    const uint8_t X = instruction.X;
+    const uint8_t Y = instruction.Y;
+    const uint8_t NN = instruction.NN;
+    const uint16_t NNN = instruction.NNN;
+    const Quirks& rules = QUIRK_PROFILES[quirks];
+
+    // Branch-free ops are applied under the active mask across the group's
+    // blocks so they vectorize; the rest loop over the group's lanes only
+    const uint32_t* const members = group.members;
+    const size_t count = group.count;
+
+    // Increment PC to next instruction
+    for_each_block_lane<scalar>(group, [&](size_t lane)
+    {
+        program_counter[lane] += is_active<scalar>(lane) << 1;
+    });
+
+    switch (instruction.op)
+    {
+    case OP_00E0:
+        for (size_t i = 0; i < count; ++i)
+        {
+            std::fill(lane_display(members[i]), lane_display(members[i]) + DISPLAY_HEIGHT, 0);
+        }
+        break;
+    case OP_00EE:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+            stack_pointer[lane] -= 1;
+            program_counter[lane] = stack[(stack_pointer[lane] % MAX_CALLSTACK) * padded_lanes + lane];
+        }
+        break;
+    case OP_1NNN:
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            program_counter[lane] = select<uint16_t>(is_active<scalar>(lane), NNN, program_counter[lane]);
+        });
+        break;
+    case OP_2NNN:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+            stack[(stack_pointer[lane] % MAX_CALLSTACK) * padded_lanes + lane] = program_counter[lane];
+            stack_pointer[lane] += 1;
+            program_counter[lane] = NNN;
+        }
+        break;
+    case OP_3XNN:
+    {
+        const uint8_t* vx = V(X);
+        skip_if<scalar>(group, [&](size_t lane) { return vx[lane] == NN; });
+        break;
+    }
+    case OP_4XNN:
+    {
+        const uint8_t* vx = V(X);
+        skip_if<scalar>(group, [&](size_t lane) { return vx[lane] != NN; });
+        break;
+    }
+    case OP_5XY2:
+    case OP_5XY3:
+        // XO-CHIP's register range stores aren't supported here; without
+        // them they compare like 5XY0 (see effective_op())
+        if (rules.xochip_ops)
+        {
+            break;
+        }
+        [[fallthrough]];
+    case OP_5XY0:
+    {
+        const uint8_t* vx = V(X);
+        const uint8_t* vy = V(Y);
+        skip_if<scalar>(group, [&](size_t lane) { return vx[lane] == vy[lane]; });
+        break;
+    }
+    case OP_9XY0:
+    {
+        const uint8_t* vx = V(X);
+        const uint8_t* vy = V(Y);
+        skip_if<scalar>(group, [&](size_t lane) { return vx[lane] != vy[lane]; });
+        break;
+    }
+    case OP_6XNN:
+        alu<scalar>(X, Y, false, group, [NN](uint8_t, uint8_t, uint8_t& vx, uint8_t&) { vx = NN; });
+        break;
+    case OP_7XNN:
+        // Note: Do NOT set carry flag (VF) on overflow
+        alu<scalar>(X, Y, false, group, [NN](uint8_t x, uint8_t, uint8_t& vx, uint8_t&) { vx = x + NN; });
+        break;
+    case OP_8XY0:
+        alu<scalar>(X, Y, false, group, [](uint8_t, uint8_t y, uint8_t& vx, uint8_t&) { vx = y; });
+        break;
+    case OP_8XY1:
+        alu<scalar>(X, Y, rules.vf_reset, group, [](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            vx = x | y;
+            vf = 0;
+        });
+        break;
+    case OP_8XY2:
+        alu<scalar>(X, Y, rules.vf_reset, group, [](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            vx = x & y;
+            vf = 0;
+        });
+        break;
+    case OP_8XY3:
+        alu<scalar>(X, Y, rules.vf_reset, group, [](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            vx = x ^ y;
+            vf = 0;
+        });
+        break;
+    case OP_8XY4:
+        alu<scalar>(X, Y, true, group, [](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            vx = x + y;
+            vf = vx < x; // Carry
+        });
+        break;
+    case OP_8XY5:
+        alu<scalar>(X, Y, true, group, [](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            vx = x - y;
+            vf = x >= y; // No borrow
+        });
+        break;
+    case OP_8XY6:
+        alu<scalar>(X, Y, true, group, [&rules](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            const uint8_t source = rules.shift_uses_vy ? y : x;
+            vx = source >> 1;
+            vf = source & 0b00000001;
+        });
+        break;
+    case OP_8XY7:
+        alu<scalar>(X, Y, true, group, [](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            vx = y - x;
+            vf = y >= x; // No borrow
+        });
+        break;
+    case OP_8XYE:
+        alu<scalar>(X, Y, true, group, [&rules](uint8_t x, uint8_t y, uint8_t& vx, uint8_t& vf)
+        {
+            const uint8_t source = rules.shift_uses_vy ? y : x;
+            vx = source << 1;
+            vf = source >> 7;
+        });
+        break;
+    case OP_ANNN:
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            index_register[lane] = select<uint16_t>(is_active<scalar>(lane), NNN, index_register[lane]);
+        });
+        break;
+    case OP_BNNN:
+    {
+        const uint8_t* offset = V(rules.jump_uses_v0 ? 0x0 : X);
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            program_counter[lane] = select<uint16_t>(is_active<scalar>(lane), NNN + offset[lane], program_counter[lane]);
+        });
+        break;
+    }
+    case OP_CXNN:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+            V(X)[lane] = random[lane].next_byte() & NN;
+        }
+        break;
+    case OP_DXY0: // Classic: no rows, so it only clears VF
+    case OP_DXYN:
+    {
+        const uint8_t N = instruction.opcode & 0x000F;
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+
+            // Same clipping/wrapping and collision rules as Cpu::op_DXYN
+            const uint8_t x_coord = V(X)[lane] & (DISPLAY_WIDTH - 1);
+            const uint8_t y_start = V(Y)[lane] & (DISPLAY_HEIGHT - 1);
+            const uint8_t* lane_mem = lane_memory(lane);
+            uint64_t* rows = lane_display(lane);
+            uint8_t collision = 0;
+
+            for (unsigned int row = 0; row < N; ++row)
+            {
+                if (rules.clip_sprites && y_start + row >= DISPLAY_HEIGHT)
+                {
+                    break;
+                }
+
+                const unsigned int y = (y_start + row) & (DISPLAY_HEIGHT - 1);
+                const uint8_t sprite_data = lane_mem[(index_register[lane] + row) & (CLASSIC_MEMORY_SIZE - 1)];
+                const uint64_t aligned = uint64_t{ sprite_data } << (DISPLAY_WIDTH - 8);
+                uint64_t sprite_bits = aligned >> x_coord;
+
+                if (!rules.clip_sprites && x_coord != 0)
+                {
+                    sprite_bits |= aligned << (DISPLAY_WIDTH - x_coord);
+                }
+
+                collision |= (rows[y] & sprite_bits) != 0;
+                rows[y] ^= sprite_bits;
+            }
+
+            V(0xF)[lane] = collision;
+        }
+        break;
+    }
+    case OP_EX9E:
+    {
+        const uint8_t* vx = V(X);
+        skip_if<scalar>(group, [&](size_t lane) { return lane < lanes && ((keys_pressed[lane] >> (vx[lane] & 0xF)) & 1); });
+        break;
+    }
+    case OP_EXA1:
+    {
+        const uint8_t* vx = V(X);
+        skip_if<scalar>(group, [&](size_t lane) { return lane < lanes && !((keys_pressed[lane] >> (vx[lane] & 0xF)) & 1); });
+        break;
+    }
+    case OP_FX07:
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            V(X)[lane] = select(is_active<scalar>(lane), delay_timer[lane], V(X)[lane]);
+        });
+        break;
+    case OP_FX0A:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+
+            // Same wait-for-release logic as Cpu::op_FX0A
+            const int8_t key = last_key_pressed[lane];
+
+            if (key != -1 && ((keys_released_this_loop[lane] >> key) & 1))
+            {
+                V(X)[lane] = key;
+                last_key_pressed[lane] = -1;
+            }
+            else
+            {
+                for (int candidate = 0; candidate < NUMBER_OF_KEYS; ++candidate)
+                {
+                    if ((keys_pressed_this_loop[lane] >> candidate) & 1)
+                    {
+                        last_key_pressed[lane] = candidate;
+                        break;
+                    }
+                }
+
+                program_counter[lane] -= 2;
+            }
+        }
+        break;
+    case OP_FX15:
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            delay_timer[lane] = select(is_active<scalar>(lane), V(X)[lane], delay_timer[lane]);
+        });
+        break;
+    case OP_FX18:
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            sound_timer[lane] = select(is_active<scalar>(lane), V(X)[lane], sound_timer[lane]);
+        });
+        break;
+    case OP_FX1E:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+            index_register[lane] += V(X)[lane];
+
+            // Set carry flag if index register overflows the 12-bit range
+            if (rules.index_overflow && index_register[lane] > 0x0FFF)
+            {
+                V(0xF)[lane] = 1;
+            }
+        }
+        break;
+    case OP_FX29:
+        for_each_block_lane<scalar>(group, [&](size_t lane)
+        {
+            const uint16_t address = FONT_SET_START_ADDRESS + V(X)[lane] * BYTES_PER_FONT_SPRITE;
+            index_register[lane] = select(is_active<scalar>(lane), address, index_register[lane]);
+        });
+        break;
+    case OP_FX33:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+
+            // Binary-coded decimal conversion
+            const uint8_t value = V(X)[lane];
+            write_memory(lane, index_register[lane], value / 100);
+            write_memory(lane, index_register[lane] + 1, value / 10 % 10);
+            write_memory(lane, index_register[lane] + 2, value % 10);
+        }
+        mark_written(group, 3);
+        break;
+    case OP_FX55:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+            for (int reg = 0; reg <= X; ++reg)
+            {
+                write_memory(lane, index_register[lane] + reg, V(reg)[lane]);
+            }
+        }
+        mark_written(group, X + 1);
+
+        increment_index<scalar>(X, group);
+        break;
+    case OP_FX65:
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t lane = members[i];
+            const uint8_t* lane_mem = lane_memory(lane);
+            for (int reg = 0; reg <= X; ++reg)
+            {
+                V(reg)[lane] = lane_mem[(index_register[lane] + reg) & (CLASSIC_MEMORY_SIZE - 1)];
+            }
+        }
+
+        increment_index<scalar>(X, group);
+        break;
+    default:
+        break;
+    }
+}
@@ -1,10 +1,120 @@
-#include <cstdlib>
-#include <ctime>
+#include <algorithm>
+#include <cstring>
+#include <random>
 
 #include "cpu.h"
 #include "memory.h"
 #include "display.h"
+#include "decoder.h"
 #include "constants.h"
+#include "tracer.h"
+
+// Dispatch engine is chosen at build time (see CHIP8_DISPATCH in CMakeLists.txt)
+// Computed goto ("labels as values") is a GCC/Clang extension; other compilers
+// always get the handler table
+#if defined(CHIP8_DISPATCH_GOTO) && defined(__GNUC__)
+#define CHIP8_USE_COMPUTED_GOTO 1
+#else
+#define CHIP8_USE_COMPUTED_GOTO 0
+#endif
+
+namespace
+{
+    // Skipping cycles would hide them from the instrumentation counters
+    constexpr bool DETECT_IDLE_LOOPS = !CpuProbe::ENABLED;
+
+    // Longest loop body (not counting the jump) checked for idling, in bytes:
+    // enough for polling the delay timer and a key. Longer loops are rarely
+    // idle, and checking them costs busy ones time
+    const unsigned int MAX_IDLE_LOOP_BODY = 8;
+
+    // Operations that only read V, I, memory, the timers and the keys and
+    // only write V, I and the program counter. None of their inputs change
+    // during a run() unless some other operation writes them
+    constexpr bool is_idle_safe(Op op)
+    {
+        switch (op)
+        {
+        case OP_INVALID:
+        case OP_3XNN: case OP_4XNN: case OP_5XY0: case OP_9XY0:
+        case OP_5XY3: case OP_6XNN: case OP_7XNN:
+        case OP_8XY0: case OP_8XY1: case OP_8XY2: case OP_8XY3:
+        case OP_8XY4: case OP_8XY5: case OP_8XY6: case OP_8XY7: case OP_8XYE:
+        case OP_1NNN: case OP_ANNN: case OP_EX9E: case OP_EXA1:
+        case OP_FX07: case OP_FX1E: case OP_FX29: case OP_FX30: case OP_FX65:
+            return true;
+        default:
+            return false;
+        }
+    }
+}
+
+// Order must match the Op enum in decoder.h. SUPER-CHIP / XO-CHIP handlers
+// are quirky too: under a profile without the extension they do what
+// effective_op() in quirks.h says
+template <QuirkProfile profile>
+const Cpu::Handler Cpu::handlers[OP_COUNT] = {
+    &Cpu::op_invalid,
+    &Cpu::op_00E0,
+    &Cpu::op_00EE,
+    &Cpu::op_00CN<profile>,
+    &Cpu::op_00DN<profile>,
+    &Cpu::op_00FB<profile>,
+    &Cpu::op_00FC<profile>,
+    &Cpu::op_00FD<profile>,
+    &Cpu::op_00FE<profile>,
+    &Cpu::op_00FF<profile>,
+    &Cpu::op_1NNN,
+    &Cpu::op_2NNN,
+    &Cpu::op_3XNN<profile>,
+    &Cpu::op_4XNN<profile>,
+    &Cpu::op_5XY0<profile>,
+    &Cpu::op_5XY2<profile>,
+    &Cpu::op_5XY3<profile>,
+    &Cpu::op_6XNN,
+    &Cpu::op_7XNN,
+    &Cpu::op_8XY0,
+    &Cpu::op_8XY1<profile>,
+    &Cpu::op_8XY2<profile>,
+    &Cpu::op_8XY3<profile>,
+    &Cpu::op_8XY4,
+    &Cpu::op_8XY5,
+    &Cpu::op_8XY6<profile>,
+    &Cpu::op_8XY7,
+    &Cpu::op_8XYE<profile>,
+    &Cpu::op_9XY0<profile>,
+    &Cpu::op_ANNN,
+    &Cpu::op_BNNN<profile>,
+    &Cpu::op_CXNN,
+    &Cpu::op_DXYN<profile>,
+    &Cpu::op_DXY0<profile>,
+    &Cpu::op_EX9E<profile>,
+    &Cpu::op_EXA1<profile>,
+    &Cpu::op_F000<profile>,
+    &Cpu::op_FN01<profile>,
+    &Cpu::op_F002<profile>,
+    &Cpu::op_FX07,
+    &Cpu::op_FX0A,
+    &Cpu::op_FX15,
+    &Cpu::op_FX18,
+    &Cpu::op_FX1E<profile>,
+    &Cpu::op_FX29,
+    &Cpu::op_FX30<profile>,
+    &Cpu::op_FX33,
+    &Cpu::op_FX3A<profile>,
+    &Cpu::op_FX55<profile>,
+    &Cpu::op_FX65<profile>,
+    &Cpu::op_FX75<profile>,
+    &Cpu::op_FX85<profile>,
+};
+
+// Order must match the QuirkProfile enum in quirks.h
+const Cpu::Handler* const Cpu::handler_tables[QUIRK_PROFILE_COUNT] = {
+    Cpu::handlers<QUIRKS_VIP>,
+    Cpu::handlers<QUIRKS_CHIP48>,
+    Cpu::handlers<QUIRKS_SCHIP>,
+    Cpu::handlers<QUIRKS_XOCHIP>,
+};
 
 Cpu::Cpu() :
     registers{},
@@ -14,350 +124,1004 @@ Cpu::Cpu() :
     stack_pointer{ 0 },
     delay_timer{ 0 },
     sound_timer{ 0 },
-    opcode{ 0 },
-    last_key_pressed{ -1 }
+    last_key_pressed{ -1 },
+    random{ std::random_device{}() },
+    flags{},
+    audio_pattern{},
+    audio_pitch{ DEFAULT_AUDIO_PITCH },
+    quirks{ DEFAULT_QUIRK_PROFILE },
+    idle_loop{},
+    idle{ false },
+    idle_skipping{ true },
+    tracer{ nullptr }
 {
-    srand(time(NULL));
 }
 
 void Cpu::tick(Memory& memory, Display& display, Keypad& keypad)
 {
-    fetch_instruction(memory);
-    decode_and_execute(memory, display, keypad);
+    const uint16_t address = program_counter;
+    const Instruction instruction = fetch_instruction(memory);
+    decode_and_execute(instruction, memory, display, keypad);
+
+    if (tracer)
+    {
+        trace(address, instruction);
+    }
 }
 
-void Cpu::fetch_instruction(Memory& memory)
+inline void Cpu::trace(uint16_t address, const Instruction& instruction)
 {
-    // Get the next 16-bit instruction from memory (two bytes)
-    // Left-shift hi-byte by 8 bits; fills space to right with 0s
-    // Bitwise OR overwrites 0s to the right with the lo-byte's values
-    opcode = memory.read(program_counter) << 8 | memory.read(program_counter + 1);
+    tracer->record(address, instruction.opcode, index_register, registers);
+}
+
+Instruction Cpu::fetch_instruction(Memory& memory)
+{
+    // Get the next 16-bit instruction from memory, already decoded into its
+    // operation and operands
+    const Instruction instruction = memory.fetch(program_counter);
+    probe.on_instruction(program_counter, instruction.op);
 
     // Increment PC to next instruction
     program_counter += 2;
+
+    return instruction;
 }
 
-// Decode
-void Cpu::decode_and_execute(Memory& memory, Display& display, Keypad& keypad)
+void Cpu::decode_and_execute(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad)
 {
-    const uint16_t op = (opcode & 0xF000);
-    const uint8_t X = (opcode & 0x0F00) >> 8;
-    const uint8_t Y = (opcode & 0x00F0) >> 4;
-    const uint8_t N = (opcode & 0x000F);
-    const uint8_t NN = (opcode & 0x00FF);
-    const uint16_t NNN = (opcode & 0x0FFF);
+    (this->*handler_tables[quirks][instruction.op])(instruction, memory, display, keypad);
+}
 
-    if (op == 0x0000)
+template <QuirkProfile profile>
+void Cpu::skip(Memory& memory)
+{
+    if constexpr (QUIRK_PROFILES[profile].long_skips)
     {
-        if (NNN == 0x00E0)
-        {
-            display.clear();
-        }
-        else if (NNN == 0x00EE)
+        if (memory.fetch(program_counter).opcode == 0xF000)
         {
-            // Return from subroutine
-            stack_pointer -= 1;
-            program_counter = stack[stack_pointer];
+            program_counter += 2;
         }
     }
-    else if (op == 0x1000)
+
+    program_counter += 2;
+}
+
+void Cpu::op_invalid(const Instruction& /*instruction*/, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+}
+
+void Cpu::op_00E0(const Instruction& /*instruction*/, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    display.clear();
+}
+
+void Cpu::op_00EE(const Instruction& /*instruction*/, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    // Return from subroutine
+    stack_pointer -= 1;
+    program_counter = stack[stack_pointer];
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00CN(const Instruction& instruction, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
     {
-        program_counter = NNN;
+        return;
     }
-    else if (op == 0x2000)
+
+    display.scroll_down(instruction.opcode & 0x000F);
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00DN(const Instruction& instruction, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
     {
-        // Call subroutine
-        stack[stack_pointer] = program_counter;
-        stack_pointer += 1;
-        program_counter = NNN;
+        return;
     }
-    else if (op == 0x3000)
+
+    display.scroll_up(instruction.opcode & 0x000F);
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00FB(const Instruction& /*instruction*/, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
     {
-        if (registers[X] == NN)
-        {
-            program_counter += 2;
-        }
+        return;
     }
-    else if (op == 0x4000)
+
+    display.scroll_right();
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00FC(const Instruction& /*instruction*/, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
     {
-        if (registers[X] != NN)
-        {
-            program_counter += 2;
-        }
+        return;
+    }
+
+    display.scroll_left();
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00FD(const Instruction& /*instruction*/, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
+    {
+        return;
     }
-    else if (op == 0x5000)
+
+    // Exit: there's no interpreter to return to, so stop here for good,
+    // leaving the final screen up
+    program_counter -= 2;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00FE(const Instruction& /*instruction*/, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
     {
-        if (registers[X] == registers[Y])
-        {
-            program_counter += 2;
-        }
+        return;
     }
-    else if (op == 0x6000)
+
+    display.set_hires(false);
+}
+
+template <QuirkProfile profile>
+void Cpu::op_00FF(const Instruction& /*instruction*/, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
     {
-        registers[X] = NN;
+        return;
     }
-    else if (op == 0x7000)
+
+    display.set_hires(true);
+}
+
+void Cpu::op_1NNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    program_counter = instruction.NNN;
+}
+
+void Cpu::op_2NNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    // Call subroutine
+    stack[stack_pointer] = program_counter;
+    stack_pointer += 1;
+    program_counter = instruction.NNN;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_3XNN(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if (registers[instruction.X] == instruction.NN)
     {
-        // Note: Do NOT set carry flag (VF) on overflow
-        registers[X] += NN;
+        skip<profile>(memory);
     }
-    else if (op == 0x8000)
+}
+
+template <QuirkProfile profile>
+void Cpu::op_4XNN(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if (registers[instruction.X] != instruction.NN)
     {
-        if (N == 0x0)
+        skip<profile>(memory);
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_5XY0(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if (registers[instruction.X] == registers[instruction.Y])
+    {
+        skip<profile>(memory);
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_5XY2(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
+    {
+        op_5XY0<profile>(instruction, memory, display, keypad);
+        return;
+    }
+
+    // VX to VY in order (counting down if Y < X) to consecutive bytes at I;
+    // I itself doesn't change
+    const int step = instruction.X <= instruction.Y ? 1 : -1;
+    const int count = (instruction.Y - instruction.X) * step + 1;
+
+    for (int i = 0; i < count; ++i)
+    {
+        memory.write(index_register + i, registers[instruction.X + i * step]);
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_5XY3(const Instruction& instruction, Memory& memory, Display& display, Keypad& keypad)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
+    {
+        op_5XY0<profile>(instruction, memory, display, keypad);
+        return;
+    }
+
+    const int step = instruction.X <= instruction.Y ? 1 : -1;
+    const int count = (instruction.Y - instruction.X) * step + 1;
+
+    for (int i = 0; i < count; ++i)
+    {
+        registers[instruction.X + i * step] = memory.read(index_register + i);
+    }
+}
+
+void Cpu::op_6XNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] = instruction.NN;
+}
+
+void Cpu::op_7XNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    // Note: Do NOT set carry flag (VF) on overflow
+    registers[instruction.X] += instruction.NN;
+}
+
+void Cpu::op_8XY0(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] = registers[instruction.Y];
+}
+
+template <QuirkProfile profile>
+void Cpu::op_8XY1(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] |= registers[instruction.Y];
+
+    if constexpr (QUIRK_PROFILES[profile].vf_reset)
+    {
+        registers[0xF] = 0;
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_8XY2(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] &= registers[instruction.Y];
+
+    if constexpr (QUIRK_PROFILES[profile].vf_reset)
+    {
+        registers[0xF] = 0;
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_8XY3(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] ^= registers[instruction.Y];
+
+    if constexpr (QUIRK_PROFILES[profile].vf_reset)
+    {
+        registers[0xF] = 0;
+    }
+}
+
+void Cpu::op_8XY4(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    const uint8_t X = instruction.X;
+    const uint8_t Y = instruction.Y;
+
+    // Check if operation will result in overflow (sum greater than max 8-bit integer)
+    int overflow = registers[X] > 0xFF - registers[Y] ? 1 : 0;
+
+    // Perform operation
+    registers[X] += registers[Y];
+
+    // Set carry flag
+    registers[0xF] = overflow;
+}
+
+void Cpu::op_8XY5(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    const uint8_t X = instruction.X;
+    const uint8_t Y = instruction.Y;
+
+    // Check if operation will result in "underflow" (1 if no carry required; 0 if carry required)
+    int overflow = registers[X] >= registers[Y] ? 1 : 0;
+
+    // Perform operation
+    registers[X] -= registers[Y];
+
+    // Set carry flag
+    registers[0xF] = overflow;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_8XY6(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    const uint8_t X = instruction.X;
+
+    if constexpr (QUIRK_PROFILES[profile].shift_uses_vy)
+    {
+        registers[X] = registers[instruction.Y];
+    }
+
+    // Store bit that will be lost in shift
+    uint8_t lost_bit = registers[X] & 0b00000001;
+    registers[X] >>= 1;
+    registers[0xF] = lost_bit;
+}
+
+void Cpu::op_8XY7(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    const uint8_t X = instruction.X;
+    const uint8_t Y = instruction.Y;
+
+    // Check if operation will result in "underflow" (1 if no carry required; 0 if carry required)
+    int overflow = registers[Y] >= registers[X] ? 1 : 0;
+
+    // Perform operation
+    registers[X] = registers[Y] - registers[X];
+
+    // Set carry flag
+    registers[0xF] = overflow;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_8XYE(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    const uint8_t X = instruction.X;
+
+    if constexpr (QUIRK_PROFILES[profile].shift_uses_vy)
+    {
+        registers[X] = registers[instruction.Y];
+    }
+
+    // Store bit that will be lost in shift
+    uint8_t lost_bit = (registers[X] & 0b10000000) >> 7;
+    registers[X] <<= 1;
+    registers[0xF] = lost_bit;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_9XY0(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if (registers[instruction.X] != registers[instruction.Y])
+    {
+        skip<profile>(memory);
+    }
+}
+
+void Cpu::op_ANNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    index_register = instruction.NNN;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_BNNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    // Without the quirk this is really BXNN: XNN + VX
+    program_counter = instruction.NNN + registers[QUIRK_PROFILES[profile].jump_uses_v0 ? 0x0 : instruction.X];
+}
+
+void Cpu::op_CXNN(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] = random.next_byte() & instruction.NN;
+}
+
+template <QuirkProfile profile>
+void Cpu::draw(uint8_t X, uint8_t Y, Memory& memory, Display& display, unsigned int height, bool wide)
+{
+    // Index register contains pointer to memory location for sprite to be drawn
+    // This pointer has been set by some previous instruction
+
+    // Reset flag register
+    registers[0xF] = 0;
+
+    // VX and VY indicate initial x- and y-coordinates for drawing the sprite
+    // Convert absolute (wrapped) values; whether the sprite itself is clipped
+    // or wrapped depends on the quirk profile
+    const unsigned int width = display.get_width();
+    const unsigned int screen_height = display.get_height();
+    const unsigned int x_coord = registers[X] & (width - 1); // Same as VX % width
+    const unsigned int y_coord = registers[Y] & (screen_height - 1); // Same as VY % height
+
+    // Each byte is 8 pixels of a row (1 bit = 1 pixel); every selected plane
+    // has its own rows, one plane's after another's
+    const unsigned int row_bytes = wide ? 2 : 1;
+    const unsigned int plane_bytes = height * row_bytes;
+    const unsigned int sprite_bytes = display.get_selected_plane_count() * plane_bytes;
+    const uint8_t* sprite = memory.read_span(index_register, sprite_bytes);
+
+    // Sprites straddling a page (or the end of memory) are gathered first
+    uint8_t gathered[DISPLAY_PLANES * 32];
+    if (!sprite)
+    {
+        for (unsigned int i = 0; i < sprite_bytes; ++i)
         {
-            registers[X] = registers[Y];
+            gathered[i] = memory.read(index_register + i);
         }
-        else if (N == 0x1)
+        sprite = gathered;
+    }
+
+    if constexpr (CpuProbe::ENABLED)
+    {
+        // Rows cut off at the bottom edge aren't drawn
+        const unsigned int visible_rows = QUIRK_PROFILES[profile].clip_sprites
+            ? std::min(height, screen_height - y_coord)
+            : height;
+
+        for (unsigned int i = 0; i < sprite_bytes; ++i)
         {
-            registers[X] |= registers[Y];
+            if ((i % plane_bytes) / row_bytes < visible_rows)
+            {
+                probe.on_draw_row(x_coord + (i % row_bytes) * 8, sprite[i], width);
+            }
         }
-        else if (N == 0x2)
+    }
+
+    // The whole sprite goes to the display in one call, which applies each
+    // row with a few word-wide shifts and XORs
+    if (display.draw_sprite(x_coord, y_coord, sprite, height, wide, QUIRK_PROFILES[profile].clip_sprites))
+    {
+        registers[0xF] = 1;
+    }
+
+    probe.on_draw(registers[0xF] != 0);
+}
+
+template <QuirkProfile profile>
+void Cpu::op_DXYN(const Instruction& instruction, Memory& memory, Display& display, Keypad& /*keypad*/)
+{
+    // Draw; N indicates the number of bytes to draw (i.e. the sprite's pixel height)
+    draw<profile>(instruction.X, instruction.Y, memory, display, instruction.opcode & 0x000F, false);
+}
+
+template <QuirkProfile profile>
+void Cpu::op_DXY0(const Instruction& instruction, Memory& memory, Display& display, Keypad& /*keypad*/)
+{
+    // 16x16 sprite, two bytes per row; the older interpreters draw nothing
+    // (though VF is still cleared)
+    if constexpr (QUIRK_PROFILES[profile].big_sprites)
+    {
+        draw<profile>(instruction.X, instruction.Y, memory, display, 16, true);
+    }
+    else
+    {
+        draw<profile>(instruction.X, instruction.Y, memory, display, 0, false);
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_EX9E(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& keypad)
+{
+    if (keypad.is_pressed(registers[instruction.X]))
+    {
+        skip<profile>(memory);
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_EXA1(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& keypad)
+{
+    if (!keypad.is_pressed(registers[instruction.X]))
+    {
+        skip<profile>(memory);
+    }
+}
+
+template <QuirkProfile profile>
+void Cpu::op_F000(const Instruction& /*instruction*/, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
+    {
+        return;
+    }
+
+    // The address is the next word, which is skipped over
+    index_register = memory.read(program_counter) << 8 | memory.read(program_counter + 1);
+    program_counter += 2;
+}
+
+template <QuirkProfile profile>
+void Cpu::op_FN01(const Instruction& instruction, Memory& /*memory*/, Display& display, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
+    {
+        return;
+    }
+
+    display.select_planes(instruction.X);
+}
+
+template <QuirkProfile profile>
+void Cpu::op_F002(const Instruction& /*instruction*/, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
+    {
+        return;
+    }
+
+    for (unsigned int i = 0; i < AUDIO_PATTERN_SIZE; ++i)
+    {
+        audio_pattern[i] = memory.read(index_register + i);
+    }
+}
+
+void Cpu::op_FX07(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    registers[instruction.X] = delay_timer;
+}
+
+void Cpu::op_FX0A(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& keypad)
+{
+    if (last_key_pressed != -1 && keypad.is_released_this_loop(last_key_pressed))
+    {
+        // Some key was previously pressed, and it was released this loop
+        // Store that key in VX and clear last keypress state; instruction complete
+        registers[instruction.X] = last_key_pressed;
+        last_key_pressed = -1;
+        probe.on_key_wait(true);
+    }
+    else
+    {
+        // Either no key has been pressed, or we are still waiting for the pressed key to release
+        // Update the latest keypress if a new key was pressed this loop
+        const int8_t key = keypad.first_pressed_this_loop();
+        if (key != -1)
         {
-            registers[X] &= registers[Y];
+            last_key_pressed = key;
         }
-        else if (N == 0x3)
+
+        // Decrement PC to retry instruction
+        program_counter -= 2;
+        probe.on_key_wait(false);
+    }
+}
+
+void Cpu::op_FX15(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    delay_timer = registers[instruction.X];
+}
+
+void Cpu::op_FX18(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    sound_timer = registers[instruction.X];
+}
+
+template <QuirkProfile profile>
+void Cpu::op_FX1E(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    index_register += registers[instruction.X];
+
+    // Set carry flag if index register overflows the typical 12-bit addressing range
+    // The original COSMAC VIP interpreter doesn't do this but some others (e.g. Amiga) do
+    if constexpr (QUIRK_PROFILES[profile].index_overflow)
+    {
+        if (index_register > 0x0FFF)
         {
-            registers[X] ^= registers[Y];
+            registers[0xF] = 1;
         }
-        else if (N == 0x4)
-        {
-            // Check if operation will result in overflow (sum greater than max 8-bit integer)
-            int overflow = registers[X] > 0xFF - registers[Y] ? 1 : 0;
+    }
+}
 
-            // Perform operation
-            registers[X] += registers[Y];
+void Cpu::op_FX29(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    index_register = FONT_SET_START_ADDRESS + (registers[instruction.X] * BYTES_PER_FONT_SPRITE);
+}
 
-            // Set carry flag
-            registers[0xF] = overflow;
-        }
-        else if (N == 0x5)
-        {
-            // Check if operation will result in "underflow" (1 if no carry required; 0 if carry required)
-            int overflow = registers[X] >= registers[Y] ? 1 : 0;
+template <QuirkProfile profile>
+void Cpu::op_FX30(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
+    {
+        return;
+    }
 
-            // Perform operation
-            registers[X] -= registers[Y];
+    index_register = BIG_FONT_SET_START_ADDRESS + ((registers[instruction.X] & 0x0F) * BYTES_PER_BIG_FONT_SPRITE);
+}
 
-            // Set carry flag
-            registers[0xF] = overflow;
-        }
-        else if (N == 0x6)
-        {
-            if (CLASSIC_MODE)
-            {
-                registers[X] = registers[Y];
-            }
+void Cpu::op_FX33(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    // Binary-coded decimal conversion
+    uint8_t decimal_value = registers[instruction.X];
 
-            // Store bit that will be lost in shift
-            uint8_t lost_bit = registers[X] & 0b00000001;
-            registers[X] >>= 1;
-            registers[0xF] = lost_bit;
-        }
-        else if (N == 0x7)
-        {
-            // Check if operation will result in "underflow" (1 if no carry required; 0 if carry required)
-            int overflow = registers[Y] >= registers[X] ? 1 : 0;
+    // Place each digit of decimal value in X into memory starting at index register
+    // Iterate backwards beginning with least significant digit
+    for (int i = 2; i >= 0; --i)
+    {
+        memory.write(index_register + i, decimal_value % 10);
+        decimal_value /= 10;
+    }
+}
 
-            // Perform operation
-            registers[X] = registers[Y] - registers[X];
+template <QuirkProfile profile>
+void Cpu::op_FX3A(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].xochip_ops)
+    {
+        return;
+    }
 
-            // Set carry flag
-            registers[0xF] = overflow;
-        }
-        else if (N == 0xE)
-        {
-            if (CLASSIC_MODE)
-            {
-                registers[X] = registers[Y];
-            }
+    audio_pitch = registers[instruction.X];
+}
 
-            // Store bit that will be lost in shift
-            uint8_t lost_bit = (registers[X] & 0b10000000) >> 7;
-            registers[X] <<= 1;
-            registers[0xF] = lost_bit;
-        }
+template <QuirkProfile profile>
+void Cpu::op_FX55(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    for (int i = 0; i <= instruction.X; ++i)
+    {
+        memory.write(index_register + i, registers[i]);
     }
-    else if (op == 0x9000)
+
+    if constexpr (QUIRK_PROFILES[profile].load_store_index == INDEX_PLUS_X)
     {
-        if (registers[X] != registers[Y])
-        {
-            program_counter += 2;
-        }
+        index_register += instruction.X;
     }
-    else if (op == 0xA000)
+    else if constexpr (QUIRK_PROFILES[profile].load_store_index == INDEX_PLUS_X_PLUS_1)
     {
-        index_register = NNN;
+        index_register += (instruction.X + 1);
     }
-    else if (op == 0xB000)
+}
+
+template <QuirkProfile profile>
+void Cpu::op_FX65(const Instruction& instruction, Memory& memory, Display& /*display*/, Keypad& /*keypad*/)
+{
+    for (int i = 0; i <= instruction.X; ++i)
     {
-        program_counter = NNN + registers[CLASSIC_MODE ? 0x0 : X];
+        registers[i] = memory.read(index_register + i);
     }
-    else if (op == 0xC000)
+
+    if constexpr (QUIRK_PROFILES[profile].load_store_index == INDEX_PLUS_X)
     {
-        registers[X] = rand() & NN;
+        index_register += instruction.X;
     }
-    else if (op == 0xD000)
+    else if constexpr (QUIRK_PROFILES[profile].load_store_index == INDEX_PLUS_X_PLUS_1)
     {
-        // Draw
+        index_register += (instruction.X + 1);
+    }
+}
 
-        // Index register contains pointer to memory location for sprite to be drawn
-        // This pointer has been set by some previous instruction
+template <QuirkProfile profile>
+void Cpu::op_FX75(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
+    {
+        return;
+    }
 
-        // Reset flag register
-        registers[0xF] = 0;
+    for (int i = 0; i <= instruction.X; ++i)
+    {
+        flags[i] = registers[i];
+    }
+}
 
-        // VX and VY indicate initial x- and y-coordinates for drawing the sprite
-        // Initialize y-coordinate and convert absolute (wrapped) value
-        uint8_t y_coord = registers[Y] & DISPLAY_HEIGHT - 1; // Same as VY % 32
+template <QuirkProfile profile>
+void Cpu::op_FX85(const Instruction& instruction, Memory& /*memory*/, Display& /*display*/, Keypad& /*keypad*/)
+{
+    if constexpr (!QUIRK_PROFILES[profile].schip_ops)
+    {
+        return;
+    }
 
-        // N indicates the number of bytes to draw (i.e. the sprite's pixel height)
-        for (int row = 0; row < N; ++row)
-        {
-            // Sprites should not wrap; end drawing current sprite
-            if (y_coord >= DISPLAY_HEIGHT)
-            {
-                break;
-            }
+    for (int i = 0; i <= instruction.X; ++i)
+    {
+        registers[i] = flags[i];
+    }
+}
 
-            // Initialize x-coordinate and convert absolute (wrapped) value
-            uint8_t x_coord = registers[X] & DISPLAY_WIDTH - 1; // Same as VX % 64
+void Cpu::run(Memory& memory, Display& display, Keypad& keypad, uint64_t cycles)
+{
+    if (tracer)
+    {
+        run_traced<true>(memory, display, keypad, cycles);
+        tracer->publish();
+    }
+    else
+    {
+        run_traced<false>(memory, display, keypad, cycles);
+    }
+}
 
-            // Each byte represents a row of pixels (1 bit = 1 pixel)
-            const uint8_t sprite_data = memory.read(index_register + row);
+template <bool traced>
+void Cpu::run_traced(Memory& memory, Display& display, Keypad& keypad, uint64_t cycles)
+{
+    // The profile is checked once per run, never per instruction
+    switch (quirks)
+    {
+    case QUIRKS_VIP:
+        run_with_quirks<QUIRKS_VIP, traced>(memory, display, keypad, cycles);
+        break;
+    case QUIRKS_CHIP48:
+        run_with_quirks<QUIRKS_CHIP48, traced>(memory, display, keypad, cycles);
+        break;
+    case QUIRKS_XOCHIP:
+        run_with_quirks<QUIRKS_XOCHIP, traced>(memory, display, keypad, cycles);
+        break;
+    default:
+        run_with_quirks<QUIRKS_SCHIP, traced>(memory, display, keypad, cycles);
+        break;
+    }
+}
 
-            for (int col = 0; col < 8; ++col)
-            {
-                // Sprites should not wrap; end drawing current row
-                if (x_coord >= DISPLAY_WIDTH)
-                {
-                    break;
-                }
+inline bool Cpu::may_close_idle_loop(uint16_t address, uint16_t target) const
+{
+    // A short backward jump, and not one closing a loop already found to
+    // do more than idle
+    return DETECT_IDLE_LOOPS && idle_skipping && static_cast<uint16_t>(address - target) <= MAX_IDLE_LOOP_BODY &&
+        !(idle_loop.valid && idle_loop.jump == address && !idle_loop.safe);
+}
 
-                // Shift current bit into the 1s place and mask to get the pixel value
-                const bool sprite_pixel = (sprite_data >> (7 - col)) & 1;
+template <QuirkProfile profile, bool traced>
+void Cpu::run_with_quirks(Memory& memory, Display& display, Keypad& keypad, uint64_t cycles)
+{
+    // Timers, keys and memory may have changed since the last run
+    idle_loop.valid = false;
+    idle = false;
 
-                if (sprite_pixel)
-                {
-                    display.set_pixel(x_coord, y_coord);
-                }
+#if CHIP8_USE_COMPUTED_GOTO
+    // Threaded dispatch: every handler ends with its own indirect jump to the
+    // next instruction's label, instead of all instructions sharing one
+    // (hard to predict) jump at the top of a loop
 
-                x_coord += 1;
-            }
+    // Order must match the Op enum in decoder.h
+    static void* const labels[OP_COUNT] = {
+        &&L_invalid,
+        &&L_00E0, &&L_00EE, &&L_00CN, &&L_00DN, &&L_00FB, &&L_00FC, &&L_00FD, &&L_00FE, &&L_00FF,
+        &&L_1NNN, &&L_2NNN, &&L_3XNN, &&L_4XNN, &&L_5XY0, &&L_5XY2, &&L_5XY3, &&L_6XNN, &&L_7XNN,
+        &&L_8XY0, &&L_8XY1, &&L_8XY2, &&L_8XY3, &&L_8XY4, &&L_8XY5, &&L_8XY6, &&L_8XY7, &&L_8XYE,
+        &&L_9XY0, &&L_ANNN, &&L_BNNN, &&L_CXNN, &&L_DXYN, &&L_DXY0, &&L_EX9E, &&L_EXA1,
+        &&L_F000, &&L_FN01, &&L_F002, &&L_FX07, &&L_FX0A, &&L_FX15, &&L_FX18, &&L_FX1E,
+        &&L_FX29, &&L_FX30, &&L_FX33, &&L_FX3A, &&L_FX55, &&L_FX65, &&L_FX75, &&L_FX85,
+    };
 
-            y_coord += 1;
-        }
+    Instruction instruction;
+
+    // Address of the instruction being executed; only kept when tracing
+    uint16_t traced_address = 0;
+
+#define DISPATCH()                                   \
+    if (cycles == 0)                                 \
+    {                                                \
+        return;                                      \
+    }                                                \
+    --cycles;                                        \
+    if constexpr (traced)                            \
+    {                                                \
+        traced_address = program_counter;            \
+    }                                                \
+    instruction = fetch_instruction(memory);         \
+    goto *labels[instruction.op]
+
+#define TRACE()                                      \
+    if constexpr (traced)                            \
+    {                                                \
+        trace(traced_address, instruction);          \
     }
-    else if (op == 0xE000)
+
+#define HANDLER(name)                                                  \
+    L_##name:                                                          \
+    op_##name(instruction, memory, display, keypad);                   \
+    TRACE()                                                            \
+    DISPATCH()
+
+#define QUIRK_HANDLER(name)                                            \
+    L_##name:                                                          \
+    op_##name<profile>(instruction, memory, display, keypad);          \
+    TRACE()                                                            \
+    DISPATCH()
+
+    DISPATCH();
+
+    HANDLER(invalid);
+    HANDLER(00E0);
+    HANDLER(00EE);
+    QUIRK_HANDLER(00CN);
+    QUIRK_HANDLER(00DN);
+    QUIRK_HANDLER(00FB);
+    QUIRK_HANDLER(00FC);
+    QUIRK_HANDLER(00FD);
+    QUIRK_HANDLER(00FE);
+    QUIRK_HANDLER(00FF);
+L_1NNN:
+    // Checked before jumping, while the jump's address is still at hand.
+    // A trace must show every cycle, so tracing runs don't skip any
+    if (__builtin_expect(!traced && may_close_idle_loop(program_counter - 2, instruction.NNN), 0))
     {
-        if (NN == 0x9E)
-        {
-            if (keypad.is_pressed(registers[X]))
-            {
-                SDL_log('test');
-                program_counter += 2;
-            }
-        }
-        else if (NN == 0xA1)
+        const uint16_t address = program_counter - 2;
+        op_1NNN(instruction, memory, display, keypad);
+        cycles -= skip_idle_loop(address, memory, display, keypad, cycles);
+        DISPATCH();
+    }
+    op_1NNN(instruction, memory, display, keypad);
+    TRACE();
+    DISPATCH();
+
+    HANDLER(2NNN);
+    QUIRK_HANDLER(3XNN);
+    QUIRK_HANDLER(4XNN);
+    QUIRK_HANDLER(5XY0);
+    QUIRK_HANDLER(5XY2);
+    QUIRK_HANDLER(5XY3);
+    HANDLER(6XNN);
+    HANDLER(7XNN);
+    HANDLER(8XY0);
+    QUIRK_HANDLER(8XY1);
+    QUIRK_HANDLER(8XY2);
+    QUIRK_HANDLER(8XY3);
+    HANDLER(8XY4);
+    HANDLER(8XY5);
+    QUIRK_HANDLER(8XY6);
+    HANDLER(8XY7);
+    QUIRK_HANDLER(8XYE);
+    QUIRK_HANDLER(9XY0);
+    HANDLER(ANNN);
+    QUIRK_HANDLER(BNNN);
+    HANDLER(CXNN);
+    QUIRK_HANDLER(DXYN);
+    QUIRK_HANDLER(DXY0);
+    QUIRK_HANDLER(EX9E);
+    QUIRK_HANDLER(EXA1);
+    QUIRK_HANDLER(F000);
+    QUIRK_HANDLER(FN01);
+    QUIRK_HANDLER(F002);
+    HANDLER(FX07);
+L_FX0A:
+    {
+        const uint16_t address = program_counter - 2;
+        const int8_t waiting_for = last_key_pressed;
+        op_FX0A(instruction, memory, display, keypad);
+        TRACE();
+        if constexpr (!traced)
         {
-            if (!keypad.is_pressed(registers[X]))
-            {
-                program_counter += 2;
-            }
+            cycles -= skip_key_wait(address, waiting_for, cycles);
         }
     }
-    else if (op == 0xF000)
+    DISPATCH();
+
+    HANDLER(FX15);
+    HANDLER(FX18);
+    QUIRK_HANDLER(FX1E);
+    HANDLER(FX29);
+    QUIRK_HANDLER(FX30);
+    HANDLER(FX33);
+    QUIRK_HANDLER(FX3A);
+    QUIRK_HANDLER(FX55);
+    QUIRK_HANDLER(FX65);
+    QUIRK_HANDLER(FX75);
+    QUIRK_HANDLER(FX85);
+
+#undef QUIRK_HANDLER
+#undef HANDLER
+#undef TRACE
+#undef DISPATCH
+#else
+    for (; cycles > 0; --cycles)
     {
-        if (NN == 0x07)
+        const uint16_t address = program_counter;
+        const int8_t waiting_for = last_key_pressed;
+        const Instruction instruction = fetch_instruction(memory);
+        (this->*handlers<profile>[instruction.op])(instruction, memory, display, keypad);
+
+        if constexpr (traced)
         {
-            registers[X] = delay_timer;
+            trace(address, instruction);
+            continue;
         }
-        else if (NN == 0x15)
+
+        if (instruction.op == OP_1NNN && may_close_idle_loop(address, program_counter))
         {
-            delay_timer = registers[X];
+            cycles -= skip_idle_loop(address, memory, display, keypad, cycles - 1);
         }
-        else if (NN == 0x18)
+        else if (instruction.op == OP_FX0A)
         {
-            sound_timer = registers[X];
+            cycles -= skip_key_wait(address, waiting_for, cycles - 1);
         }
-        else if (NN == 0x0A)
+    }
+#endif
+}
+
+uint64_t Cpu::skip_idle_loop(uint16_t address, Memory& memory, Display& display, Keypad& keypad, uint64_t remaining)
+{
+    const uint16_t target = program_counter;
+
+    // A jump to itself: nothing will ever change
+    if (target == address)
+    {
+        idle = true;
+        return remaining;
+    }
+
+    // Only a loop made entirely of idle-safe operations can be idle
+    auto is_safe = [&]()
+    {
+        for (uint16_t body = target; body < address; body += 2)
         {
-            if (last_key_pressed != -1 && keypad.is_released_this_loop(last_key_pressed))
-            {
-                // Some key was previously pressed, and it was released this loop
-                // Store that key in VX and clear last keypress state; instruction complete
-                registers[X] = last_key_pressed;
-                last_key_pressed = -1;
-            }
-            else
+            if (!is_idle_safe(memory.fetch(body).op))
             {
-                // Either no key has been pressed, or we are still waiting for the pressed key to release
-                // Cycle through keys and update the latest keypress if a new key was pressed this loop
-                for (int i = 0; i < 16; ++i)
-                {
-                    if (keypad.is_pressed_this_loop(i))
-                    {
-                        last_key_pressed = i;
-                        break;
-                    }
-                }
-
-                // Decrement PC to retry instruction
-                program_counter -= 2;
+                return false;
             }
         }
-        else if (NN == 0x1E)
-        {
-            index_register += registers[X];
+        return true;
+    };
 
-            // Set carry flag if index register overflows the typical 12-bit addressing range
-            // The original COSMAC VIP interpreter doesn't do this but some others (e.g. Amiga) do
-            if (index_register > 0x0FFF)
-            {
-                registers[0xF] = 1;
-            }
-        }
-        else if (NN == 0x29)
+    // And only if its registers are the same as the last time round
+    const bool repeated = idle_loop.valid && idle_loop.jump == address && registers == idle_loop.registers &&
+        index_register == idle_loop.index_register;
+
+    if (!repeated)
+    {
+        if (!idle_loop.valid || idle_loop.jump != address)
         {
-            index_register = FONT_SET_START_ADDRESS + (registers[X] * BYTES_PER_FONT_SPRITE);
+            idle_loop.valid = true;
+            idle_loop.jump = address;
+            idle_loop.safe = is_safe();
         }
-        else if (NN == 0x33)
-        {
-            // Binary-coded decimal conversion
-            uint8_t decimal_value = registers[X];
+        idle_loop.registers = registers;
+        idle_loop.index_register = index_register;
+        return 0;
+    }
 
-            // Place each digit of decimal value in X into memory starting at index register
-            // Iterate backwards beginning with least significant digit
-            for (int i = 2; i >= 0; --i)
-            {
-                memory.write(index_register + i, decimal_value % 10);
-                decimal_value /= 10;
-            }
-        }
-        else if (NN == 0x55)
+    // Checked again, since code outside the loop may have rewritten it
+    // since the first time
+    if (!is_safe())
+    {
+        idle_loop.safe = false;
+        return 0;
+    }
+
+    // Go round once more, for real, watching where it goes. If that comes
+    // back through the jump to the same state without leaving the loop,
+    // every later trip round goes exactly the same way (nothing the loop
+    // reads changes during a run), so skip all the whole ones. A trip
+    // round that doesn't loop inside the body takes at most one cycle per
+    // instruction
+    const uint64_t longest_trip = std::min<uint64_t>(remaining, (address - target) / 2 + 1);
+    uint64_t executed = 0;
+
+    while (executed < longest_trip)
+    {
+        const uint16_t at = program_counter;
+        tick(memory, display, keypad);
+        ++executed;
+
+        if (at == address)
         {
-            for (int i = 0; i <= X; ++i)
+            if (program_counter != target || registers != idle_loop.registers ||
+                index_register != idle_loop.index_register)
             {
-                memory.write(index_register + i, registers[i]);
+                break;
             }
 
-            if (CLASSIC_MODE)
-            {
-                index_register += (X + 1);
-            }
+            idle = true;
+            const uint64_t left = remaining - executed;
+            return remaining - left % executed;
         }
-        else if (NN == 0x65)
-        {
-            for (int i = 0; i <= X; ++i)
-            {
-                registers[i] = memory.read(index_register + i);
-            }
 
-            if (CLASSIC_MODE)
-            {
-                index_register += (X + 1);
-            }
+        // Left the loop through a skip or jump
+        if (program_counter < target || program_counter > address)
+        {
+            break;
         }
     }
+
+    idle_loop.registers = registers;
+    idle_loop.index_register = index_register;
+    return executed;
+}
+
+uint64_t Cpu::skip_key_wait(uint16_t address, int8_t waiting_for, uint64_t remaining)
+{
+    // Still waiting, and with the same key as before: the key events don't
+    // change during a run, so neither will anything else
+    if (DETECT_IDLE_LOOPS && idle_skipping && program_counter == address && last_key_pressed == waiting_for)
+    {
+        idle = true;
+        return remaining;
+    }
+    return 0;
 }
 
 void Cpu::decrement_timers()
@@ -371,3 +1135,105 @@ void Cpu::decrement_timers()
         --sound_timer;
     }
 }
+
+bool Cpu::is_idle() const
+{
+    return idle;
+}
+
+void Cpu::set_idle_skipping(bool enabled)
+{
+    idle_skipping = enabled;
+}
+
+bool Cpu::get_idle_skipping() const
+{
+    return idle_skipping;
+}
+
+void Cpu::set_tracer(Tracer* tracer)
+{
+    this->tracer = tracer;
+}
+
+void Cpu::set_quirks(QuirkProfile profile)
+{
+    quirks = profile < QUIRK_PROFILE_COUNT ? profile : DEFAULT_QUIRK_PROFILE;
+}
+
+QuirkProfile Cpu::get_quirks() const
+{
+    return quirks;
+}
+
+void Cpu::seed(uint64_t value)
+{
+    random.seed(value);
+}
+
+const CpuProbe& Cpu::get_probe() const
+{
+    return probe;
+}
+
+void Cpu::reset_probe()
+{
+    probe.reset();
+}
+
+uint64_t Cpu::get_random_state() const
+{
+    return random.get_state();
+}
+
+void Cpu::set_random_state(uint64_t state)
+{
+    random.set_state(state);
+}
+
+const std::array<uint8_t, NUMBER_OF_REGISTERS>& Cpu::get_registers() const
+{
+    return registers;
+}
+
+uint16_t Cpu::get_program_counter() const
+{
+    return program_counter;
+}
+
+uint16_t Cpu::get_index_register() const
+{
+    return index_register;
+}
+
+void Cpu::save_state(SaveState& state) const
+{
+    state.program_counter = program_counter;
+    state.index_register = index_register;
+    std::memcpy(state.stack, stack.data(), sizeof(state.stack));
+    std::memcpy(state.registers, registers.data(), sizeof(state.registers));
+    state.stack_pointer = stack_pointer;
+    state.delay_timer = delay_timer;
+    state.sound_timer = sound_timer;
+    state.last_key_pressed = last_key_pressed;
+    state.random_state = random.get_state();
+    std::memcpy(state.flags, flags.data(), sizeof(state.flags));
+    std::memcpy(state.audio_pattern, audio_pattern.data(), sizeof(state.audio_pattern));
+    state.audio_pitch = audio_pitch;
+}
+
+void Cpu::load_state(const SaveState& state)
+{
+    program_counter = state.program_counter;
+    index_register = state.index_register;
+    std::memcpy(stack.data(), state.stack, sizeof(state.stack));
+    std::memcpy(registers.data(), state.registers, sizeof(state.registers));
+    stack_pointer = state.stack_pointer;
+    delay_timer = state.delay_timer;
+    sound_timer = state.sound_timer;
+    last_key_pressed = state.last_key_pressed;
+    random.set_state(state.random_state);
+    std::memcpy(flags.data(), state.flags, sizeof(state.flags));
+    std::memcpy(audio_pattern.data(), state.audio_pattern, sizeof(state.audio_pattern));
+    audio_pitch = state.audio_pitch;
+}
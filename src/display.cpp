@@ -1,31 +1,414 @@
+#include <array>
 #include <cstdint>
-#include <iostream>
+#include <cstring>
 
 #include "display.h"
+#include "hash.h"
 #include "constants.h"
 
+static_assert(DISPLAY_WIDTH == 64, "Low resolution rows are packed into one 64-bit word");
+static_assert(HIRES_DISPLAY_WIDTH == 128, "High resolution rows are packed into two 64-bit words");
+
+namespace
+{
+    // Each byte of a packed row expands to 8 RGBA pixels; precomputing all
+    // 256 patterns turns expansion into one 32-byte copy per byte
+    using PixelGroup = std::array<uint32_t, 8>;
+
+    std::array<PixelGroup, 256> build_expansion_table()
+    {
+        std::array<PixelGroup, 256> table{};
+
+        for (int byte = 0; byte < 256; ++byte)
+        {
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                table[byte][bit] = (byte >> (7 - bit)) & 1 ? PIXEL_ON : PIXEL_OFF;
+            }
+        }
+
+        return table;
+    }
+
+    const std::array<PixelGroup, 256> EXPANSION_TABLE = build_expansion_table();
+
+    // Pixels 00FB / 00FC scroll by
+    const unsigned int SCROLL_PIXELS = 4;
+}
+
 Display::Display()
-    : buffer{}
+    : planes{},
+      hires{ false },
+      selected_planes{ 1 }
 {
 }
 
-uint32_t Display::set_pixel(int x, int y)
+template <unsigned int ROW_WORDS, bool WIDE>
+bool Display::draw_plane(uint64_t* words, unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height, bool clip)
 {
-    const int display_index = x + (y * DISPLAY_WIDTH);
-    const uint32_t new_pixel_value = buffer[display_index] ^= PIXEL_ON; // Bitwise OR
+    const unsigned int screen_height = ROW_WORDS == 1 ? DISPLAY_HEIGHT : HIRES_DISPLAY_HEIGHT;
+
+    // Where each sprite row's bits land is the same for every row, so work
+    // out the shifts once: a row is lined up with its MSB at the top of a
+    // word, then shifted right by x across the row's words. Bits shifted
+    // past the right edge are dropped, or rotated back in on the left
+    const unsigned int word = x / 64;
+    const unsigned int shift = x % 64;
+
+    // The word the carried bits go to; with nowhere to go (clipped at the
+    // right edge) they're masked off and XORed harmlessly into word itself
+    const bool carry_wraps = word + 1 == ROW_WORDS;
+    const unsigned int carry_word = carry_wraps ? 0 : word + 1;
+    const uint64_t carry_mask = shift != 0 && !(carry_wraps && clip) ? ~uint64_t{ 0 } : 0;
 
-    return new_pixel_value;
+    // With one word a row, the carry lands back in the same word, so a row
+    // is a single rotate; clipping masks off the bits that came round
+    const uint64_t rotate_mask = clip ? ~uint64_t{ 0 } >> shift : ~uint64_t{ 0 };
+
+    // Rows past the bottom edge are cut off, or wrap to the top
+    const unsigned int rows = clip && y + height > screen_height ? screen_height - y : height;
+
+    uint64_t collision = 0;
+
+    for (unsigned int row = 0; row < rows; ++row)
+    {
+        const unsigned int line = (y + row) & (screen_height - 1);
+
+        const uint64_t bits = WIDE ? uint64_t{ sprite[row * 2] } << 8 | sprite[row * 2 + 1] : uint64_t{ sprite[row] } << 8;
+        const uint64_t aligned = bits << 48;
+
+        uint64_t* line_words = words + line * ROW_WORDS;
+        if constexpr (ROW_WORDS == 1)
+        {
+            const uint64_t pixels = ((aligned >> shift) | (aligned << ((64 - shift) & 63))) & rotate_mask;
+            collision |= line_words[0] & pixels;
+            line_words[0] ^= pixels;
+        }
+        else
+        {
+            // Part of the row in word, and the part that carries into the
+            // next word (or off the edge); shifting in two steps keeps a
+            // shift of 0 from becoming an undefined shift by 64
+            const uint64_t first = aligned >> shift;
+            const uint64_t carry = (aligned << (63 - shift) << 1) & carry_mask;
+
+            collision |= line_words[word] & first;
+            line_words[word] ^= first;
+            collision |= line_words[carry_word] & carry;
+            line_words[carry_word] ^= carry;
+        }
+    }
+
+    return collision != 0;
+}
+
+// The classic case draw_sprite() calls directly
+template bool Display::draw_plane<1, false>(uint64_t* words, unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height, bool clip);
+
+bool Display::draw_sprite_planes(unsigned int x, unsigned int y, const uint8_t* sprite, unsigned int height, bool wide, bool clip)
+{
+    bool collision = false;
+
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!((selected_planes >> plane) & 1))
+        {
+            continue;
+        }
+
+        if (hires)
+        {
+            collision |= wide
+                ? draw_plane<2, true>(planes[plane], x, y, sprite, height, clip)
+                : draw_plane<2, false>(planes[plane], x, y, sprite, height, clip);
+        }
+        else
+        {
+            collision |= wide
+                ? draw_plane<1, true>(planes[plane], x, y, sprite, height, clip)
+                : draw_plane<1, false>(planes[plane], x, y, sprite, height, clip);
+        }
+
+        sprite += wide ? height * 2 : height;
+    }
+
+    return collision;
 }
 
 void Display::clear()
 {
-    for (int i = 0; i < DISPLAY_WIDTH * DISPLAY_HEIGHT; ++i)
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if ((selected_planes >> plane) & 1)
+        {
+            std::memset(planes[plane], 0, sizeof(planes[plane]));
+        }
+    }
+}
+
+void Display::scroll_down(unsigned int rows)
+{
+    const unsigned int height = get_height();
+    const unsigned int row_words = get_row_words();
+    rows = rows < height ? rows : height;
+
+    // Rows are contiguous, so a scroll is one memmove per plane
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
     {
-        buffer[i] = PIXEL_OFF;
+        if ((selected_planes >> plane) & 1)
+        {
+            uint64_t* words = planes[plane];
+            std::memmove(words + rows * row_words, words, (height - rows) * row_words * sizeof(uint64_t));
+            std::memset(words, 0, rows * row_words * sizeof(uint64_t));
+        }
     }
 }
 
-const uint32_t* Display::get_display_buffer() const
+void Display::scroll_up(unsigned int rows)
+{
+    const unsigned int height = get_height();
+    const unsigned int row_words = get_row_words();
+    rows = rows < height ? rows : height;
+
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if ((selected_planes >> plane) & 1)
+        {
+            uint64_t* words = planes[plane];
+            std::memmove(words, words + rows * row_words, (height - rows) * row_words * sizeof(uint64_t));
+            std::memset(words + (height - rows) * row_words, 0, rows * row_words * sizeof(uint64_t));
+        }
+    }
+}
+
+void Display::scroll_right()
+{
+    const unsigned int height = get_height();
+
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!((selected_planes >> plane) & 1))
+        {
+            continue;
+        }
+
+        uint64_t* words = planes[plane];
+
+        if (!hires)
+        {
+            for (unsigned int y = 0; y < height; ++y)
+            {
+                words[y] >>= SCROLL_PIXELS;
+            }
+            continue;
+        }
+
+        // The bits leaving the left word carry into the right one
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            uint64_t* row = &words[y * 2];
+            row[1] = (row[1] >> SCROLL_PIXELS) | (row[0] << (64 - SCROLL_PIXELS));
+            row[0] >>= SCROLL_PIXELS;
+        }
+    }
+}
+
+void Display::scroll_left()
+{
+    const unsigned int height = get_height();
+
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        if (!((selected_planes >> plane) & 1))
+        {
+            continue;
+        }
+
+        uint64_t* words = planes[plane];
+
+        if (!hires)
+        {
+            for (unsigned int y = 0; y < height; ++y)
+            {
+                words[y] <<= SCROLL_PIXELS;
+            }
+            continue;
+        }
+
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            uint64_t* row = &words[y * 2];
+            row[0] = (row[0] << SCROLL_PIXELS) | (row[1] >> (64 - SCROLL_PIXELS));
+            row[1] <<= SCROLL_PIXELS;
+        }
+    }
+}
+
+void Display::set_hires(bool enabled)
+{
+    // Every plane is cleared, selected or not, since the row layout changes
+    std::memset(planes, 0, sizeof(planes));
+    hires = enabled;
+}
+
+unsigned int Display::get_row_words() const
+{
+    return hires ? 2 : 1;
+}
+
+uint64_t Display::all_rows() const
+{
+    return ~uint64_t{ 0 } >> (64 - get_height());
+}
+
+void Display::select_planes(uint8_t mask)
+{
+    selected_planes = mask & ((1 << DISPLAY_PLANES) - 1);
+}
+
+uint8_t Display::get_selected_planes() const
+{
+    return selected_planes;
+}
+
+unsigned int Display::get_pixel(unsigned int x, unsigned int y) const
+{
+    const unsigned int index = y * get_row_words() + x / 64;
+    const unsigned int bit = 63 - x % 64;
+
+    unsigned int color = 0;
+    for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+    {
+        color |= ((planes[plane][index] >> bit) & 1) << plane;
+    }
+    return color;
+}
+
+const uint64_t* Display::get_rows() const
+{
+    return planes[0];
+}
+
+const uint64_t* Display::get_plane(unsigned int plane) const
+{
+    return planes[plane];
+}
+
+uint64_t Display::hash() const
+{
+    const size_t size = get_height() * get_row_words() * sizeof(uint64_t);
+    uint64_t value = fnv1a_64(planes[0], size);
+
+    // Only a high resolution or two-plane screen hashes anything more
+    bool extended = hires;
+    for (size_t word = 0; word < size / sizeof(uint64_t) && !extended; ++word)
+    {
+        extended = planes[1][word] != 0;
+    }
+
+    if (extended)
+    {
+        const uint8_t mode = hires;
+        value = fnv1a_64(&mode, sizeof(mode), value);
+        value = fnv1a_64(planes[1], size, value);
+    }
+
+    return value;
+}
+
+void Display::expand_rgba(uint32_t* pixels) const
+{
+    expand_rgba_rows(pixels, 0, get_height());
+}
+
+void Display::expand_rgba_rows(uint32_t* pixels, unsigned int first_row, unsigned int row_count) const
+{
+    const unsigned int row_words = get_row_words();
+    pixels += first_row * get_width();
+
+    for (unsigned int index = first_row * row_words; index < (first_row + row_count) * row_words; ++index)
+    {
+        const uint64_t low = planes[0][index];
+        const uint64_t high = planes[1][index];
+
+        for (int byte = 0; byte < 8; ++byte)
+        {
+            const uint8_t bits = low >> (56 - byte * 8);
+            const uint8_t plane_2_bits = high >> (56 - byte * 8);
+
+            // Plane 1 is usually empty; then it's the plain table lookup
+            if (plane_2_bits == 0)
+            {
+                std::memcpy(pixels, EXPANSION_TABLE[bits].data(), sizeof(PixelGroup));
+            }
+            else
+            {
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    pixels[bit] = PIXEL_PALETTE[((bits >> (7 - bit)) & 1) | ((plane_2_bits >> (7 - bit)) & 1) << 1];
+                }
+            }
+            pixels += 8;
+        }
+    }
+}
+
+void Display::expand_rgba_rows(const uint64_t* rows, uint32_t* pixels, unsigned int first_row, unsigned int row_count)
+{
+    pixels += first_row * DISPLAY_WIDTH;
+
+    for (unsigned int y = first_row; y < first_row + row_count; ++y)
+    {
+        const uint64_t row = rows[y];
+
+        for (int byte = 0; byte < 8; ++byte)
+        {
+            const uint8_t bits = row >> (56 - byte * 8);
+            std::memcpy(pixels, EXPANSION_TABLE[bits].data(), sizeof(PixelGroup));
+            pixels += 8;
+        }
+    }
+}
+
+uint64_t Display::diff_rows(const Display& other) const
+{
+    if (hires != other.hires)
+    {
+        return all_rows();
+    }
+
+    const unsigned int row_words = get_row_words();
+    uint64_t dirty = 0;
+
+    for (unsigned int y = 0; y < get_height(); ++y)
+    {
+        uint64_t changed = 0;
+        for (unsigned int plane = 0; plane < DISPLAY_PLANES; ++plane)
+        {
+            for (unsigned int word = y * row_words; word < (y + 1) * row_words; ++word)
+            {
+                changed |= planes[plane][word] ^ other.planes[plane][word];
+            }
+        }
+        dirty |= uint64_t{ changed != 0 } << y;
+    }
+
+    return dirty;
+}
+
+static_assert(sizeof(SaveState::display_planes) == sizeof(uint64_t) * DISPLAY_PLANES * HIRES_DISPLAY_HEIGHT * 2,
+    "Save states hold every plane at high resolution");
+
+void Display::save_state(SaveState& state) const
+{
+    state.display_hires = hires;
+    state.display_selected_planes = selected_planes;
+    std::memcpy(state.display_planes, planes, sizeof(planes));
+}
+
+void Display::load_state(const SaveState& state)
 {
-    return buffer;
+    hires = state.display_hires != 0;
+    select_planes(state.display_selected_planes);
+    std::memcpy(planes, state.display_planes, sizeof(planes));
 }
@@ -0,0 +1,203 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "emulation_thread.h"
+
+EmulationThread::EmulationThread(Chip8& chip8) :
+    chip8{ chip8 },
+    scheduler{ DISPLAY_HZ, CPU_HZ / DISPLAY_HZ },
+    running{ false },
+    turbo{ false },
+    frame_count{ 0 }
+{
+}
+
+EmulationThread::~EmulationThread()
+{
+    stop();
+}
+
+void EmulationThread::start()
+{
+    if (running.exchange(true))
+    {
+        return;
+    }
+
+    frame_count = 0;
+    thread = std::thread(&EmulationThread::run, this);
+}
+
+void EmulationThread::stop()
+{
+    running = false;
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+bool EmulationThread::keydown(uint8_t key, FrameScheduler::Clock::time_point time)
+{
+    return key_events.try_push(KeyEvent{ key, true, time });
+}
+
+bool EmulationThread::keyup(uint8_t key, FrameScheduler::Clock::time_point time)
+{
+    return key_events.try_push(KeyEvent{ key, false, time });
+}
+
+void EmulationThread::set_turbo(bool enabled)
+{
+    turbo = enabled;
+}
+
+void EmulationThread::set_frame_callback(std::function<void()> callback)
+{
+    frame_callback = std::move(callback);
+}
+
+bool EmulationThread::update_frame()
+{
+    return frames.update();
+}
+
+const DisplayFrame& EmulationThread::get_frame() const
+{
+    return frames.read_slot();
+}
+
+uint64_t EmulationThread::get_frame_count() const
+{
+    return frame_count;
+}
+
+void EmulationThread::run()
+{
+    scheduler.start();
+    bool was_turbo = false;
+
+    // Real time covered by the frames run so far; the next batch stands for
+    // everything since
+    FrameScheduler::Clock::time_point last_run = FrameScheduler::Clock::now();
+
+    // Display hash of the last frame handed to the UI thread, if that was
+    // an idle frame
+    bool idle_published = false;
+    uint64_t published_hash = 0;
+
+    while (running)
+    {
+        const bool is_turbo = turbo;
+        unsigned int due = 1;
+
+        if (is_turbo)
+        {
+            was_turbo = true;
+        }
+        else
+        {
+            if (was_turbo)
+            {
+                // Resume real-time pacing from now rather than "catching up"
+                // on deadlines that turbo already ran past
+                scheduler.start();
+                was_turbo = false;
+            }
+
+            // Sleep in short slices so stop() and turbo stay responsive
+            const auto wait = scheduler.time_until_next_frame();
+            if (wait > FrameScheduler::Clock::duration::zero())
+            {
+                std::this_thread::sleep_for(std::min<FrameScheduler::Clock::duration>(wait, std::chrono::milliseconds(50)));
+                continue;
+            }
+
+            due = scheduler.take_due_frames();
+            if (due == 0)
+            {
+                continue;
+            }
+        }
+
+        const FrameScheduler::Clock::time_point now = FrameScheduler::Clock::now();
+        run_frame(scheduler.take_cycles(due), last_run, now);
+        last_run = now;
+        frame_count += due;
+
+        // Idling (e.g. waiting for a key or a delay) with the screen as it
+        // was: don't publish, so the UI thread has nothing to present and
+        // both threads sleep until a timer or key moves the ROM on. The
+        // screen is only hashed while idle
+        if (chip8.is_idle())
+        {
+            const uint64_t hash = chip8.get_display_hash();
+            if (idle_published && hash == published_hash)
+            {
+                continue;
+            }
+            published_hash = hash;
+            idle_published = true;
+        }
+        else
+        {
+            idle_published = false;
+        }
+
+        DisplayFrame& frame = frames.write_slot();
+        frame.display = chip8.get_display();
+        frame.frame_number = frame_count;
+        frames.publish();
+
+        if (frame_callback)
+        {
+            frame_callback();
+        }
+    }
+}
+
+void EmulationThread::run_frame(uint64_t cycles, FrameScheduler::Clock::time_point start, FrameScheduler::Clock::time_point end)
+{
+    // Events are queued in the order they happened; each one lands on the
+    // cycle as far through the batch as it was through [start, end]. Earlier
+    // than start (queued while paused) means the first cycle, later than end
+    // (queued while this runs) the end of the batch, where the next frame's
+    // first cycle sees it
+    const double span = std::chrono::duration<double>(end - start).count();
+    uint64_t executed = 0;
+
+    KeyEvent event;
+    while (key_events.try_pop(event))
+    {
+        uint64_t at = cycles;
+        if (event.time <= start || span <= 0.0)
+        {
+            at = 0;
+        }
+        else if (event.time < end)
+        {
+            at = static_cast<uint64_t>(std::chrono::duration<double>(event.time - start).count() / span * cycles);
+        }
+
+        if (at > executed)
+        {
+            chip8.run_timed(at - executed);
+            executed = at;
+        }
+
+        if (event.down)
+        {
+            chip8.keydown(event.key);
+        }
+        else
+        {
+            chip8.keyup(event.key);
+        }
+    }
+
+    chip8.run_timed(cycles - executed);
+}
@@ -0,0 +1,596 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "frame_capture.h"
+
+namespace
+{
+    // How long the writer sleeps when there are no new frames for it
+    const auto WRITER_POLL_INTERVAL = std::chrono::milliseconds(1);
+
+    const char Y4M_FRAME_HEADER[] = "FRAME\n";
+    const size_t Y4M_FRAME_HEADER_SIZE = sizeof(Y4M_FRAME_HEADER) - 1;
+
+    // AVI layout: RIFF header, the hdrl list (main header, one video
+    // stream's header and format), then the movi list of '00db' frame
+    // chunks and the idx1 index. Offsets of the fields close() fills in
+    const size_t AVI_RIFF_SIZE_OFFSET = 4;
+    const size_t AVI_TOTAL_FRAMES_OFFSET = 48;
+    const size_t AVI_STREAM_LENGTH_OFFSET = 140;
+    const size_t AVI_MOVI_SIZE_OFFSET = 216;
+    const size_t AVI_MOVI_OFFSET = 220; // The 'movi' FOURCC; index offsets count from here
+    const size_t AVI_HEADER_SIZE = 224;
+
+    const size_t AVI_CHUNK_HEADER_SIZE = 8;
+    const size_t AVI_INDEX_ENTRY_SIZE = 16;
+    const uint32_t AVIF_HASINDEX = 0x10;
+    const uint32_t AVIIF_KEYFRAME = 0x10;
+
+    // RIFF sizes are 32-bit, and plenty of readers treat them as signed
+    const uint64_t AVI_MAX_SIZE = uint64_t{ 1 } << 31;
+
+    void put_u16(std::vector<uint8_t>& out, uint16_t value)
+    {
+        out.push_back(static_cast<uint8_t>(value));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+    }
+
+    void put_u32(std::vector<uint8_t>& out, uint32_t value)
+    {
+        put_u16(out, static_cast<uint16_t>(value));
+        put_u16(out, static_cast<uint16_t>(value >> 16));
+    }
+
+    void put_fourcc(std::vector<uint8_t>& out, const char* fourcc)
+    {
+        out.insert(out.end(), fourcc, fourcc + 4);
+    }
+
+    void store_u32(uint8_t* out, uint32_t value)
+    {
+        for (int byte = 0; byte < 4; ++byte)
+        {
+            out[byte] = static_cast<uint8_t>(value >> (byte * 8));
+        }
+    }
+
+    CaptureFormat format_for(const std::string& filename)
+    {
+        const size_t dot = filename.find_last_of('.');
+        std::string extension = dot == std::string::npos ? "" : filename.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+        {
+            return static_cast<char>(std::tolower(c));
+        });
+
+        if (extension == "y4m")
+        {
+            return CaptureFormat::Y4M;
+        }
+        if (extension == "avi")
+        {
+            return CaptureFormat::AVI;
+        }
+        return CaptureFormat::RAW;
+    }
+
+    uint8_t clamp_channel(double value)
+    {
+        return static_cast<uint8_t>(std::min(255.0, std::max(0.0, std::round(value))));
+    }
+
+    size_t round_up_to_power_of_two(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+FrameCapture::FrameCapture(size_t capacity) :
+    ring(round_up_to_power_of_two(std::max<size_t>(capacity, 2))),
+    mask{ ring.size() - 1 },
+    position{ 0 },
+    pending_repeats{ 0 },
+    frames{ 0 },
+    repeats{ 0 },
+    dropped{ 0 },
+    head{ 0 },
+    tail{ 0 },
+    format{ CaptureFormat::RAW },
+    scale{ DEFAULT_SCALE },
+    width{ 0 },
+    height{ 0 },
+    colors{},
+    file_size{ 0 },
+    written_frames{ 0 },
+    truncated{ false },
+    running{ false }
+{
+}
+
+FrameCapture::~FrameCapture()
+{
+    close();
+}
+
+bool FrameCapture::open(const std::string& filename, unsigned int scale)
+{
+    close();
+
+    out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    format = format_for(filename);
+    this->scale = std::max(scale, 1u);
+    width = HIRES_DISPLAY_WIDTH * this->scale;
+    height = HIRES_DISPLAY_HEIGHT * this->scale;
+
+    for (size_t color = 0; color < colors.size(); ++color)
+    {
+        const uint32_t pixel = PIXEL_PALETTE[color];
+        const uint8_t r = pixel & 0xFF;
+        const uint8_t g = (pixel >> 8) & 0xFF;
+        const uint8_t b = (pixel >> 16) & 0xFF;
+
+        switch (format)
+        {
+        case CaptureFormat::RAW:
+            colors[color] = { r, g, b };
+            break;
+        case CaptureFormat::AVI:
+            colors[color] = { b, g, r };
+            break;
+        case CaptureFormat::Y4M:
+            // BT.601, studio range (what Y4M readers assume)
+            colors[color] = {
+                clamp_channel(16.0 + 0.257 * r + 0.504 * g + 0.098 * b),
+                clamp_channel(128.0 - 0.148 * r - 0.291 * g + 0.439 * b),
+                clamp_channel(128.0 + 0.439 * r - 0.368 * g - 0.071 * b),
+            };
+            break;
+        }
+    }
+
+    position = 0;
+    pending_repeats = 0;
+    frames = 0;
+    repeats = 0;
+    dropped = 0;
+    head = 0;
+    tail = 0;
+
+    encoded.clear();
+    row_colors.assign(width, 0);
+    file_size = 0;
+    written_frames = 0;
+    index.clear();
+    truncated = false;
+
+    write_header();
+
+    running = true;
+    writer = std::thread(&FrameCapture::write_loop, this);
+    return true;
+}
+
+void FrameCapture::close()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    running = false;
+    writer.join();
+
+    // The writer has stopped, so its side is this thread's now; the last
+    // frame lasts as long as it was captured for
+    write_repeats(pending_repeats);
+    pending_repeats = 0;
+    finish();
+
+    out.close();
+}
+
+bool FrameCapture::is_open() const
+{
+    return writer.joinable();
+}
+
+void FrameCapture::capture(const Display& display)
+{
+    ++frames;
+
+    // The previous frame's slot stays put until the writer is done with
+    // it, and the writer only reads it, so comparing against it is safe
+    if (position > 0 && display.diff_rows(ring[(position - 1) & mask].display) == 0)
+    {
+        ++pending_repeats;
+        ++repeats;
+        return;
+    }
+
+    if (position - tail.load(std::memory_order_acquire) == ring.size())
+    {
+        ++pending_repeats;
+        ++dropped;
+        return;
+    }
+
+    Slot& slot = ring[position & mask];
+    slot.display = display;
+    slot.repeats = pending_repeats;
+    pending_repeats = 0;
+
+    head.store(++position, std::memory_order_release);
+}
+
+uint64_t FrameCapture::get_frame_count() const
+{
+    return frames;
+}
+
+uint64_t FrameCapture::get_repeat_count() const
+{
+    return repeats;
+}
+
+uint64_t FrameCapture::get_dropped_count() const
+{
+    return dropped;
+}
+
+bool FrameCapture::is_truncated() const
+{
+    return truncated;
+}
+
+CaptureFormat FrameCapture::get_format() const
+{
+    return format;
+}
+
+unsigned int FrameCapture::get_width() const
+{
+    return width;
+}
+
+unsigned int FrameCapture::get_height() const
+{
+    return height;
+}
+
+void FrameCapture::write_loop()
+{
+    uint64_t consumed = 0;
+
+    for (;;)
+    {
+        // Read running first: once it's false, head is final
+        const bool stopping = !running.load(std::memory_order_acquire);
+        const uint64_t available = head.load(std::memory_order_acquire);
+
+        if (available != consumed)
+        {
+            // Hand each slot back as soon as it's written, so the emulation
+            // has room again as early as possible
+            for (; consumed != available; ++consumed)
+            {
+                const Slot& slot = ring[consumed & mask];
+                write_repeats(slot.repeats);
+                write_frame(slot.display);
+                tail.store(consumed + 1, std::memory_order_release);
+            }
+        }
+        else if (stopping)
+        {
+            break;
+        }
+        else
+        {
+            std::this_thread::sleep_for(WRITER_POLL_INTERVAL);
+        }
+    }
+}
+
+void FrameCapture::write_header()
+{
+    std::vector<uint8_t> header;
+
+    if (format == CaptureFormat::Y4M)
+    {
+        const std::string text = "YUV4MPEG2 W" + std::to_string(width) + " H" + std::to_string(height) + " F" +
+            std::to_string(static_cast<unsigned int>(DISPLAY_HZ)) + ":1 Ip A1:1 C444\n";
+        header.assign(text.begin(), text.end());
+    }
+    else if (format == CaptureFormat::AVI)
+    {
+        const uint32_t stride = (width * 3 + 3) & ~3u;
+        const uint32_t frame_size = stride * height;
+        const uint32_t rate = static_cast<uint32_t>(DISPLAY_HZ);
+
+        put_fourcc(header, "RIFF");
+        put_u32(header, 0); // Filled in by finish()
+        put_fourcc(header, "AVI ");
+
+        put_fourcc(header, "LIST");
+        put_u32(header, 192);
+        put_fourcc(header, "hdrl");
+
+        put_fourcc(header, "avih");
+        put_u32(header, 56);
+        put_u32(header, static_cast<uint32_t>(1000000.0 / DISPLAY_HZ + 0.5));
+        put_u32(header, frame_size * rate);
+        put_u32(header, 0);
+        put_u32(header, AVIF_HASINDEX);
+        put_u32(header, 0); // Total frames
+        put_u32(header, 0);
+        put_u32(header, 1); // Streams
+        put_u32(header, frame_size + AVI_CHUNK_HEADER_SIZE);
+        put_u32(header, width);
+        put_u32(header, height);
+        for (int reserved = 0; reserved < 4; ++reserved)
+        {
+            put_u32(header, 0);
+        }
+
+        put_fourcc(header, "LIST");
+        put_u32(header, 116);
+        put_fourcc(header, "strl");
+
+        put_fourcc(header, "strh");
+        put_u32(header, 56);
+        put_fourcc(header, "vids");
+        put_fourcc(header, "DIB ");
+        put_u32(header, 0); // Flags
+        put_u16(header, 0); // Priority
+        put_u16(header, 0); // Language
+        put_u32(header, 0); // Initial frames
+        put_u32(header, 1); // Scale
+        put_u32(header, rate);
+        put_u32(header, 0); // Start
+        put_u32(header, 0); // Length
+        put_u32(header, frame_size + AVI_CHUNK_HEADER_SIZE);
+        put_u32(header, 0xFFFFFFFF); // Default quality
+        put_u32(header, 0); // Sample size (varies: repeats are empty)
+        put_u16(header, 0);
+        put_u16(header, 0);
+        put_u16(header, static_cast<uint16_t>(width));
+        put_u16(header, static_cast<uint16_t>(height));
+
+        // BITMAPINFOHEADER; a positive height means rows go bottom-up
+        put_fourcc(header, "strf");
+        put_u32(header, 40);
+        put_u32(header, 40);
+        put_u32(header, width);
+        put_u32(header, height);
+        put_u16(header, 1); // Planes
+        put_u16(header, 24); // Bits per pixel
+        put_u32(header, 0); // BI_RGB
+        put_u32(header, frame_size);
+        put_u32(header, 0);
+        put_u32(header, 0);
+        put_u32(header, 0);
+        put_u32(header, 0);
+
+        put_fourcc(header, "LIST");
+        put_u32(header, 0); // Filled in by finish()
+        put_fourcc(header, "movi");
+    }
+
+    out.write(reinterpret_cast<const char*>(header.data()), header.size());
+    file_size = header.size();
+}
+
+void FrameCapture::write_frame(const Display& display)
+{
+    encode(display);
+
+    if (format == CaptureFormat::AVI)
+    {
+        if (truncated || file_size + encoded.size() + index.size() + AVI_INDEX_ENTRY_SIZE + AVI_CHUNK_HEADER_SIZE > AVI_MAX_SIZE)
+        {
+            truncated = true;
+            return;
+        }
+
+        put_fourcc(index, "00db");
+        put_u32(index, AVIIF_KEYFRAME);
+        put_u32(index, static_cast<uint32_t>(file_size - AVI_MOVI_OFFSET));
+        put_u32(index, static_cast<uint32_t>(encoded.size() - AVI_CHUNK_HEADER_SIZE));
+    }
+
+    out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+    file_size += encoded.size();
+    ++written_frames;
+}
+
+void FrameCapture::write_repeats(uint64_t count)
+{
+    // Nothing to repeat before the first frame
+    if (encoded.empty())
+    {
+        return;
+    }
+
+    if (format != CaptureFormat::AVI)
+    {
+        for (uint64_t i = 0; i < count; ++i)
+        {
+            out.write(reinterpret_cast<const char*>(encoded.data()), encoded.size());
+        }
+        file_size += count * encoded.size();
+        written_frames += count;
+        return;
+    }
+
+    // An empty chunk: "the same frame again"
+    static const uint8_t EMPTY_CHUNK[AVI_CHUNK_HEADER_SIZE] = { '0', '0', 'd', 'b', 0, 0, 0, 0 };
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        if (truncated || file_size + AVI_CHUNK_HEADER_SIZE + index.size() + 2 * AVI_INDEX_ENTRY_SIZE > AVI_MAX_SIZE)
+        {
+            truncated = true;
+            return;
+        }
+
+        put_fourcc(index, "00db");
+        put_u32(index, 0);
+        put_u32(index, static_cast<uint32_t>(file_size - AVI_MOVI_OFFSET));
+        put_u32(index, 0);
+
+        out.write(reinterpret_cast<const char*>(EMPTY_CHUNK), sizeof(EMPTY_CHUNK));
+        file_size += sizeof(EMPTY_CHUNK);
+        ++written_frames;
+    }
+}
+
+void FrameCapture::finish()
+{
+    if (format != CaptureFormat::AVI)
+    {
+        out.flush();
+        return;
+    }
+
+    std::vector<uint8_t> trailer;
+    put_fourcc(trailer, "idx1");
+    put_u32(trailer, static_cast<uint32_t>(index.size()));
+    const uint64_t movi_end = file_size;
+
+    out.write(reinterpret_cast<const char*>(trailer.data()), trailer.size());
+    out.write(reinterpret_cast<const char*>(index.data()), index.size());
+    file_size += trailer.size() + index.size();
+
+    // Go back and fill in the sizes and frame counts
+    const struct
+    {
+        size_t offset;
+        uint64_t value;
+    } fields[] = {
+        { AVI_RIFF_SIZE_OFFSET, file_size - 8 },
+        { AVI_TOTAL_FRAMES_OFFSET, written_frames },
+        { AVI_STREAM_LENGTH_OFFSET, written_frames },
+        { AVI_MOVI_SIZE_OFFSET, movi_end - AVI_MOVI_OFFSET },
+    };
+
+    for (const auto& field : fields)
+    {
+        uint8_t bytes[4];
+        store_u32(bytes, static_cast<uint32_t>(field.value));
+        out.seekp(field.offset);
+        out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+    }
+
+    out.flush();
+}
+
+void FrameCapture::encode(const Display& display)
+{
+    const unsigned int source_width = display.get_width();
+    const unsigned int source_height = display.get_height();
+    const unsigned int factor = width / source_width;
+    const unsigned int row_words = source_width / 64;
+    const uint64_t* plane_1 = display.get_plane(0);
+    const uint64_t* plane_2 = display.get_plane(1);
+
+    const size_t stride = format == CaptureFormat::AVI ? (width * 3 + 3) & ~3u : width * 3;
+    const size_t plane_size = size_t{ width } * height; // Y4M
+    size_t header = 0;
+
+    if (format == CaptureFormat::Y4M)
+    {
+        header = Y4M_FRAME_HEADER_SIZE;
+    }
+    else if (format == CaptureFormat::AVI)
+    {
+        header = AVI_CHUNK_HEADER_SIZE;
+    }
+
+    if (encoded.empty())
+    {
+        encoded.assign(header + stride * height, 0);
+
+        if (format == CaptureFormat::Y4M)
+        {
+            std::memcpy(encoded.data(), Y4M_FRAME_HEADER, Y4M_FRAME_HEADER_SIZE);
+        }
+        else if (format == CaptureFormat::AVI)
+        {
+            std::memcpy(encoded.data(), "00db", 4);
+            store_u32(encoded.data() + 4, static_cast<uint32_t>(stride * height));
+        }
+    }
+
+    uint8_t* const payload = encoded.data() + header;
+
+    for (unsigned int y = 0; y < source_height; ++y)
+    {
+        for (unsigned int x = 0; x < source_width; ++x)
+        {
+            const unsigned int word = y * row_words + x / 64;
+            const unsigned int bit = 63 - x % 64;
+            const uint8_t color = static_cast<uint8_t>(((plane_1[word] >> bit) & 1) | ((plane_2[word] >> bit) & 1) << 1);
+            std::fill_n(row_colors.begin() + x * factor, factor, color);
+        }
+
+        // Convert the first output row of this display row; the other
+        // factor - 1 are copies of it
+        const size_t first_row = size_t{ y } * factor;
+
+        if (format == CaptureFormat::Y4M)
+        {
+            uint8_t* const luma = payload + first_row * width;
+            uint8_t* const blue = luma + plane_size;
+            uint8_t* const red = blue + plane_size;
+
+            for (unsigned int i = 0; i < width; ++i)
+            {
+                const std::array<uint8_t, 3>& value = colors[row_colors[i]];
+                luma[i] = value[0];
+                blue[i] = value[1];
+                red[i] = value[2];
+            }
+
+            for (unsigned int copy = 1; copy < factor; ++copy)
+            {
+                for (uint8_t* const plane : { luma, blue, red })
+                {
+                    std::memcpy(plane + copy * width, plane, width);
+                }
+            }
+            continue;
+        }
+
+        // AVI rows are stored bottom-up
+        auto row_at = [&](size_t row)
+        {
+            return payload + (format == CaptureFormat::AVI ? height - 1 - row : row) * stride;
+        };
+
+        uint8_t* const pixels = row_at(first_row);
+        for (unsigned int i = 0; i < width; ++i)
+        {
+            std::memcpy(pixels + i * 3, colors[row_colors[i]].data(), 3);
+        }
+
+        for (unsigned int copy = 1; copy < factor; ++copy)
+        {
+            std::memcpy(row_at(first_row + copy), pixels, width * 3);
+        }
+    }
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cstdint>
+
+#include "frame_scheduler.h"
+
+FrameScheduler::FrameScheduler(double frame_hz, double cycles_per_frame, unsigned int max_catch_up_frames) :
+    frame_period{ std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / frame_hz)) },
+    cycles_per_frame{ cycles_per_frame },
+    max_catch_up_frames{ max_catch_up_frames },
+    next_frame{ Clock::now() + frame_period },
+    cycle_budget{ 0.0 },
+    dropped_frames{ 0 }
+{
+}
+
+void FrameScheduler::start()
+{
+    next_frame = Clock::now() + frame_period;
+    cycle_budget = 0.0;
+    dropped_frames = 0;
+}
+
+unsigned int FrameScheduler::take_due_frames()
+{
+    const Clock::time_point now = Clock::now();
+
+    if (now < next_frame)
+    {
+        return 0;
+    }
+
+    const uint64_t due = (now - next_frame) / frame_period + 1;
+
+    if (due > max_catch_up_frames)
+    {
+        // Too far behind to catch up without visibly fast-forwarding; run the
+        // allowed frames and restart the schedule from now
+        dropped_frames += due - max_catch_up_frames;
+        next_frame = now + frame_period;
+        return max_catch_up_frames;
+    }
+
+    next_frame += due * frame_period;
+    return static_cast<unsigned int>(due);
+}
+
+uint64_t FrameScheduler::take_cycles(unsigned int frames)
+{
+    cycle_budget += frames * cycles_per_frame;
+
+    const uint64_t cycles = static_cast<uint64_t>(cycle_budget);
+    cycle_budget -= cycles;
+    return cycles;
+}
+
+FrameScheduler::Clock::duration FrameScheduler::time_until_next_frame() const
+{
+    const Clock::time_point now = Clock::now();
+    return now < next_frame ? next_frame - now : Clock::duration::zero();
+}
+
+uint64_t FrameScheduler::get_dropped_frames() const
+{
+    return dropped_frames;
+}
@@ -0,0 +1,176 @@
+#include <cstdint>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "input_log.h"
+
+namespace
+{
+    const uint32_t INPUT_LOG_MAGIC = 0x4C493843; // "C8IL"
+    const uint32_t INPUT_LOG_VERSION = 1;
+
+    void put_u64(std::vector<uint8_t>& out, uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; ++i)
+        {
+            out.push_back(static_cast<uint8_t>(value >> (i * 8)));
+        }
+    }
+
+    // LEB128: 7 bits per byte, high bit set on all but the last
+    void put_varint(std::vector<uint8_t>& out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    bool get_u64(const std::vector<uint8_t>& in, size_t& position, uint64_t& value, int bytes)
+    {
+        if (position + bytes > in.size())
+        {
+            return false;
+        }
+
+        value = 0;
+        for (int i = 0; i < bytes; ++i)
+        {
+            value |= uint64_t{ in[position++] } << (i * 8);
+        }
+        return true;
+    }
+
+    bool get_varint(const std::vector<uint8_t>& in, size_t& position, uint64_t& value)
+    {
+        value = 0;
+        for (int shift = 0; shift < 64 && position < in.size(); shift += 7)
+        {
+            const uint8_t byte = in[position++];
+            value |= uint64_t{ byte & 0x7Fu } << shift;
+
+            if (!(byte & 0x80))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+InputLog::InputLog() :
+    random_state{ 0 },
+    cycle_count{ 0 }
+{
+}
+
+void InputLog::clear(uint64_t random_state)
+{
+    this->random_state = random_state;
+    cycle_count = 0;
+    events.clear();
+}
+
+void InputLog::record(uint64_t cycle, EventType type, uint8_t key)
+{
+    events.push_back(Event{ cycle, type, key });
+
+    if (cycle > cycle_count)
+    {
+        cycle_count = cycle;
+    }
+}
+
+void InputLog::set_cycle_count(uint64_t cycles)
+{
+    cycle_count = cycles;
+}
+
+uint64_t InputLog::get_cycle_count() const
+{
+    return cycle_count;
+}
+
+uint64_t InputLog::get_random_state() const
+{
+    return random_state;
+}
+
+const std::vector<InputLog::Event>& InputLog::get_events() const
+{
+    return events;
+}
+
+bool InputLog::save(const std::string& filename) const
+{
+    std::vector<uint8_t> out;
+    out.reserve(32 + events.size() * 3);
+
+    put_u64(out, INPUT_LOG_MAGIC, 4);
+    put_u64(out, INPUT_LOG_VERSION, 4);
+    put_u64(out, random_state, 8);
+    put_u64(out, cycle_count, 8);
+    put_u64(out, events.size(), 8);
+
+    uint64_t previous_cycle = 0;
+    for (const Event& event : events)
+    {
+        put_varint(out, event.cycle - previous_cycle);
+        out.push_back(static_cast<uint8_t>(event.type << 4 | (event.key & 0xF)));
+        previous_cycle = event.cycle;
+    }
+
+    std::ofstream file_out(filename, std::ios::binary);
+    file_out.write(reinterpret_cast<const char*>(out.data()), out.size());
+    return file_out.good();
+}
+
+bool InputLog::load(const std::string& filename)
+{
+    std::ifstream file_in(filename, std::ios::binary);
+
+    if (!file_in.is_open())
+    {
+        return false;
+    }
+
+    const std::vector<uint8_t> in{ std::istreambuf_iterator<char>(file_in), std::istreambuf_iterator<char>() };
+    size_t position = 0;
+    uint64_t magic, version, count;
+
+    if (!get_u64(in, position, magic, 4) || magic != INPUT_LOG_MAGIC ||
+        !get_u64(in, position, version, 4) || version != INPUT_LOG_VERSION ||
+        !get_u64(in, position, random_state, 8) ||
+        !get_u64(in, position, cycle_count, 8) ||
+        !get_u64(in, position, count, 8))
+    {
+        return false;
+    }
+
+    events.clear();
+    uint64_t cycle = 0;
+
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t delta;
+        if (!get_varint(in, position, delta) || position >= in.size())
+        {
+            return false;
+        }
+
+        const uint8_t packed = in[position++];
+        if ((packed >> 4) > TIMER_TICK)
+        {
+            return false;
+        }
+
+        cycle += delta;
+        events.push_back(Event{ cycle, static_cast<EventType>(packed >> 4), static_cast<uint8_t>(packed & 0xF) });
+    }
+
+    return true;
+}
@@ -0,0 +1,859 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "jit.h"
+#include "cpu.h"
+#include "memory.h"
+#include "decoder.h"
+#include "constants.h"
+
+// Only x86-64 with the System V calling convention (block functions receive
+// the Cpu pointer in RDI) and POSIX mmap are supported
+#if defined(__x86_64__) && defined(__unix__)
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#else
+#define CHIP8_JIT_SUPPORTED 0
+#endif
+
+namespace
+{
+    const size_t CODE_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    // Longest block we translate; also bounds how far a block can overshoot
+    // the cycle budget (it can't: blocks only run if they fit)
+    const int MAX_BLOCK_LENGTH = 64;
+
+    // Worst case native code size per CHIP-8 instruction, plus prologue and
+    // epilogue; used to make sure a block fits before compiling it
+    const size_t MAX_BYTES_PER_INSTRUCTION = 32;
+    const size_t MAX_BLOCK_OVERHEAD = 256;
+
+    // x86-64 register numbers
+    enum HostReg : uint8_t
+    {
+        RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+        R8, R9, R10, R11, R12, R13, R14, R15
+    };
+
+    // Host registers available for caching guest V registers, caller-saved
+    // first. RAX/RCX/RDX are scratch; RDI holds the Cpu pointer
+    const HostReg ALLOCATABLE[] = { RSI, R8, R9, R10, R11, RBX, RBP, R12, R13, R14, R15 };
+
+    bool is_callee_saved(HostReg reg)
+    {
+        return reg == RBX || reg == RBP || reg >= R12;
+    }
+
+    // Where a guest V register lives during a block: a host register, or its
+    // slot in the Cpu object addressed as [RDI + disp]
+    struct Location
+    {
+        bool in_register;
+        HostReg reg;
+        int32_t disp;
+    };
+
+    // Minimal x86-64 encoder covering the handful of instruction forms the
+    // translator needs. Byte-sized operations always carry a REX prefix so
+    // host registers 4-7 mean SPL/BPL/SIL/DIL rather than AH/CH/DH/BH
+    class Emitter
+    {
+    public:
+        explicit Emitter(uint8_t* out) : start{ out }, cursor{ out } {}
+
+        size_t size() const { return cursor - start; }
+        uint8_t* position() const { return cursor; }
+
+        void byte(uint8_t value) { *cursor++ = value; }
+
+        void u16(uint16_t value)
+        {
+            std::memcpy(cursor, &value, sizeof(value));
+            cursor += sizeof(value);
+        }
+
+        void u32(uint32_t value)
+        {
+            std::memcpy(cursor, &value, sizeof(value));
+            cursor += sizeof(value);
+        }
+
+        // REX + opcode(s) + ModRM for a byte operation between a register
+        // (ModRM.reg) and a location (ModRM.rm)
+        void byte_op(std::initializer_list<uint8_t> opcode, uint8_t reg_field, const Location& rm)
+        {
+            const uint8_t rex_b = rm.in_register ? (rm.reg >> 3) : 0;
+            byte(0x40 | ((reg_field >> 3) << 2) | rex_b);
+
+            for (const uint8_t op : opcode)
+            {
+                byte(op);
+            }
+
+            modrm(reg_field, rm);
+        }
+
+        void modrm(uint8_t reg_field, const Location& rm)
+        {
+            if (rm.in_register)
+            {
+                byte(0xC0 | ((reg_field & 7) << 3) | (rm.reg & 7));
+            }
+            else
+            {
+                // [RDI + disp32]
+                byte(0x80 | ((reg_field & 7) << 3) | RDI);
+                u32(rm.disp);
+            }
+        }
+
+        // ModRM for a 16/32-bit operand at [RDI + disp32] (no REX needed)
+        void mem(uint8_t reg_field, int32_t disp)
+        {
+            byte(0x80 | ((reg_field & 7) << 3) | RDI);
+            u32(disp);
+        }
+
+        void push(HostReg reg)
+        {
+            if (reg >= R8)
+            {
+                byte(0x41);
+            }
+            byte(0x50 | (reg & 7));
+        }
+
+        void pop(HostReg reg)
+        {
+            if (reg >= R8)
+            {
+                byte(0x41);
+            }
+            byte(0x58 | (reg & 7));
+        }
+
+        void ret() { byte(0xC3); }
+
+    private:
+        uint8_t* start;
+        uint8_t* cursor;
+    };
+
+    // ALU opcodes in their "op r/m8, r8" form; "op r8, r/m8" is +2
+    enum AluOp : uint8_t
+    {
+        ALU_ADD = 0x00,
+        ALU_OR = 0x08,
+        ALU_AND = 0x20,
+        ALU_SUB = 0x28,
+        ALU_XOR = 0x30,
+        ALU_CMP = 0x38,
+        ALU_MOV = 0x88,
+    };
+
+    // SETcc condition codes (0F 90+cc)
+    enum Condition : uint8_t
+    {
+        CC_C = 0x2,  // Carry / below
+        CC_NC = 0x3, // No carry / above or equal
+        CC_E = 0x4,
+        CC_NE = 0x5,
+    };
+
+    bool is_compilable(Op op)
+    {
+        switch (op)
+        {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_6XNN:
+        case OP_7XNN:
+        case OP_8XY0:
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+        case OP_9XY0:
+        case OP_ANNN:
+        case OP_BNNN:
+        case OP_FX15:
+        case OP_FX18:
+        case OP_FX1E:
+        case OP_FX29:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    bool is_skip(Op op)
+    {
+        return op == OP_3XNN || op == OP_4XNN || op == OP_5XY0 || op == OP_9XY0;
+    }
+
+    // Instructions that transfer control; a block always ends after one
+    bool is_terminator(Op op)
+    {
+        switch (op)
+        {
+        case OP_00EE:
+        case OP_1NNN:
+        case OP_2NNN:
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_5XY0:
+        case OP_9XY0:
+        case OP_BNNN:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    // Guest registers read or written by an instruction, as bitmasks
+    void register_usage(const Instruction& instruction, const Quirks& quirks, uint16_t& used, uint16_t& written)
+    {
+        const uint16_t vx = 1 << instruction.X;
+        const uint16_t vy = 1 << instruction.Y;
+        const uint16_t vf = 1 << 0xF;
+
+        switch (instruction.op)
+        {
+        case OP_3XNN:
+        case OP_4XNN:
+        case OP_FX15:
+        case OP_FX18:
+        case OP_FX29:
+            used |= vx;
+            break;
+        case OP_5XY0:
+        case OP_9XY0:
+            used |= vx | vy;
+            break;
+        case OP_6XNN:
+        case OP_7XNN:
+            used |= vx;
+            written |= vx;
+            break;
+        case OP_8XY0:
+            used |= vx | vy;
+            written |= vx;
+            break;
+        case OP_8XY1:
+        case OP_8XY2:
+        case OP_8XY3:
+            used |= vx | vy;
+            written |= vx;
+            if (quirks.vf_reset)
+            {
+                used |= vf;
+                written |= vf;
+            }
+            break;
+        case OP_8XY4:
+        case OP_8XY5:
+        case OP_8XY6:
+        case OP_8XY7:
+        case OP_8XYE:
+            used |= vx | vy | vf;
+            written |= vx | vf;
+            break;
+        case OP_BNNN:
+            used |= quirks.jump_uses_v0 ? 1 : vx;
+            break;
+        case OP_FX1E:
+            used |= vx;
+            if (quirks.index_overflow)
+            {
+                used |= vf;
+                written |= vf;
+            }
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+#if CHIP8_JIT_SUPPORTED
+
+namespace
+{
+    // Offsets of the Cpu fields the generated code touches directly
+    struct CpuLayout
+    {
+        int32_t registers;
+        int32_t program_counter;
+        int32_t index_register;
+        int32_t stack;
+        int32_t stack_pointer;
+        int32_t delay_timer;
+        int32_t sound_timer;
+    };
+
+    class Translator
+    {
+    public:
+        Translator(Emitter& emitter, const Location (&guest)[NUMBER_OF_REGISTERS], const CpuLayout& cpu_layout, const Quirks& block_quirks) :
+            out{ emitter },
+            V{ guest },
+            layout{ cpu_layout },
+            quirks{ block_quirks }
+        {
+        }
+
+        // Byte ALU operation between two guest registers
+        void alu(AluOp op, const Location& dst, const Location& src)
+        {
+            if (src.in_register)
+            {
+                out.byte_op({ op }, src.reg, dst);
+            }
+            else if (dst.in_register)
+            {
+                out.byte_op({ static_cast<uint8_t>(op + 2) }, dst.reg, src);
+            }
+            else
+            {
+                // No memory-to-memory forms; go through DL
+                out.byte_op({ 0x8A }, RDX, src);
+                out.byte_op({ op }, RDX, dst);
+            }
+        }
+
+        void mov_imm(const Location& dst, uint8_t value)
+        {
+            if (dst.in_register)
+            {
+                out.byte(0x40 | (dst.reg >> 3));
+                out.byte(0xB0 | (dst.reg & 7));
+            }
+            else
+            {
+                out.byte_op({ 0xC6 }, 0, dst);
+            }
+            out.byte(value);
+        }
+
+        // 80 /digit ib
+        void alu_imm(uint8_t digit, const Location& dst, uint8_t value)
+        {
+            out.byte_op({ 0x80 }, digit, dst);
+            out.byte(value);
+        }
+
+        void setcc(Condition condition, const Location& dst)
+        {
+            out.byte_op({ 0x0F, static_cast<uint8_t>(0x90 | condition) }, 0, dst);
+        }
+
+        // 8XY1/8XY2/8XY3 clear VF afterwards on interpreters with that quirk
+        void vf_reset(const Location& flag)
+        {
+            if (quirks.vf_reset)
+            {
+                mov_imm(flag, 0);
+            }
+        }
+
+        // movzx eax, V
+        void load_eax(const Location& src)
+        {
+            out.byte_op({ 0x0F, 0xB6 }, RAX, src);
+        }
+
+        // Sets EAX to next_address, or next_address + 2 if the condition holds
+        // (flags must already be set by a compare)
+        void skip_if(Condition condition, uint16_t next_address)
+        {
+            // setcc al; movzx eax, al; lea eax, [rax*2 + next_address]
+            out.byte(0x0F);
+            out.byte(0x90 | condition);
+            out.byte(0xC0);
+            out.byte(0x0F);
+            out.byte(0xB6);
+            out.byte(0xC0);
+            out.byte(0x8D);
+            out.byte(0x04);
+            out.byte(0x45);
+            out.u32(next_address);
+        }
+
+        // Emits one instruction. Terminators leave the new program counter in
+        // EAX; everything else falls through
+        void translate(const Instruction& instruction, uint16_t next_address)
+        {
+            const Location& VX = V[instruction.X];
+            const Location& VY = V[instruction.Y];
+            const Location& VF = V[0xF];
+
+            switch (instruction.op)
+            {
+            case OP_00EE:
+                // dec byte [sp]; movzx eax, byte [sp]; movzx eax, word [stack + rax*2]
+                out.byte(0xFE);
+                out.mem(1, layout.stack_pointer);
+                out.byte(0x0F);
+                out.byte(0xB6);
+                out.mem(RAX, layout.stack_pointer);
+                out.byte(0x0F);
+                out.byte(0xB7);
+                out.byte(0x84);
+                out.byte(0x47);
+                out.u32(layout.stack);
+                break;
+            case OP_1NNN:
+                // mov eax, NNN
+                out.byte(0xB8);
+                out.u32(instruction.NNN);
+                break;
+            case OP_2NNN:
+                // movzx eax, byte [sp]; mov word [stack + rax*2], next; inc byte [sp]
+                out.byte(0x0F);
+                out.byte(0xB6);
+                out.mem(RAX, layout.stack_pointer);
+                out.byte(0x66);
+                out.byte(0xC7);
+                out.byte(0x84);
+                out.byte(0x47);
+                out.u32(layout.stack);
+                out.u16(next_address);
+                out.byte(0xFE);
+                out.mem(0, layout.stack_pointer);
+                out.byte(0xB8);
+                out.u32(instruction.NNN);
+                break;
+            case OP_3XNN:
+                alu_imm(7, VX, instruction.NN);
+                skip_if(CC_E, next_address);
+                break;
+            case OP_4XNN:
+                alu_imm(7, VX, instruction.NN);
+                skip_if(CC_NE, next_address);
+                break;
+            case OP_5XY0:
+                alu(ALU_CMP, VX, VY);
+                skip_if(CC_E, next_address);
+                break;
+            case OP_9XY0:
+                alu(ALU_CMP, VX, VY);
+                skip_if(CC_NE, next_address);
+                break;
+            case OP_6XNN:
+                mov_imm(VX, instruction.NN);
+                break;
+            case OP_7XNN:
+                alu_imm(0, VX, instruction.NN);
+                break;
+            case OP_8XY0:
+                alu(ALU_MOV, VX, VY);
+                break;
+            case OP_8XY1:
+                alu(ALU_OR, VX, VY);
+                vf_reset(VF);
+                break;
+            case OP_8XY2:
+                alu(ALU_AND, VX, VY);
+                vf_reset(VF);
+                break;
+            case OP_8XY3:
+                alu(ALU_XOR, VX, VY);
+                vf_reset(VF);
+                break;
+            case OP_8XY4:
+                // VF = carry out of VX + VY
+                alu(ALU_ADD, VX, VY);
+                setcc(CC_C, VF);
+                break;
+            case OP_8XY5:
+                // VF = 1 unless VX - VY borrows
+                alu(ALU_SUB, VX, VY);
+                setcc(CC_NC, VF);
+                break;
+            case OP_8XY7:
+                // al = VY - VX; cl = no borrow; VX = al; VF = cl
+                out.byte_op({ 0x8A }, RAX, VY);
+                out.byte_op({ 0x2A }, RAX, VX);
+                out.byte_op({ 0x0F, 0x93 }, 0, { true, RCX, 0 });
+                out.byte_op({ 0x88 }, RAX, VX);
+                out.byte_op({ 0x88 }, RCX, VF);
+                break;
+            case OP_8XY6:
+                if (quirks.shift_uses_vy)
+                {
+                    alu(ALU_MOV, VX, VY);
+                }
+                // shr VX, 1 shifts the lost bit into CF
+                out.byte_op({ 0xD0 }, 5, VX);
+                setcc(CC_C, VF);
+                break;
+            case OP_8XYE:
+                if (quirks.shift_uses_vy)
+                {
+                    alu(ALU_MOV, VX, VY);
+                }
+                out.byte_op({ 0xD0 }, 4, VX);
+                setcc(CC_C, VF);
+                break;
+            case OP_ANNN:
+                // mov word [I], NNN
+                out.byte(0x66);
+                out.byte(0xC7);
+                out.mem(0, layout.index_register);
+                out.u16(instruction.NNN);
+                break;
+            case OP_BNNN:
+                load_eax(quirks.jump_uses_v0 ? V[0x0] : VX);
+                out.byte(0x05);
+                out.u32(instruction.NNN);
+                break;
+            case OP_FX15:
+                out.byte_op({ 0x0F, 0xB6 }, RAX, VX);
+                out.byte(0x88);
+                out.mem(RAX, layout.delay_timer);
+                break;
+            case OP_FX18:
+                out.byte_op({ 0x0F, 0xB6 }, RAX, VX);
+                out.byte(0x88);
+                out.mem(RAX, layout.sound_timer);
+                break;
+            case OP_FX1E:
+            {
+                // add word [I], ax; cmp word [I], 0x0FFF; jbe skip; mov VF, 1
+                load_eax(VX);
+                out.byte(0x66);
+                out.byte(0x01);
+                out.mem(RAX, layout.index_register);
+                if (!quirks.index_overflow)
+                {
+                    break;
+                }
+                out.byte(0x66);
+                out.byte(0x81);
+                out.mem(7, layout.index_register);
+                out.u16(0x0FFF);
+                out.byte(0x76);
+                uint8_t* jump = out.position();
+                out.byte(0);
+                mov_imm(VF, 1);
+                *jump = static_cast<uint8_t>(out.position() - jump - 1);
+                break;
+            }
+            case OP_FX29:
+                // lea eax, [rax + rax*4 + FONT_SET_START_ADDRESS]; mov word [I], ax
+                load_eax(VX);
+                out.byte(0x8D);
+                out.byte(0x84);
+                out.byte(0x80);
+                out.u32(FONT_SET_START_ADDRESS);
+                out.byte(0x66);
+                out.byte(0x89);
+                out.mem(RAX, layout.index_register);
+                break;
+            default:
+                break;
+            }
+        }
+
+    private:
+        Emitter& out;
+        const Location (&V)[NUMBER_OF_REGISTERS];
+        const CpuLayout& layout;
+        const Quirks& quirks;
+    };
+}
+
+#endif
+
+Jit::Jit() :
+    blocks(CLASSIC_MEMORY_SIZE),
+    compiled_chunks{ 0 },
+    quirks{ DEFAULT_QUIRK_PROFILE },
+    code_buffer{ nullptr },
+    code_capacity{ 0 },
+    code_used{ 0 }
+{
+#if CHIP8_JIT_SUPPORTED
+    void* buffer = mmap(nullptr, CODE_BUFFER_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (buffer != MAP_FAILED)
+    {
+        code_buffer = static_cast<uint8_t*>(buffer);
+        code_capacity = CODE_BUFFER_SIZE;
+    }
+#endif
+}
+
+Jit::~Jit()
+{
+#if CHIP8_JIT_SUPPORTED
+    if (code_buffer)
+    {
+        munmap(code_buffer, code_capacity);
+    }
+#endif
+}
+
+bool Jit::is_available() const
+{
+    return code_buffer != nullptr;
+}
+
+void Jit::flush()
+{
+    for (auto& block : blocks)
+    {
+        block = Block{};
+    }
+
+    compiled_chunks = 0;
+    code_used = 0;
+}
+
+void Jit::invalidate(uint64_t chunks)
+{
+    if ((chunks & compiled_chunks) == 0)
+    {
+        return;
+    }
+
+    compiled_chunks = 0;
+
+    for (auto& block : blocks)
+    {
+        if (block.chunks & chunks)
+        {
+            // Dead code stays in the buffer until the next flush
+            block = Block{};
+        }
+        compiled_chunks |= block.chunks;
+    }
+}
+
+const Jit::Block& Jit::compile(uint16_t address, Memory& memory)
+{
+    Block& block = blocks[address];
+    block = Block{};
+    block.compiled = true;
+
+#if CHIP8_JIT_SUPPORTED
+    // Scan the block: straight-line compilable instructions, ending after a
+    // control transfer or before the first instruction we can't translate
+    Instruction instructions[MAX_BLOCK_LENGTH];
+    int length = 0;
+    uint16_t used = 0;
+    uint16_t written = 0;
+    uint16_t pc = address;
+
+    const Quirks& rules = QUIRK_PROFILES[quirks];
+
+    while (length < MAX_BLOCK_LENGTH && pc < CLASSIC_MEMORY_SIZE - 1)
+    {
+        const Instruction instruction = memory.fetch(pc);
+
+        if (!is_compilable(instruction.op))
+        {
+            break;
+        }
+
+        // With long skips, a skip over F000 NNNN moves 4 bytes; rare enough
+        // to leave to the interpreter
+        if (rules.long_skips && is_skip(instruction.op) && memory.fetch(pc + 2).opcode == 0xF000)
+        {
+            break;
+        }
+
+        instructions[length++] = instruction;
+        register_usage(instruction, rules, used, written);
+        pc += 2;
+
+        if (is_terminator(instruction.op))
+        {
+            break;
+        }
+    }
+
+    if (length == 0)
+    {
+        return block;
+    }
+
+    if (code_capacity - code_used < MAX_BLOCK_OVERHEAD + length * MAX_BYTES_PER_INSTRUCTION)
+    {
+        flush();
+        block.compiled = true;
+    }
+
+    const CpuLayout layout{
+        static_cast<int32_t>(offsetof(Cpu, registers)),
+        static_cast<int32_t>(offsetof(Cpu, program_counter)),
+        static_cast<int32_t>(offsetof(Cpu, index_register)),
+        static_cast<int32_t>(offsetof(Cpu, stack)),
+        static_cast<int32_t>(offsetof(Cpu, stack_pointer)),
+        static_cast<int32_t>(offsetof(Cpu, delay_timer)),
+        static_cast<int32_t>(offsetof(Cpu, sound_timer)),
+    };
+
+    // Give every guest register the block uses a host register, as long as
+    // there are enough of them; the rest are accessed in place in the Cpu
+    Location guest[NUMBER_OF_REGISTERS];
+    std::vector<HostReg> saved;
+    size_t next_host = 0;
+
+    for (unsigned int v = 0; v < NUMBER_OF_REGISTERS; ++v)
+    {
+        guest[v] = { false, RAX, static_cast<int32_t>(layout.registers + v) };
+
+        if ((used & (1 << v)) && next_host < sizeof(ALLOCATABLE) / sizeof(ALLOCATABLE[0]))
+        {
+            guest[v].in_register = true;
+            guest[v].reg = ALLOCATABLE[next_host++];
+
+            if (is_callee_saved(guest[v].reg))
+            {
+                saved.push_back(guest[v].reg);
+            }
+        }
+    }
+
+    uint8_t* const entry = code_buffer + code_used;
+    Emitter out{ entry };
+    Translator translator{ out, guest, layout, rules };
+
+    // Prologue: save callee-saved registers we use and load guest registers
+    for (const HostReg reg : saved)
+    {
+        out.push(reg);
+    }
+
+    for (unsigned int v = 0; v < NUMBER_OF_REGISTERS; ++v)
+    {
+        if (guest[v].in_register)
+        {
+            out.byte_op({ 0x8A }, guest[v].reg, { false, RAX, static_cast<int32_t>(layout.registers + v) });
+        }
+    }
+
+    uint16_t next_address = address;
+
+    for (int i = 0; i < length; ++i)
+    {
+        next_address += 2;
+        translator.translate(instructions[i], next_address);
+    }
+
+    // Blocks that don't end in a control transfer fall through
+    if (!is_terminator(instructions[length - 1].op))
+    {
+        out.byte(0xB8);
+        out.u32(next_address);
+    }
+
+    // Epilogue: write back the new PC and modified guest registers
+    out.byte(0x66);
+    out.byte(0x89);
+    out.mem(RAX, layout.program_counter);
+
+    for (unsigned int v = 0; v < NUMBER_OF_REGISTERS; ++v)
+    {
+        if (guest[v].in_register && (written & (1 << v)))
+        {
+            out.byte_op({ 0x88 }, guest[v].reg, { false, RAX, static_cast<int32_t>(layout.registers + v) });
+        }
+    }
+
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+    {
+        out.pop(*it);
+    }
+
+    out.ret();
+
+    code_used += out.size();
+
+    // Mark every chunk the block's bytes fall in; with long skips, a final
+    // skip also depends on the instruction after it not becoming F000
+    uint16_t last_byte = address + length * 2 - 1;
+    if (rules.long_skips && is_skip(instructions[length - 1].op))
+    {
+        last_byte = std::min<unsigned int>(last_byte + 2, CLASSIC_MEMORY_SIZE - 1);
+    }
+
+    for (unsigned int chunk = address / MEMORY_CHUNK_SIZE; chunk <= last_byte / MEMORY_CHUNK_SIZE; ++chunk)
+    {
+        block.chunks |= uint64_t{ 1 } << chunk;
+    }
+
+    block.code = reinterpret_cast<BlockFn>(entry);
+    block.length = length;
+    compiled_chunks |= block.chunks;
+#endif
+
+    return block;
+}
+
+void Jit::run(Cpu& cpu, Memory& memory, Display& display, Keypad& keypad, uint64_t cycles)
+{
+    if (!is_available())
+    {
+        cpu.run(memory, display, keypad, cycles);
+        return;
+    }
+
+    if (cpu.quirks != quirks)
+    {
+        flush();
+        quirks = cpu.quirks;
+    }
+
+    // Memory may have changed since the last run (e.g. a new ROM)
+    invalidate(memory.take_written_chunks());
+
+    while (cycles > 0)
+    {
+        const uint16_t address = cpu.program_counter;
+
+        // Only the classic 4 KB is compiled; XO-CHIP code above it is
+        // interpreted
+        if (address >= CLASSIC_MEMORY_SIZE - 1)
+        {
+            cpu.tick(memory, display, keypad);
+            --cycles;
+            continue;
+        }
+
+        const Block* block = &blocks[address];
+
+        if (!block->compiled)
+        {
+            block = &compile(address, memory);
+        }
+
+        if (block->length > 0 && block->length <= cycles)
+        {
+            block->code(&cpu);
+            cycles -= block->length;
+        }
+        else
+        {
+            // Interpret one instruction; this is the only place memory can
+            // be written, so check whether it hit compiled code
+            cpu.tick(memory, display, keypad);
+            --cycles;
+
+            invalidate(memory.take_written_chunks());
+        }
+    }
+}
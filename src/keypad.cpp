@@ -1,46 +1,56 @@
 #include <cstdint>
-#include <map>
 
 #include "keypad.h"
 
 Keypad::Keypad() :
-    pressed{}
+    pressed{ 0 },
+    pressed_this_loop{ 0 },
+    released_this_loop{ 0 }
 {
 }
 
 void Keypad::keydown(uint8_t key)
 {
-    pressed[key] = true;
-    pressed_this_loop[key] = true;
+    const uint16_t bit = 1 << (key & 0xF);
+    pressed |= bit;
+    pressed_this_loop |= bit;
 }
 
 void Keypad::keyup(uint8_t key)
 {
-    pressed[key] = false;
-    released_this_loop[key] = true;
+    const uint16_t bit = 1 << (key & 0xF);
+    pressed &= ~bit;
+    released_this_loop |= bit;
 }
 
 void Keypad::clear_key_events()
 {
-    for (int i = 0; i < 16; ++i)
-    {
-        pressed_this_loop[i] = false;
-        released_this_loop[i] = false;
-    }
+    pressed_this_loop = 0;
+    released_this_loop = 0;
 }
 
-bool Keypad::is_pressed(uint8_t key)
+int8_t Keypad::first_pressed_this_loop() const
 {
-    // Zero-initializes if does not exist
-    return pressed[key];
+    for (int8_t key = 0; key < 16; ++key)
+    {
+        if ((pressed_this_loop >> key) & 1)
+        {
+            return key;
+        }
+    }
+    return -1;
 }
 
-bool Keypad::is_pressed_this_loop(uint8_t key)
+void Keypad::save_state(SaveState& state) const
 {
-    return pressed_this_loop[key];
+    state.keys_pressed = pressed;
+    state.keys_pressed_this_loop = pressed_this_loop;
+    state.keys_released_this_loop = released_this_loop;
 }
 
-bool Keypad::is_released_this_loop(uint8_t key)
+void Keypad::load_state(const SaveState& state)
 {
-    return released_this_loop[key];
+    pressed = state.keys_pressed;
+    pressed_this_loop = state.keys_pressed_this_loop;
+    released_this_loop = state.keys_released_this_loop;
 }
@@ -1,105 +1,479 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+
 #include <SDL3/SDL.h>
 
 #include "chip8.h"
-#include "utils.h"
 #include "constants.h"
+#include "emulation_thread.h"
+#include "keymap.h"
+#include "presenter.h"
 
-bool poll_input();
+bool wait_input();
+void wake_ui();
+bool handle_event(const SDL_Event& event);
+FrameScheduler::Clock::time_point event_time(const SDL_Event& event);
 bool init_sdl();
 void quit_sdl();
+bool parse_palette(const char* text, std::array<uint32_t, 1 << DISPLAY_PLANES>& palette);
+void upload_image(const PresentedImage& image);
+void present();
 
 SDL_Window* g_window{ nullptr };
 SDL_Renderer* g_renderer{ nullptr };
+
+// Holds the present stage's latest image at its full size; remade when
+// that size changes (window resized, resolution switched). Only the bands
+// that changed since the image it holds (g_texture_sequence) are uploaded
 SDL_Texture* g_texture{ nullptr };
+unsigned int g_texture_width{ 0 };
+unsigned int g_texture_height{ 0 };
+uint64_t g_texture_sequence{ 0 };
+
+// Set when the window contents need redrawing even if the image didn't
+// change (window exposed/resized)
+bool g_force_present{ false };
+
+// The UI thread sleeps in SDL_WaitEvent; the emulation thread and presenter
+// wake it with this event type when they have a frame or image ready. Only
+// one is queued at a time (turbo publishes thousands of frames a second)
+Uint32 g_wake_event{ 0 };
+std::atomic<bool> g_wake_pending{ false };
 
 Chip8 chip8;
 
-int main()
+// Owns the core while running; the UI thread only talks to it through
+// lock-free queues
+EmulationThread* g_emulation{ nullptr };
+
+// Blends, colors and scales frames on its own thread (see presenter.h)
+Presenter* g_presenter{ nullptr };
+
+// Turbo setting from the command line; Tab overrides it while held
+bool g_turbo{ false };
+
+int main(int argc, char* argv[])
 {
+    // --seed N makes CXNN deterministic; --record FILE writes every key event
+    // and timer tick to an input log that chip8_headless --replay can re-run;
+    // --turbo runs unthrottled (holding Tab does the same); --profile FILE
+    // writes the probe's JSON report at exit (CHIP8_INSTRUMENT builds);
+    // --quirks vip|chip48|schip|xochip picks the interpreter behavior to follow;
+    // --trace FILE records every executed instruction for chip8_trace;
+    // --phosphor DECAY sets how much of its brightness a pixel keeps per
+    // frame after going off (0 for none); --palette RRGGBB,... sets the
+    // colors of off, plane 1, plane 2 and both planes' pixels; --capture FILE
+    // records every frame as video (.avi, .y4m or raw RGB24), at
+    // --capture-scale N times 128x64
+    std::string record_file;
+    std::string profile_file;
+    std::string trace_file;
+    std::string capture_file;
+    unsigned int capture_scale = FrameCapture::DEFAULT_SCALE;
+    bool seeded = false;
+    uint64_t seed = 0;
+    QuirkProfile quirks = DEFAULT_QUIRK_PROFILE;
+    double phosphor_decay = PHOSPHOR_DECAY;
+    std::array<uint32_t, 1 << DISPLAY_PLANES> palette;
+    std::copy(std::begin(PIXEL_PALETTE), std::end(PIXEL_PALETTE), palette.begin());
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 0);
+            seeded = true;
+        }
+        else if (std::strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+        {
+            record_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profile_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            capture_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc)
+        {
+            capture_scale = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+        {
+            if (!parse_quirk_profile(argv[++i], quirks))
+            {
+                SDL_Log("Unknown quirk profile %s\n", argv[i]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--phosphor") == 0 && i + 1 < argc)
+        {
+            phosphor_decay = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--palette") == 0 && i + 1 < argc)
+        {
+            if (!parse_palette(argv[++i], palette))
+            {
+                SDL_Log("Bad palette %s; expected up to 4 RRGGBB colors\n", argv[i]);
+            }
+        }
+        else if (std::strcmp(argv[i], "--turbo") == 0)
+        {
+            g_turbo = true;
+        }
+    }
+
     init_sdl();
 
+    g_wake_event = SDL_RegisterEvents(1);
+
+    Presenter presenter;
+    presenter.set_phosphor_decay(phosphor_decay);
+    presenter.set_palette(palette);
+    presenter.set_image_callback(wake_ui);
+
+    int window_width = 0;
+    int window_height = 0;
+    SDL_GetWindowSizeInPixels(g_window, &window_width, &window_height);
+    presenter.set_output_size(window_width, window_height);
+
+    g_presenter = &presenter;
+    presenter.start();
+
     chip8 = Chip8();
+    chip8.set_quirks(quirks);
     chip8.load_rom("roms/Pong 2 (Pong hack) [David Winter, 1997].ch8");
 
-    bool running = true;
+    if (seeded)
+    {
+        chip8.seed(seed);
+    }
 
-    double prev_cycle_time, prev_frame_time, prev_timer_time;
-    prev_cycle_time = prev_frame_time = prev_timer_time = get_time_in_ms();
+    InputLog log;
+    if (!record_file.empty())
+    {
+        chip8.start_recording(log);
+    }
+
+    // The ring buffer is a few megabytes; only made when tracing
+    std::unique_ptr<Tracer> tracer;
+    if (!trace_file.empty())
+    {
+        tracer = std::make_unique<Tracer>();
+        if (tracer->open(trace_file))
+        {
+            chip8.start_tracing(*tracer);
+        }
+        else
+        {
+            SDL_Log("Failed to open trace file %s\n", trace_file.c_str());
+        }
+    }
+
+    // Frames are captured on the emulation thread at every timer tick; the
+    // encoding and file writes happen on the capture's own thread
+    FrameCapture capture;
+    if (!capture_file.empty())
+    {
+        if (capture.open(capture_file, capture_scale))
+        {
+            chip8.start_capture(capture);
+        }
+        else
+        {
+            SDL_Log("Failed to open capture file %s\n", capture_file.c_str());
+        }
+    }
+
+    // The core runs on its own thread at DISPLAY_HZ frames (each a whole
+    // CPU_HZ / DISPLAY_HZ cycle batch); this thread only forwards input and
+    // presents whatever frame is newest, so a slow present or vsync wait
+    // never delays emulation. Blending and scaling happen on the presenter's
+    // thread, so this one only uploads and draws finished images
+    EmulationThread emulation(chip8);
+    emulation.set_turbo(g_turbo);
+    emulation.set_frame_callback(wake_ui);
+    g_emulation = &emulation;
+    emulation.start();
+
+    bool running = true;
 
     while (running)
     {
-        if (!poll_input())
+        if (!wait_input())
         {
             running = false;
             continue;
         }
 
-        const double now = get_time_in_ms();
-
-        if (now - prev_cycle_time >= CYCLE_DURATION_MS)
+        if (emulation.update_frame())
         {
-            chip8.cycle_cpu();
-            chip8.clear_key_events();
-            prev_cycle_time += CYCLE_DURATION_MS;
+            presenter.submit(emulation.get_frame().display);
         }
 
-        if (now - prev_timer_time >= TIMER_DURATION_MS)
+        if (presenter.update_image())
         {
-            chip8.decrement_timers();
-            prev_timer_time += TIMER_DURATION_MS;
+            upload_image(presenter.get_image());
+            g_force_present = true;
         }
 
-        if (now - prev_frame_time >= FRAME_DURATION_MS)
+        if (g_force_present)
         {
-            const uint32_t* pixels = chip8.get_display_buffer();
+            present();
+            g_force_present = false;
+        }
+    }
+
+    // The core is back in this thread's hands once the emulation thread stops
+    emulation.stop();
+    g_emulation = nullptr;
+
+    presenter.stop();
+    g_presenter = nullptr;
+
+    if (tracer && tracer->is_open())
+    {
+        chip8.stop_tracing();
+        tracer->close();
+    }
+
+    if (capture.is_open())
+    {
+        chip8.stop_capture();
+        capture.close();
+        SDL_Log("Captured %llu frames (%llu repeats, %llu dropped)\n",
+            static_cast<unsigned long long>(capture.get_frame_count()),
+            static_cast<unsigned long long>(capture.get_repeat_count()),
+            static_cast<unsigned long long>(capture.get_dropped_count()));
+    }
 
-            SDL_RenderClear(g_renderer);
-            SDL_UpdateTexture(g_texture, NULL, pixels, DISPLAY_WIDTH * sizeof(uint32_t));
-            SDL_RenderTexture(g_renderer, g_texture, NULL, NULL);
-            SDL_RenderPresent(g_renderer);
+    if (!record_file.empty())
+    {
+        chip8.stop_recording();
+        if (!log.save(record_file))
+        {
+            SDL_Log("Failed to write input log %s\n", record_file.c_str());
+        }
+    }
 
-            prev_frame_time += FRAME_DURATION_MS;
+    if (!profile_file.empty())
+    {
+        std::ofstream out(profile_file);
+        if (out.is_open())
+        {
+            chip8.get_probe().write_json(out);
+        }
+        else
+        {
+            SDL_Log("Failed to write profile %s\n", profile_file.c_str());
         }
     }
 
     quit_sdl();
 }
 
-bool poll_input()
+// "RRGGBB,RRGGBB,..." in palette order; colors not given keep their value
+bool parse_palette(const char* text, std::array<uint32_t, 1 << DISPLAY_PLANES>& palette)
+{
+    for (uint32_t& color : palette)
+    {
+        char* end = nullptr;
+        const unsigned long rgb = std::strtoul(text, &end, 16);
+        if (end - text != 6)
+        {
+            return false;
+        }
+
+        // RGBA bytes in memory, opaque
+        color = 0xFF000000 | (rgb & 0xFF) << 16 | (rgb & 0xFF00) | (rgb >> 16 & 0xFF);
+
+        if (*end != ',')
+        {
+            return *end == '\0';
+        }
+        text = end + 1;
+    }
+
+    return false;
+}
+
+void upload_image(const PresentedImage& image)
+{
+    if (!g_texture || image.width != g_texture_width || image.height != g_texture_height)
+    {
+        SDL_DestroyTexture(g_texture);
+        g_texture = SDL_CreateTexture(g_renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, image.width, image.height);
+        SDL_SetTextureScaleMode(g_texture, SDL_SCALEMODE_NEAREST);
+        g_texture_width = image.width;
+        g_texture_height = image.height;
+        g_texture_sequence = 0;
+    }
+
+    // One update per run of changed display rows, each a band scale image
+    // rows high; a moving sprite or two is a small fraction of the image
+    const uint64_t rows = image.rows_changed_since(g_texture_sequence);
+    const unsigned int display_rows = image.height / image.scale;
+    const size_t band_pixels = size_t{ image.width } * image.scale;
+
+    for (unsigned int y = 0; y < display_rows;)
+    {
+        if (!((rows >> y) & 1))
+        {
+            ++y;
+            continue;
+        }
+
+        unsigned int end = y + 1;
+        while (end < display_rows && ((rows >> end) & 1))
+        {
+            ++end;
+        }
+
+        const SDL_Rect band{ 0, static_cast<int>(y * image.scale), static_cast<int>(image.width),
+            static_cast<int>((end - y) * image.scale) };
+        SDL_UpdateTexture(g_texture, &band, image.pixels.data() + y * band_pixels, image.width * sizeof(uint32_t));
+        y = end;
+    }
+
+    g_texture_sequence = image.sequence;
+}
+
+// Draw the image 1:1, centered; it's already scaled to fit the window
+void present()
+{
+    if (!g_texture)
+    {
+        return;
+    }
+
+    int width = 0;
+    int height = 0;
+    SDL_GetCurrentRenderOutputSize(g_renderer, &width, &height);
+
+    const SDL_FRect destination{
+        static_cast<float>((width - static_cast<int>(g_texture_width)) / 2),
+        static_cast<float>((height - static_cast<int>(g_texture_height)) / 2),
+        static_cast<float>(g_texture_width),
+        static_cast<float>(g_texture_height)
+    };
+
+    SDL_RenderClear(g_renderer);
+    SDL_RenderTexture(g_renderer, g_texture, NULL, &destination);
+    SDL_RenderPresent(g_renderer);
+}
+
+// Sleep until the first event (input, or a wakeup from wake_ui()), then
+// drain whatever else is queued; returns false once the user asked to quit
+bool wait_input()
 {
     SDL_Event event;
 
-    if (SDL_PollEvent(&event))
+    if (!SDL_WaitEvent(&event))
     {
-        if (event.type == SDL_EVENT_QUIT)
+        return true;
+    }
+
+    do
+    {
+        if (!handle_event(event))
         {
             return false;
         }
-        else if (event.type == SDL_EVENT_KEY_DOWN)
+    } while (SDL_PollEvent(&event));
+
+    return true;
+}
+
+// When an event happened, on the emulation thread's clock. SDL stamps events
+// with its own nanosecond tick count as they arrive from the OS, which can be
+// well before poll_input() gets to them when several are queued
+FrameScheduler::Clock::time_point event_time(const SDL_Event& event)
+{
+    const Uint64 ticks = SDL_GetTicksNS();
+    const Uint64 age = ticks > event.common.timestamp ? ticks - event.common.timestamp : 0;
+    return FrameScheduler::Clock::now() - std::chrono::nanoseconds(age);
+}
+
+// Any thread: get the UI thread to look for a new frame or image
+void wake_ui()
+{
+    if (g_wake_pending.exchange(true))
+    {
+        return;
+    }
+
+    SDL_Event event{};
+    event.type = g_wake_event;
+    if (!SDL_PushEvent(&event))
+    {
+        g_wake_pending = false;
+    }
+}
+
+bool handle_event(const SDL_Event& event)
+{
+    if (event.type == SDL_EVENT_QUIT)
+    {
+        return false;
+    }
+    else if (event.type == g_wake_event)
+    {
+        // Cleared before the main loop looks, so a frame published after
+        // that queues another wakeup
+        g_wake_pending = false;
+    }
+    else if (event.type == SDL_EVENT_WINDOW_EXPOSED)
+    {
+        // Window contents were lost; redraw even if the display is unchanged
+        g_force_present = true;
+    }
+    else if (event.type == SDL_EVENT_WINDOW_PIXEL_SIZE_CHANGED)
+    {
+        // The presenter rescales to the new size and hands back a new image
+        g_presenter->set_output_size(event.window.data1, event.window.data2);
+        g_force_present = true;
+    }
+    else if (event.type == SDL_EVENT_KEY_DOWN)
+    {
+        if (event.key.scancode == SDL_SCANCODE_TAB)
         {
-            // Have to do it this way because map::operator[] has no const overload
-            // Use map::find to get an iterator that returns the k-v pair
-            auto it = KEYMAP.find(event.key.scancode);
+            g_emulation->set_turbo(true);
+        }
 
-            // Check that the key was found in map
-            if (it != KEYMAP.end())
-            {
-                // Get second item (value) from k-v pair
-                chip8.keydown(it->second);
-            }
+        const uint8_t key = map_scancode(event.key.scancode);
+        if (key != UNMAPPED_KEY)
+        {
+            g_emulation->keydown(key, event_time(event));
+        }
+    }
+    else if (event.type == SDL_EVENT_KEY_UP)
+    {
+        if (event.key.key == SDLK_ESCAPE)
+        {
+            return false;
         }
-        else if (event.type == SDL_EVENT_KEY_UP)
+
+        if (event.key.scancode == SDL_SCANCODE_TAB)
         {
-            if (event.key.key == SDLK_ESCAPE)
-            {
-                return false;
-            }
+            g_emulation->set_turbo(g_turbo);
+        }
 
-            auto it = KEYMAP.find(event.key.scancode);
-            if (it != KEYMAP.end())
-            {
-                chip8.keyup(it->second);
-            }
+        const uint8_t key = map_scancode(event.key.scancode);
+        if (key != UNMAPPED_KEY)
+        {
+            g_emulation->keyup(key, event_time(event));
         }
     }
 
@@ -114,14 +488,14 @@ bool init_sdl()
         return false;
     }
 
-    g_window = SDL_CreateWindow("CHIP-8", DISPLAY_WIDTH * DISPLAY_SCALE, DISPLAY_HEIGHT * DISPLAY_SCALE, 0);
+    // Resizable, at the display's full pixel resolution; the presenter
+    // scales frames to whatever size the window ends up
+    g_window = SDL_CreateWindow("CHIP-8", DISPLAY_WIDTH * DISPLAY_SCALE, DISPLAY_HEIGHT * DISPLAY_SCALE, SDL_WINDOW_RESIZABLE | SDL_WINDOW_HIGH_PIXEL_DENSITY);
     g_renderer = SDL_CreateRenderer(g_window, NULL);
-    g_texture = SDL_CreateTexture(g_renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, DISPLAY_WIDTH, DISPLAY_HEIGHT);
-    SDL_SetTextureScaleMode(g_texture, SDL_SCALEMODE_NEAREST);
 
-    if (!g_window || !g_renderer || !g_texture)
+    if (!g_window || !g_renderer)
     {
-        SDL_Log("Window/renderer/texture not initialized. SDL error: %s\n", SDL_GetError());
+        SDL_Log("Window/renderer not initialized. SDL error: %s\n", SDL_GetError());
         return false;
     }
 
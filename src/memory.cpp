@@ -1,13 +1,270 @@
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 #include "memory.h"
+#include "decoder.h"
 
-uint8_t Memory::read(uint16_t address)
+namespace
 {
-    return data[address];
+    // All-zero page every new Memory starts out sharing. It's never freed
+    // and never counted, so the many Memory objects pointing most of their
+    // page table at it don't all contend on one reference count. A function
+    // static, since Memory objects can be constructed during static init
+    MemoryPage* zero_page()
+    {
+        static MemoryPage* const page = []()
+        {
+            MemoryPage* blank = new MemoryPage;
+            std::memset(blank->data, 0, sizeof(blank->data));
+
+            const Instruction instruction = decode(0x0000);
+            for (auto& entry : blank->decoded)
+            {
+                entry = instruction;
+            }
+
+            // Never drops to 1, so make_private always copies it
+            blank->references = 2;
+            return blank;
+        }();
+
+        return page;
+    }
+
+    MemoryPage* acquire(MemoryPage* page)
+    {
+        if (page != zero_page())
+        {
+            page->references.fetch_add(1, std::memory_order_relaxed);
+        }
+        return page;
+    }
+
+    void release(MemoryPage* page)
+    {
+        if (page != zero_page() && page->references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            delete page;
+        }
+    }
+
+    bool is_zero(const uint8_t* bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; ++i)
+        {
+            if (bytes[i] != 0)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Chunks of the JIT-visible range covered by [first, last]
+    uint64_t chunk_range(unsigned int first, unsigned int last)
+    {
+        if (first >= CLASSIC_MEMORY_SIZE)
+        {
+            return 0;
+        }
+
+        last = std::min(last, CLASSIC_MEMORY_SIZE - 1);
+
+        uint64_t chunks = 0;
+        for (unsigned int chunk = first / MEMORY_CHUNK_SIZE; chunk <= last / MEMORY_CHUNK_SIZE; ++chunk)
+        {
+            chunks |= uint64_t{ 1 } << chunk;
+        }
+        return chunks;
+    }
+
+    void decode_entry(MemoryPage* page, unsigned int offset)
+    {
+        const unsigned int entry = offset & ~1u;
+        page->decoded[entry >> 1] = decode(page->data[entry] << 8 | page->data[entry + 1]);
+    }
+}
+
+Memory::Memory() :
+    private_pages{},
+    written_chunks{ 0 },
+    address_mask{ MEMORY_SIZE - 1 }
+{
+    for (auto& page : pages)
+    {
+        page = zero_page();
+    }
+}
+
+Memory::~Memory()
+{
+    release_pages();
+}
+
+Memory::Memory(const Memory& other) :
+    private_pages{},
+    written_chunks{ ~uint64_t{ 0 } },
+    address_mask{ other.address_mask }
+{
+    share_pages(other);
+}
+
+Memory& Memory::operator=(const Memory& other)
+{
+    if (this != &other)
+    {
+        release_pages();
+        share_pages(other);
+        std::memset(private_pages, 0, sizeof(private_pages));
+        address_mask = other.address_mask;
+
+        // Every byte may have changed as far as the JIT is concerned
+        written_chunks = ~uint64_t{ 0 };
+    }
+
+    return *this;
+}
+
+void Memory::share_pages(const Memory& other)
+{
+    for (unsigned int index = 0; index < MEMORY_PAGE_COUNT; ++index)
+    {
+        pages[index] = acquire(other.pages[index]);
+    }
+
+    // Both sides now share everything. Only written when needed, so sharing
+    // from a fully shared Memory (e.g. a RomStore image) from several
+    // threads at once is safe
+    for (uint64_t& bits : other.private_pages)
+    {
+        if (bits != 0)
+        {
+            bits = 0;
+        }
+    }
+}
+
+void Memory::release_pages()
+{
+    for (auto& page : pages)
+    {
+        release(page);
+        page = nullptr;
+    }
+}
+
+MemoryPage* Memory::make_private(unsigned int index)
+{
+    MemoryPage* page = pages[index];
+
+    // Nobody else holds it any more; no need to copy
+    if (page->references.load(std::memory_order_acquire) == 1)
+    {
+        private_pages[index / 64] |= uint64_t{ 1 } << (index % 64);
+        return page;
+    }
+
+    MemoryPage* copy = new MemoryPage;
+    std::memcpy(copy->data, page->data, sizeof(copy->data));
+    std::memcpy(copy->decoded, page->decoded, sizeof(copy->decoded));
+    copy->references = 1;
+
+    release(page);
+    pages[index] = copy;
+    private_pages[index / 64] |= uint64_t{ 1 } << (index % 64);
+    return copy;
 }
 
 void Memory::write(uint16_t address, uint8_t value)
 {
-    data[address] = value;
+    address &= address_mask;
+    MemoryPage* page = writable_page(address / MEMORY_PAGE_SIZE);
+    const unsigned int offset = address % MEMORY_PAGE_SIZE;
+    page->data[offset] = value;
+
+    // Refresh the cache entry this byte belongs to (hi-byte if address is
+    // even, lo-byte if odd); pages are an even size, so both bytes of an
+    // entry are always in the same page
+    decode_entry(page, offset);
+
+    if (address < CLASSIC_MEMORY_SIZE)
+    {
+        written_chunks |= uint64_t{ 1 } << (address / MEMORY_CHUNK_SIZE);
+    }
+}
+
+void Memory::load(uint16_t address, const uint8_t* block, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+
+    const unsigned int last = address + size - 1;
+
+    // One memcpy per page touched
+    for (unsigned int start = address; start <= last;)
+    {
+        const unsigned int index = start / MEMORY_PAGE_SIZE;
+        const unsigned int offset = start % MEMORY_PAGE_SIZE;
+        const unsigned int end = std::min(last + 1, (index + 1) * MEMORY_PAGE_SIZE);
+
+        // Zeros over the zero page change nothing; skipping them keeps a
+        // whole-memory load (a save state, a RomStore image) from giving
+        // every untouched page its own copy
+        if (pages[index] == zero_page() && is_zero(block + (start - address), end - start))
+        {
+            start = end;
+            continue;
+        }
+
+        MemoryPage* page = writable_page(index);
+        std::memcpy(page->data + offset, block + (start - address), end - start);
+
+        for (unsigned int entry = offset & ~1u; entry < end - index * MEMORY_PAGE_SIZE; entry += 2)
+        {
+            decode_entry(page, entry);
+        }
+
+        start = end;
+    }
+
+    written_chunks |= chunk_range(address, last);
+}
+
+Instruction Memory::fetch_unaligned(uint16_t address)
+{
+    return decode(read(address) << 8 | read(address + 1));
+}
+
+uint64_t Memory::take_written_chunks()
+{
+    const uint64_t chunks = written_chunks;
+    written_chunks = 0;
+    return chunks;
+}
+
+unsigned int Memory::get_private_page_count() const
+{
+    unsigned int count = 0;
+    for (const MemoryPage* page : pages)
+    {
+        count += page != zero_page() && page->references.load(std::memory_order_relaxed) == 1;
+    }
+    return count;
+}
+
+void Memory::save_state(SaveState& state) const
+{
+    for (unsigned int index = 0; index < MEMORY_PAGE_COUNT; ++index)
+    {
+        std::memcpy(state.memory + index * MEMORY_PAGE_SIZE, pages[index]->data, MEMORY_PAGE_SIZE);
+    }
+}
+
+void Memory::load_state(const SaveState& state)
+{
+    load(0, state.memory, MEMORY_SIZE);
+    written_chunks = ~uint64_t{ 0 };
 }
@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "presenter.h"
+
+namespace
+{
+    // Longest trail set_phosphor_decay() allows; at 1.0 nothing would ever
+    // go dark
+    const double MAX_PHOSPHOR_DECAY = 0.99;
+
+    const size_t MAX_DISPLAY_PIXELS = HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HEIGHT;
+
+    // Color channels per RGBA pixel
+    const size_t CHANNELS = 4;
+
+    // Bit y set for each of the first rows rows
+    uint64_t all_rows(unsigned int rows)
+    {
+        return rows >= 64 ? ~uint64_t{ 0 } : (uint64_t{ 1 } << rows) - 1;
+    }
+}
+
+uint64_t PresentedImage::rows_changed_since(uint64_t earlier) const
+{
+    if (earlier == 0 || earlier >= sequence || sequence - earlier > PRESENTED_ROW_HISTORY)
+    {
+        return all_rows(scale == 0 ? 0 : height / scale);
+    }
+    return changed_rows[sequence - earlier - 1];
+}
+
+Presenter::Presenter() :
+    settings{},
+    fresh{ false },
+    running{ false },
+    glow(MAX_DISPLAY_PIXELS * CHANNELS, 0),
+    target(MAX_DISPLAY_PIXELS, 0),
+    blended(MAX_DISPLAY_PIXELS, 0),
+    shown(MAX_DISPLAY_PIXELS, 0),
+    shown_width{ 0 },
+    shown_height{ 0 },
+    shown_scale{ 0 },
+    sequence{ 0 },
+    row_history{},
+    fading{ false },
+    expansion(256),
+    expansion_palette{}
+{
+    std::copy(std::begin(PIXEL_PALETTE), std::end(PIXEL_PALETTE), settings.palette.begin());
+    settings.output_width = DISPLAY_WIDTH * DISPLAY_SCALE;
+    settings.output_height = DISPLAY_HEIGHT * DISPLAY_SCALE;
+    set_phosphor_decay(PHOSPHOR_DECAY);
+}
+
+Presenter::~Presenter()
+{
+    stop();
+}
+
+void Presenter::set_phosphor_decay(double decay)
+{
+    decay = std::min(std::max(decay, 0.0), MAX_PHOSPHOR_DECAY);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    settings.decay = static_cast<uint16_t>(decay * 65536.0 + 0.5);
+}
+
+void Presenter::set_palette(const std::array<uint32_t, 1 << DISPLAY_PLANES>& palette)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    settings.palette = palette;
+}
+
+void Presenter::set_output_size(unsigned int width, unsigned int height)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        settings.output_width = width;
+        settings.output_height = height;
+
+        // Re-render the current display at the new size
+        fresh = true;
+    }
+    wake.notify_one();
+}
+
+void Presenter::set_image_callback(std::function<void()> callback)
+{
+    image_callback = std::move(callback);
+}
+
+void Presenter::start()
+{
+    if (thread.joinable())
+    {
+        return;
+    }
+
+    running = true;
+    thread = std::thread(&Presenter::run, this);
+}
+
+void Presenter::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wake.notify_one();
+
+    if (thread.joinable())
+    {
+        thread.join();
+    }
+}
+
+void Presenter::submit(const Display& display)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = display;
+        fresh = true;
+    }
+    wake.notify_one();
+}
+
+bool Presenter::update_image()
+{
+    return images.update();
+}
+
+const PresentedImage& Presenter::get_image() const
+{
+    return images.read_slot();
+}
+
+bool Presenter::is_fading() const
+{
+    return fading;
+}
+
+void Presenter::run()
+{
+    const std::chrono::duration<double, std::milli> frame_interval(FRAME_DURATION_MS);
+    Display display;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        // Nothing new: sleep until there is, or, while pixels are still
+        // fading, render the same display again once a frame has passed
+        if (!fresh)
+        {
+            const auto woken = [this]() { return fresh || !running; };
+            if (fading)
+            {
+                wake.wait_for(lock, frame_interval, woken);
+            }
+            else
+            {
+                wake.wait(lock, woken);
+            }
+
+            if (!running)
+            {
+                break;
+            }
+        }
+
+        display = pending;
+        fresh = false;
+        lock.unlock();
+
+        if (render(display, images.write_slot()))
+        {
+            images.publish();
+
+            if (image_callback)
+            {
+                image_callback();
+            }
+        }
+
+        lock.lock();
+    }
+}
+
+bool Presenter::render(const Display& display, PresentedImage& image)
+{
+    Settings current;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        current = settings;
+    }
+
+    const unsigned int width = display.get_width();
+    const unsigned int height = display.get_height();
+    const size_t pixel_count = size_t{ width } * height;
+
+    // A resolution switch clears the screen anyway; don't let the old
+    // layout's glow bleed into the new one
+    const bool resized = width != shown_width || height != shown_height;
+    if (resized)
+    {
+        std::fill(glow.begin(), glow.end(), 0);
+    }
+
+    expand(display, current.palette, target.data());
+    fading = blend(target.data(), glow.data(), current.decay, blended.data(), pixel_count);
+
+    const unsigned int scale = std::max(1u, std::min(current.output_width / width, current.output_height / height));
+
+    // Rows that differ from the last image; a new layout changes them all
+    uint64_t changed = all_rows(height);
+    if (!resized && scale == shown_scale)
+    {
+        changed = 0;
+        for (unsigned int y = 0; y < height; ++y)
+        {
+            const size_t row = size_t{ y } * width;
+            changed |= uint64_t{ std::memcmp(&blended[row], &shown[row], width * sizeof(uint32_t)) != 0 } << y;
+        }
+
+        if (changed == 0)
+        {
+            return false;
+        }
+    }
+
+    std::copy(blended.begin(), blended.begin() + pixel_count, shown.begin());
+    shown_width = width;
+    shown_height = height;
+    shown_scale = scale;
+
+    std::copy_backward(row_history.begin(), row_history.end() - 1, row_history.end());
+    row_history[0] = changed;
+    sequence += 1;
+
+    // The slot holds some earlier image (the worker writes into whichever
+    // one the triple buffer hands it); only the bands changed since then
+    // need scaling again, if it's recent enough and the same size
+    const bool same_layout = image.width == width * scale && image.height == height * scale &&
+        image.pixels.size() == size_t{ image.width } * image.height;
+    const uint64_t earlier = same_layout ? image.sequence : 0;
+
+    image.width = width * scale;
+    image.height = height * scale;
+    image.scale = scale;
+    image.sequence = sequence;
+
+    uint64_t since = 0;
+    for (unsigned int i = 0; i < PRESENTED_ROW_HISTORY; ++i)
+    {
+        since |= row_history[i];
+        image.changed_rows[i] = since;
+    }
+
+    image.pixels.resize(size_t{ image.width } * image.height);
+    upscale(blended.data(), width, height, scale, image.rows_changed_since(earlier), image.pixels.data());
+    return true;
+}
+
+void Presenter::expand(const Display& display, const std::array<uint32_t, 1 << DISPLAY_PLANES>& palette, uint32_t* pixels)
+{
+    // Rebuilt only when the palette changes (i.e. almost never; the table
+    // starts out right for an all-zero palette), and after that a byte of
+    // pixels is one 32-byte copy, as in Display
+    if (palette != expansion_palette)
+    {
+        for (unsigned int bits = 0; bits < 256; ++bits)
+        {
+            for (unsigned int bit = 0; bit < 8; ++bit)
+            {
+                expansion[bits][bit] = palette[(bits >> (7 - bit)) & 1];
+            }
+        }
+        expansion_palette = palette;
+    }
+
+    const uint64_t* plane_1 = display.get_plane(0);
+    const uint64_t* plane_2 = display.get_plane(1);
+    const unsigned int words = display.get_width() * display.get_height() / 64;
+
+    for (unsigned int word = 0; word < words; ++word)
+    {
+        const uint64_t low = plane_1[word];
+        const uint64_t high = plane_2[word];
+
+        for (unsigned int byte = 0; byte < 8; ++byte)
+        {
+            const uint8_t bits = static_cast<uint8_t>(low >> (56 - byte * 8));
+            const uint8_t plane_2_bits = static_cast<uint8_t>(high >> (56 - byte * 8));
+
+            // Plane 2 is only ever used by XO-CHIP programs
+            if (plane_2_bits == 0)
+            {
+                std::memcpy(pixels, expansion[bits].data(), sizeof(expansion[bits]));
+            }
+            else
+            {
+                for (unsigned int bit = 0; bit < 8; ++bit)
+                {
+                    pixels[bit] = palette[((bits >> (7 - bit)) & 1) | ((plane_2_bits >> (7 - bit)) & 1) << 1];
+                }
+            }
+            pixels += 8;
+        }
+    }
+}
+
+// Channel by channel, as one flat loop with no branches so it compiles to
+// vector code: a 16-bit multiply-high for the decay, a max against the
+// palette color and a narrowing store, 16 or 32 channels at a time
+bool Presenter::blend(const uint32_t* target, uint16_t* glow, uint16_t decay, uint32_t* pixels, size_t n)
+{
+    const uint8_t* target_channels = reinterpret_cast<const uint8_t*>(target);
+    uint8_t* channels = reinterpret_cast<uint8_t*>(pixels);
+    uint16_t lingering = 0;
+
+    for (size_t i = 0; i < n * CHANNELS; ++i)
+    {
+        const uint16_t lit = static_cast<uint16_t>(target_channels[i] * 257);
+        const uint16_t faded = static_cast<uint16_t>((uint32_t{ glow[i] } * decay) >> 16);
+        const uint16_t value = std::max(lit, faded);
+
+        lingering |= value ^ lit;
+        glow[i] = value;
+        channels[i] = static_cast<uint8_t>(value >> 8);
+    }
+
+    return lingering != 0;
+}
+
+// Each source row is widened once, pixel by pixel, and the other scale - 1
+// output rows are straight copies of it; at 1080p and up nearly all the
+// time goes on those copies, which run at memory bandwidth. Only the rows
+// set in rows are redone
+void Presenter::upscale(const uint32_t* source, unsigned int width, unsigned int height, unsigned int scale, uint64_t rows, uint32_t* pixels)
+{
+    const size_t row_pixels = size_t{ width } * scale;
+
+    for (unsigned int y = 0; y < height; ++y)
+    {
+        if (!((rows >> y) & 1))
+        {
+            continue;
+        }
+
+        uint32_t* const row = pixels + y * scale * row_pixels;
+        const uint32_t* const source_row = source + y * width;
+
+        for (unsigned int x = 0; x < width; ++x)
+        {
+            std::fill_n(row + x * scale, scale, source_row[x]);
+        }
+
+        for (unsigned int copy = 1; copy < scale; ++copy)
+        {
+            std::memcpy(row + copy * row_pixels, row, row_pixels * sizeof(uint32_t));
+        }
+    }
+}
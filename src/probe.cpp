@@ -0,0 +1,128 @@
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+
+#include "probe.h"
+
+namespace
+{
+    std::string hex_address(unsigned int address)
+    {
+        char text[8];
+        std::snprintf(text, sizeof(text), "0x%03X", address);
+        return text;
+    }
+}
+
+void NullProbe::write_json(std::ostream& out) const
+{
+    out << "{\"enabled\": false}\n";
+}
+
+void NullProbe::write_csv(std::ostream& out) const
+{
+    out << "kind,key,value\n";
+}
+
+CountingProbe::CountingProbe() :
+    pc_counts(MEMORY_SIZE)
+{
+    reset();
+}
+
+void CountingProbe::reset()
+{
+    for (uint64_t& count : op_counts)
+    {
+        count = 0;
+    }
+    for (uint64_t& count : pc_counts)
+    {
+        count = 0;
+    }
+
+    draws = 0;
+    rows_drawn = 0;
+    pixels_drawn = 0;
+    collisions = 0;
+    key_wait_cycles = 0;
+    key_waits_completed = 0;
+}
+
+void CountingProbe::write_json(std::ostream& out) const
+{
+    uint64_t total = 0;
+    for (const uint64_t count : op_counts)
+    {
+        total += count;
+    }
+
+    out << "{\n"
+        << "  \"enabled\": true,\n"
+        << "  \"instructions\": " << total << ",\n"
+        << "  \"ops\": {";
+
+    // Only operations that actually ran, to keep reports readable
+    bool first = true;
+    for (int op = 0; op < OP_COUNT; ++op)
+    {
+        if (op_counts[op] == 0)
+        {
+            continue;
+        }
+        out << (first ? "\n" : ",\n") << "    \"" << op_name(static_cast<Op>(op)) << "\": " << op_counts[op];
+        first = false;
+    }
+
+    out << "\n  },\n"
+        << "  \"draw\": {\"draws\": " << draws << ", \"rows\": " << rows_drawn
+        << ", \"pixels\": " << pixels_drawn << ", \"collisions\": " << collisions << "},\n"
+        << "  \"key_wait\": {\"spin_cycles\": " << key_wait_cycles
+        << ", \"spin_seconds\": " << key_wait_cycles / CPU_HZ
+        << ", \"completed\": " << key_waits_completed << "},\n"
+        << "  \"pc_heat\": {";
+
+    // Sparse map of address -> executions
+    first = true;
+    for (unsigned int address = 0; address < MEMORY_SIZE; ++address)
+    {
+        if (pc_counts[address] == 0)
+        {
+            continue;
+        }
+        out << (first ? "\n" : ",\n") << "    \"" << hex_address(address) << "\": " << pc_counts[address];
+        first = false;
+    }
+
+    out << "\n  }\n"
+        << "}\n";
+}
+
+void CountingProbe::write_csv(std::ostream& out) const
+{
+    out << "kind,key,value\n";
+
+    for (int op = 0; op < OP_COUNT; ++op)
+    {
+        if (op_counts[op] != 0)
+        {
+            out << "op," << op_name(static_cast<Op>(op)) << ',' << op_counts[op] << '\n';
+        }
+    }
+
+    out << "draw,draws," << draws << '\n'
+        << "draw,rows," << rows_drawn << '\n'
+        << "draw,pixels," << pixels_drawn << '\n'
+        << "draw,collisions," << collisions << '\n'
+        << "key_wait,spin_cycles," << key_wait_cycles << '\n'
+        << "key_wait,completed," << key_waits_completed << '\n';
+
+    for (unsigned int address = 0; address < MEMORY_SIZE; ++address)
+    {
+        if (pc_counts[address] != 0)
+        {
+            out << "pc," << hex_address(address) << ',' << pc_counts[address] << '\n';
+        }
+    }
+}
@@ -0,0 +1,168 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "rom_store.h"
+#include "hash.h"
+
+RomFile::RomFile(const std::string& filename, size_t max_size) :
+    valid{ false }
+{
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        error = "Failed to open ROM " + filename;
+        return;
+    }
+
+    // ROMs are a few KB at most, so one unbuffered read into a buffer of the
+    // file's size is cheaper than mapping the file. Oversized files are
+    // turned away before anything is read
+    std::setvbuf(file, nullptr, _IONBF, 0);
+    const long length = std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+
+    if (length < 0 || std::fseek(file, 0, SEEK_SET) != 0)
+    {
+        error = "Failed to read ROM " + filename;
+    }
+    else if (length == 0)
+    {
+        error = "ROM " + filename + " is empty";
+    }
+    else if (static_cast<unsigned long>(length) > max_size)
+    {
+        error = "ROM " + filename + " is too large (more than " + std::to_string(max_size) +
+            " bytes, the space above START_ADDRESS)";
+    }
+    else
+    {
+        bytes.resize(static_cast<size_t>(length));
+        if (std::fread(bytes.data(), 1, bytes.size(), file) != bytes.size())
+        {
+            error = "Failed to read ROM " + filename;
+        }
+        else
+        {
+            valid = true;
+        }
+    }
+
+    std::fclose(file);
+}
+
+bool RomFile::is_valid() const
+{
+    return valid;
+}
+
+const std::string& RomFile::get_error() const
+{
+    return error;
+}
+
+const uint8_t* RomFile::data() const
+{
+    return bytes.data();
+}
+
+size_t RomFile::size() const
+{
+    return valid ? bytes.size() : 0;
+}
+
+const RomImage* RomStore::load(const std::string& filename, QuirkProfile profile)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    // Images are the same whatever the profile (64 KB, like Memory); only
+    // whether the program fits depends on it
+    const RomImage* image = nullptr;
+
+    const auto known = paths.find(filename);
+    if (known != paths.end())
+    {
+        image = known->second;
+    }
+    else
+    {
+        const RomFile rom(filename);
+        if (!rom.is_valid())
+        {
+            std::cerr << rom.get_error() << std::endl;
+            return nullptr;
+        }
+
+        image = add_locked(rom.data(), rom.size());
+        paths.emplace(filename, image);
+    }
+
+    const unsigned int limit = max_rom_size(QUIRK_PROFILES[profile]);
+    if (image->size > limit)
+    {
+        std::cerr << "ROM " << filename << " is too large for the " << quirk_profile_name(profile)
+                  << " profile (more than " << limit << " bytes, the space above START_ADDRESS)" << std::endl;
+        return nullptr;
+    }
+
+    return image;
+}
+
+const RomImage* RomStore::add(const uint8_t* data, size_t size, QuirkProfile profile)
+{
+    if (size == 0 || size > max_rom_size(QUIRK_PROFILES[profile]))
+    {
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    return add_locked(data, size);
+}
+
+const RomImage* RomStore::add_locked(const uint8_t* data, size_t size)
+{
+    const uint64_t hash = fnv1a_64(data, size);
+    auto& bucket = images[hash];
+
+    // Compare contents too; a hash match alone could be a collision
+    for (const auto& image : bucket)
+    {
+        if (image->size == size && std::memcmp(image->bytes + START_ADDRESS, data, size) == 0)
+        {
+            return image.get();
+        }
+    }
+
+    auto image = std::make_unique<RomImage>();
+    image->hash = hash;
+    image->size = size;
+
+    // Same layout as a Chip8 after reset() and load_rom()
+    std::memset(image->bytes, 0, MEMORY_SIZE);
+    std::memcpy(image->bytes + FONT_SET_START_ADDRESS, FONT_SET, sizeof(FONT_SET));
+    std::memcpy(image->bytes + BIG_FONT_SET_START_ADDRESS, BIG_FONT_SET, sizeof(BIG_FONT_SET));
+    std::memcpy(image->bytes + START_ADDRESS, data, size);
+
+    // Built in a scratch Memory and shared into the image, which leaves the
+    // image's pages marked shared; copies made from it by several threads
+    // at once then only read the image
+    Memory prototype;
+    prototype.load(0, image->bytes, MEMORY_SIZE);
+    image->memory = prototype;
+
+    bucket.push_back(std::move(image));
+    return bucket.back().get();
+}
+
+size_t RomStore::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    size_t count = 0;
+    for (const auto& bucket : images)
+    {
+        count += bucket.second.size();
+    }
+    return count;
+}
@@ -0,0 +1,127 @@
+#include <cstdint>
+#include <cstdio>
+#include <new>
+#include <string>
+
+#include "save_state.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#else
+#define CHIP8_HAVE_MMAP 0
+#endif
+
+bool is_valid_save_state(const SaveState& state)
+{
+    if (state.magic != SAVE_STATE_MAGIC ||
+        state.version != SAVE_STATE_VERSION ||
+        state.size != sizeof(SaveState))
+    {
+        return false;
+    }
+
+    // A damaged or hand-edited file must not leave the machine indexing past
+    // its stack or keypad. Stack pointer MAX_CALLSTACK is a full stack; -1
+    // means FX0A isn't waiting on a key
+    return state.stack_pointer <= MAX_CALLSTACK &&
+        state.last_key_pressed >= -1 && state.last_key_pressed < NUMBER_OF_KEYS &&
+        state.display_hires <= 1 &&
+        state.display_selected_planes < (1 << DISPLAY_PLANES);
+}
+
+bool write_save_state(const std::string& filename, const SaveState& state)
+{
+    std::FILE* file = std::fopen(filename.c_str(), "wb");
+
+    if (!file)
+    {
+        return false;
+    }
+
+    const bool written = std::fwrite(&state, sizeof(SaveState), 1, file) == 1;
+    return std::fclose(file) == 0 && written;
+}
+
+MappedSaveState::MappedSaveState(const std::string& filename) :
+    state{ nullptr },
+    mapped{ false }
+{
+#if CHIP8_HAVE_MMAP
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size == static_cast<off_t>(sizeof(SaveState)))
+    {
+        void* address = mmap(nullptr, sizeof(SaveState), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address != MAP_FAILED)
+        {
+            state = static_cast<const SaveState*>(address);
+            mapped = true;
+        }
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+#else
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (!file)
+    {
+        return;
+    }
+
+    SaveState* buffer = new SaveState;
+    if (std::fread(buffer, sizeof(SaveState), 1, file) == 1)
+    {
+        state = buffer;
+    }
+    else
+    {
+        delete buffer;
+    }
+
+    std::fclose(file);
+#endif
+
+    if (state && !is_valid_save_state(*state))
+    {
+        release();
+    }
+}
+
+MappedSaveState::~MappedSaveState()
+{
+    release();
+}
+
+void MappedSaveState::release()
+{
+    if (!state)
+    {
+        return;
+    }
+
+#if CHIP8_HAVE_MMAP
+    if (mapped)
+    {
+        munmap(const_cast<SaveState*>(state), sizeof(SaveState));
+    }
+#else
+    delete state;
+#endif
+
+    state = nullptr;
+    mapped = false;
+}
+
+const SaveState* MappedSaveState::get() const
+{
+    return state;
+}
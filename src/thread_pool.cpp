@@ -0,0 +1,103 @@
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "thread_pool.h"
+
+WorkStealingPool::WorkStealingPool(size_t thread_count) :
+    thread_count{ thread_count }
+{
+    if (this->thread_count == 0)
+    {
+        this->thread_count = std::thread::hardware_concurrency();
+    }
+    if (this->thread_count == 0)
+    {
+        this->thread_count = 1;
+    }
+
+    for (size_t i = 0; i < this->thread_count; ++i)
+    {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+}
+
+size_t WorkStealingPool::get_thread_count() const
+{
+    return thread_count;
+}
+
+void WorkStealingPool::run(size_t job_count, const std::function<void(size_t, size_t)>& job)
+{
+    // Deal jobs out in contiguous ranges; neighbouring jobs tend to be similar
+    // in size, so each worker starts with a fair share
+    for (size_t worker = 0; worker < thread_count; ++worker)
+    {
+        const size_t first = job_count * worker / thread_count;
+        const size_t last = job_count * (worker + 1) / thread_count;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            queues[worker]->jobs.push_back(i);
+        }
+    }
+
+    auto work = [this, &job](size_t worker)
+    {
+        size_t index;
+        while (pop(worker, index) || steal(worker, index))
+        {
+            job(index, worker);
+        }
+    };
+
+    // No jobs are ever added once running, so a worker that finds every
+    // queue empty can exit
+    std::vector<std::thread> threads;
+    for (size_t worker = 1; worker < thread_count; ++worker)
+    {
+        threads.emplace_back(work, worker);
+    }
+
+    work(0);
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+}
+
+bool WorkStealingPool::pop(size_t worker, size_t& job)
+{
+    WorkQueue& queue = *queues[worker];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    if (queue.jobs.empty())
+    {
+        return false;
+    }
+
+    job = queue.jobs.back();
+    queue.jobs.pop_back();
+    return true;
+}
+
+bool WorkStealingPool::steal(size_t thief, size_t& job)
+{
+    for (size_t offset = 1; offset < thread_count; ++offset)
+    {
+        WorkQueue& victim = *queues[(thief + offset) % thread_count];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+
+        if (!victim.jobs.empty())
+        {
+            job = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+#include "tracer.h"
+
+namespace
+{
+    const uint32_t TRACE_MAGIC = 0x52543843; // "C8TR"
+    const uint32_t TRACE_VERSION = 1;
+
+    // Record flags byte
+    const uint8_t TRACE_CYCLE_DELTA = 0x01; // A varint cycle delta follows (otherwise 1)
+    const uint8_t TRACE_INDEX = 0x02; // I follows
+    const uint8_t TRACE_REGISTERS = 0x04; // A mask of changed V0..VE and their values follow
+
+    // How long the writer sleeps when the emulation has nothing new for it
+    const auto WRITER_POLL_INTERVAL = std::chrono::milliseconds(1);
+
+    // Encoded bytes collected before each write to the file
+    const size_t WRITE_BUFFER_SIZE = 1 << 16;
+
+    const uint16_t VF_BIT = 1 << (NUMBER_OF_REGISTERS - 1);
+
+    // Flags, address, opcode and VF; a 10-byte varint; I; the mask and 15
+    // registers
+    const size_t MAX_ENCODED_RECORD = 6 + 10 + 2 + 2 + 15;
+
+    // Each returns the position after what it wrote
+    uint8_t* put_u16(uint8_t* out, uint16_t value)
+    {
+        out[0] = static_cast<uint8_t>(value);
+        out[1] = static_cast<uint8_t>(value >> 8);
+        return out + 2;
+    }
+
+    uint8_t* put_u32(uint8_t* out, uint32_t value)
+    {
+        return put_u16(put_u16(out, static_cast<uint16_t>(value)), static_cast<uint16_t>(value >> 16));
+    }
+
+    // LEB128, the same as input logs
+    uint8_t* put_varint(uint8_t* out, uint64_t value)
+    {
+        while (value >= 0x80)
+        {
+            *out++ = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        *out++ = static_cast<uint8_t>(value);
+        return out;
+    }
+
+    size_t round_up_to_power_of_two(size_t value)
+    {
+        size_t result = 1;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+}
+
+Tracer::Tracer(size_t capacity) :
+    ring(round_up_to_power_of_two(std::max(capacity, size_t{ PUBLISH_INTERVAL }))),
+    mask{ ring.size() - 1 },
+    position{ 0 },
+    limit{ ring.size() },
+    cycle{ 0 },
+    stalls{ 0 },
+    head{ 0 },
+    tail{ 0 },
+    pending{ 0 },
+    previous_cycle{ 0 },
+    previous_index{ 0 },
+    previous_registers{},
+    running{ false }
+{
+}
+
+Tracer::~Tracer()
+{
+    close();
+}
+
+bool Tracer::open(const std::string& filename)
+{
+    close();
+
+    out.open(filename, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+    {
+        return false;
+    }
+
+    // Start from an empty ring; the decoder starts from all-zero state, so
+    // the first record lists every register that isn't zero
+    position = 0;
+    limit = ring.size();
+    stalls = 0;
+    head = 0;
+    tail = 0;
+    previous_cycle = 0;
+    previous_index = 0;
+    previous_registers.fill(0);
+
+    buffer.resize(WRITE_BUFFER_SIZE + MAX_ENCODED_RECORD);
+    put_u32(put_u32(buffer.data(), TRACE_MAGIC), TRACE_VERSION);
+    pending = 8;
+
+    running = true;
+    writer = std::thread(&Tracer::write_loop, this);
+    return true;
+}
+
+void Tracer::close()
+{
+    if (!writer.joinable())
+    {
+        return;
+    }
+
+    publish();
+    running = false;
+    writer.join();
+
+    out.close();
+}
+
+bool Tracer::is_open() const
+{
+    return writer.joinable();
+}
+
+void Tracer::set_cycle(uint64_t cycle)
+{
+    this->cycle = cycle;
+}
+
+uint64_t Tracer::get_record_count() const
+{
+    return position;
+}
+
+uint64_t Tracer::get_stall_count() const
+{
+    return stalls;
+}
+
+void Tracer::wait_for_space()
+{
+    // The writer can only catch up on what it's been given
+    publish();
+    limit = tail.load(std::memory_order_acquire) + ring.size();
+
+    if (position == limit)
+    {
+        ++stalls;
+        do
+        {
+            std::this_thread::yield();
+            limit = tail.load(std::memory_order_acquire) + ring.size();
+        } while (position == limit);
+    }
+}
+
+void Tracer::write_loop()
+{
+    uint64_t consumed = 0;
+
+    for (;;)
+    {
+        // Read running first: once it's false, head is final
+        const bool stopping = !running.load(std::memory_order_acquire);
+        const uint64_t available = head.load(std::memory_order_acquire);
+
+        if (available != consumed)
+        {
+            flush(consumed, available);
+            consumed = available;
+            tail.store(consumed, std::memory_order_release);
+        }
+        else if (stopping)
+        {
+            break;
+        }
+        else
+        {
+            std::this_thread::sleep_for(WRITER_POLL_INTERVAL);
+        }
+    }
+
+    out.write(reinterpret_cast<const char*>(buffer.data()), pending);
+    pending = 0;
+    out.flush();
+}
+
+void Tracer::flush(uint64_t from, uint64_t to)
+{
+    // Encoded straight into the buffer through a pointer; it always has room
+    // for one more record of the largest size
+    buffer.resize(WRITE_BUFFER_SIZE + MAX_ENCODED_RECORD);
+    uint8_t* const start = buffer.data();
+    uint8_t* out_position = start + pending;
+    const TraceRecord* const records = ring.data();
+
+    for (uint64_t i = from; i != to; ++i)
+    {
+        const TraceRecord& entry = records[i & mask];
+
+        uint16_t changed = 0;
+        for (unsigned int r = 0; r < NUMBER_OF_REGISTERS - 1; ++r)
+        {
+            changed |= (entry.registers[r] != previous_registers[r]) << r;
+        }
+
+        const uint64_t delta = entry.cycle - previous_cycle;
+        const uint8_t flags = (delta != 1 ? TRACE_CYCLE_DELTA : 0) |
+            (entry.index_register != previous_index ? TRACE_INDEX : 0) |
+            (changed ? TRACE_REGISTERS : 0);
+
+        out_position[0] = flags;
+        out_position = put_u16(out_position + 1, entry.address);
+        out_position = put_u16(out_position, entry.opcode);
+        *out_position++ = entry.registers[NUMBER_OF_REGISTERS - 1];
+
+        if (flags & TRACE_CYCLE_DELTA)
+        {
+            out_position = put_varint(out_position, delta);
+        }
+        if (flags & TRACE_INDEX)
+        {
+            out_position = put_u16(out_position, entry.index_register);
+        }
+        if (flags & TRACE_REGISTERS)
+        {
+            out_position = put_u16(out_position, changed);
+            for (unsigned int r = 0; r < NUMBER_OF_REGISTERS - 1; ++r)
+            {
+                *out_position = entry.registers[r];
+                out_position += (changed >> r) & 1;
+            }
+        }
+
+        previous_cycle = entry.cycle;
+        previous_index = entry.index_register;
+        previous_registers = entry.registers;
+
+        if (static_cast<size_t>(out_position - start) >= WRITE_BUFFER_SIZE)
+        {
+            out.write(reinterpret_cast<const char*>(start), out_position - start);
+            out_position = start;
+        }
+    }
+
+    pending = out_position - start;
+}
+
+TraceReader::TraceReader() :
+    buffer(WRITE_BUFFER_SIZE),
+    buffered{ 0 },
+    offset{ 0 },
+    corrupt{ false },
+    cycle{ 0 },
+    index_register{ 0 },
+    registers{}
+{
+}
+
+bool TraceReader::open(const std::string& filename)
+{
+    in.open(filename, std::ios::binary);
+    if (!in.is_open())
+    {
+        return false;
+    }
+
+    uint16_t words[4];
+    for (uint16_t& word : words)
+    {
+        if (!get_u16(word))
+        {
+            return false;
+        }
+    }
+
+    const uint32_t magic = words[0] | uint32_t{ words[1] } << 16;
+    const uint32_t version = words[2] | uint32_t{ words[3] } << 16;
+    return magic == TRACE_MAGIC && version == TRACE_VERSION;
+}
+
+bool TraceReader::next(TraceEntry& entry)
+{
+    uint8_t flags;
+    if (!get_byte(flags))
+    {
+        // A clean end of file
+        return false;
+    }
+
+    // From here on, running out of bytes means the file was cut short
+    corrupt = true;
+
+    uint8_t vf;
+    if (!get_u16(entry.address) || !get_u16(entry.opcode) || !get_byte(vf))
+    {
+        return false;
+    }
+
+    uint64_t delta = 1;
+    if ((flags & TRACE_CYCLE_DELTA) && !get_varint(delta))
+    {
+        return false;
+    }
+    cycle += delta;
+
+    entry.index_changed = false;
+    if (flags & TRACE_INDEX)
+    {
+        if (!get_u16(index_register))
+        {
+            return false;
+        }
+        entry.index_changed = true;
+    }
+
+    entry.changed = 0;
+    if (flags & TRACE_REGISTERS)
+    {
+        if (!get_u16(entry.changed))
+        {
+            return false;
+        }
+        entry.changed &= ~VF_BIT;
+
+        for (unsigned int r = 0; r < NUMBER_OF_REGISTERS - 1; ++r)
+        {
+            if (((entry.changed >> r) & 1) && !get_byte(registers[r]))
+            {
+                return false;
+            }
+        }
+    }
+
+    if (vf != registers[NUMBER_OF_REGISTERS - 1])
+    {
+        entry.changed |= VF_BIT;
+        registers[NUMBER_OF_REGISTERS - 1] = vf;
+    }
+
+    entry.cycle = cycle;
+    entry.index_register = index_register;
+    entry.registers = registers;
+
+    corrupt = false;
+    return true;
+}
+
+bool TraceReader::is_corrupt() const
+{
+    return corrupt;
+}
+
+bool TraceReader::get_byte(uint8_t& byte)
+{
+    if (offset == buffered)
+    {
+        in.read(buffer.data(), buffer.size());
+        buffered = static_cast<size_t>(in.gcount());
+        offset = 0;
+
+        if (buffered == 0)
+        {
+            return false;
+        }
+    }
+
+    byte = static_cast<uint8_t>(buffer[offset++]);
+    return true;
+}
+
+bool TraceReader::get_u16(uint16_t& value)
+{
+    uint8_t low, high;
+    if (!get_byte(low) || !get_byte(high))
+    {
+        return false;
+    }
+
+    value = static_cast<uint16_t>(low | high << 8);
+    return true;
+}
+
+bool TraceReader::get_varint(uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        uint8_t byte;
+        if (!get_byte(byte))
+        {
+            return false;
+        }
+
+        value |= uint64_t{ byte & 0x7Fu } << shift;
+        if (!(byte & 0x80))
+        {
+            return true;
+        }
+    }
+    return false;
+}
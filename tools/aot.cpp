@@ -0,0 +1,461 @@
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "constants.h"
+#include "decoder.h"
+#include "quirks.h"
+#include "rom_store.h"
+
+// Ahead-of-time translator: recovers a ROM's control flow graph and writes
+// it out as a C++ source file with one function per basic block, for
+// compiling into a runner (see aot.h and chip8_add_aot_rom in CMakeLists.txt)
+
+void print_usage()
+{
+    std::cerr << "Usage: chip8_aot <rom> -o <file.cpp> [--name NAME] [--quirks vip|chip48|schip|xochip]\n"
+              << "  -o FILE     Where to write the generated C++ source\n"
+              << "  --name N    Name of the AotProgram it defines (default: aot_ plus\n"
+              << "              the ROM's file name)\n"
+              << "  --quirks P  Profile the quirky instructions are translated for; a\n"
+              << "              machine following another one interprets the ROM\n"
+              << "              (default schip)\n";
+}
+
+namespace
+{
+    // Longest run of instructions put in one block; keeps the generated
+    // functions a reasonable size
+    const int MAX_BLOCK_LENGTH = 256;
+
+    struct Block
+    {
+        uint16_t address;
+        uint16_t length;
+        uint16_t size;
+        std::vector<std::string> lines;
+    };
+
+    std::string hex(unsigned int value, int digits)
+    {
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "0x%0*X", digits, value);
+        return buffer;
+    }
+
+    std::string reg(unsigned int index)
+    {
+        return "c.V[" + hex(index, 1) + "]";
+    }
+
+    // Identifier-safe name for the program, from the ROM's file name
+    std::string default_name(const std::string& path)
+    {
+        std::string base = path.substr(path.find_last_of("/\\") + 1);
+        base = base.substr(0, base.find_last_of('.'));
+
+        std::string name = "aot_";
+        for (const char c : base)
+        {
+            name += std::isalnum(static_cast<unsigned char>(c)) ? static_cast<char>(std::tolower(static_cast<unsigned char>(c))) : '_';
+        }
+        return name;
+    }
+
+    class Translator
+    {
+    public:
+        Translator(const uint8_t* rom, size_t size, QuirkProfile quirks) :
+            rom{ rom },
+            end{ static_cast<unsigned int>(START_ADDRESS + size) },
+            rules{ QUIRK_PROFILES[quirks] }
+        {
+        }
+
+        // Walk the control flow graph from START_ADDRESS, translating each
+        // block reached
+        void run()
+        {
+            std::vector<uint16_t> pending{ static_cast<uint16_t>(START_ADDRESS) };
+            std::set<uint16_t> seen{ static_cast<uint16_t>(START_ADDRESS) };
+
+            while (!pending.empty())
+            {
+                const uint16_t address = pending.back();
+                pending.pop_back();
+
+                std::vector<uint16_t> successors;
+                Block block = translate(address, successors);
+                if (block.length > 0)
+                {
+                    blocks[address] = std::move(block);
+                }
+
+                for (const uint16_t next : successors)
+                {
+                    if (in_rom(next, 2) && next % 2 == 0 && seen.insert(next).second)
+                    {
+                        pending.push_back(next);
+                    }
+                }
+            }
+        }
+
+        const std::map<uint16_t, Block>& get_blocks() const
+        {
+            return blocks;
+        }
+
+    private:
+        // Whether [address, address + bytes) is translated ROM: in the
+        // program and below the classic 4 KB that memory write tracking covers
+        bool in_rom(unsigned int address, unsigned int bytes) const
+        {
+            return address >= START_ADDRESS && address + bytes <= end && address + bytes <= CLASSIC_MEMORY_SIZE;
+        }
+
+        uint16_t word(unsigned int address) const
+        {
+            return rom[address - START_ADDRESS] << 8 | rom[address - START_ADDRESS + 1];
+        }
+
+        // Where a skip at address lands when it's taken, or 0 if that depends
+        // on bytes outside the translated ROM
+        unsigned int skip_target(unsigned int address) const
+        {
+            if (!rules.long_skips)
+            {
+                return address + 4;
+            }
+            if (!in_rom(address + 2, 2))
+            {
+                return 0;
+            }
+            return word(address + 2) == 0xF000 ? address + 6 : address + 4;
+        }
+
+        Block translate(uint16_t address, std::vector<uint16_t>& successors)
+        {
+            Block block{ address, 0, 0, {} };
+            unsigned int pc = address;
+
+            auto emit = [&](const std::string& code, unsigned int bytes)
+            {
+                char comment[48];
+                std::snprintf(comment, sizeof(comment), " // %03X: %04X", pc, word(pc));
+                block.lines.push_back("    " + code + comment);
+                block.length += 1;
+                pc += bytes;
+                block.size = pc - address;
+            };
+
+            while (block.length < MAX_BLOCK_LENGTH)
+            {
+                if (!in_rom(pc, 2))
+                {
+                    break;
+                }
+
+                const uint16_t opcode = word(pc);
+                // As the interpreter runs it under these quirks
+                Instruction in = decode(opcode);
+                in.op = effective_op(rules, in.op);
+                const unsigned int next = pc + 2;
+                const std::string NN = hex(in.NN, 2);
+                const std::string NNN = hex(in.NNN, 3);
+                const std::string VX = reg(in.X);
+                const std::string VY = reg(in.Y);
+                const std::string VF = reg(0xF);
+
+                // Skips end the block with both ways out
+                std::string condition;
+
+                switch (in.op)
+                {
+                case OP_00E0:
+                    emit("c.display.clear();", 2);
+                    continue;
+                case OP_1NNN:
+                    emit("return " + NNN + ";", 2);
+                    successors.push_back(in.NNN);
+                    return block;
+                case OP_3XNN:
+                    condition = VX + " == " + NN;
+                    break;
+                case OP_4XNN:
+                    condition = VX + " != " + NN;
+                    break;
+                case OP_5XY0:
+                    condition = VX + " == " + VY;
+                    break;
+                case OP_9XY0:
+                    condition = VX + " != " + VY;
+                    break;
+                case OP_EX9E:
+                    condition = "c.keypad.is_pressed(" + VX + ")";
+                    break;
+                case OP_EXA1:
+                    condition = "!c.keypad.is_pressed(" + VX + ")";
+                    break;
+                case OP_6XNN:
+                    emit(VX + " = " + NN + ";", 2);
+                    continue;
+                case OP_7XNN:
+                    emit(VX + " += " + NN + ";", 2);
+                    continue;
+                case OP_8XY0:
+                    emit(VX + " = " + VY + ";", 2);
+                    continue;
+                case OP_8XY1:
+                case OP_8XY2:
+                case OP_8XY3:
+                {
+                    const char* operation = in.op == OP_8XY1 ? " |= " : in.op == OP_8XY2 ? " &= " : " ^= ";
+                    emit(VX + operation + VY + ";" + (rules.vf_reset ? " " + VF + " = 0;" : ""), 2);
+                    continue;
+                }
+                case OP_8XY4:
+                    emit("{ const unsigned int sum = " + VX + " + " + VY + "; " + VX + " = sum; " + VF + " = sum > 0xFF; }", 2);
+                    continue;
+                case OP_8XY5:
+                    emit("{ const uint8_t flag = " + VX + " >= " + VY + "; " + VX + " -= " + VY + "; " + VF + " = flag; }", 2);
+                    continue;
+                case OP_8XY7:
+                    emit("{ const uint8_t flag = " + VY + " >= " + VX + "; " + VX + " = " + VY + " - " + VX + "; " + VF + " = flag; }", 2);
+                    continue;
+                case OP_8XY6:
+                case OP_8XYE:
+                {
+                    const std::string source = rules.shift_uses_vy ? VY : VX;
+                    const std::string shifted = in.op == OP_8XY6
+                        ? "{ const uint8_t value = " + source + "; " + VX + " = value >> 1; " + VF + " = value & 1; }"
+                        : "{ const uint8_t value = " + source + "; " + VX + " = value << 1; " + VF + " = value >> 7; }";
+                    emit(shifted, 2);
+                    continue;
+                }
+                case OP_ANNN:
+                    emit("c.I = " + NNN + ";", 2);
+                    continue;
+                case OP_FX1E:
+                    emit("c.I += " + VX + ";" + (rules.index_overflow ? " if (c.I > 0x0FFF) { " + VF + " = 1; }" : ""), 2);
+                    continue;
+                case OP_FX29:
+                    emit("c.I = FONT_SET_START_ADDRESS + " + VX + " * BYTES_PER_FONT_SPRITE;", 2);
+                    continue;
+                case OP_FX30:
+                    emit("c.I = BIG_FONT_SET_START_ADDRESS + (" + VX + " & 0x0F) * BYTES_PER_BIG_FONT_SPRITE;", 2);
+                    continue;
+
+                // Control flow the translation can't follow statically: the
+                // interpreter runs it and says where to go next
+                case OP_2NNN:
+                    emit("return c.interpret(" + hex(pc, 4) + ");", 2);
+                    successors.push_back(in.NNN);
+                    successors.push_back(next); // Where it returns to
+                    return block;
+                case OP_FX0A:
+                    emit("return c.interpret(" + hex(pc, 4) + ");", 2);
+                    successors.push_back(next);
+                    return block;
+                case OP_00EE:
+                case OP_BNNN:
+                case OP_00FD:
+                    emit("return c.interpret(" + hex(pc, 4) + ");", 2);
+                    return block;
+
+                // Memory stores end the block, so one that overwrites
+                // translated code is noticed before that code runs
+                case OP_FX33:
+                case OP_FX55:
+                case OP_5XY2:
+                    emit("return c.interpret(" + hex(pc, 4) + ");", 2);
+                    successors.push_back(next);
+                    return block;
+
+                // The 4-byte F000 NNNN
+                case OP_F000:
+                    if (!in_rom(pc, 4))
+                    {
+                        block.lines.push_back("    return " + hex(pc, 4) + ";");
+                        return block;
+                    }
+                    emit("c.interpret(" + hex(pc, 4) + ");", 4);
+                    continue;
+
+                // Drawing, scrolling, timers, random numbers, loads, ...
+                default:
+                    emit("c.interpret(" + hex(pc, 4) + ");", 2);
+                    continue;
+                }
+
+                // A skip
+                const unsigned int taken = skip_target(pc);
+                if (taken == 0)
+                {
+                    emit("return c.interpret(" + hex(pc, 4) + ");", 2);
+                    return block;
+                }
+
+                const unsigned int skip_pc = pc;
+                emit("return " + condition + " ? " + hex(taken, 4) + " : " + hex(next, 4) + ";", 2);
+                if (rules.long_skips)
+                {
+                    // The target depends on the next instruction too
+                    block.size = skip_pc + 4 - address;
+                }
+                successors.push_back(next);
+                successors.push_back(taken);
+                return block;
+            }
+
+            // Ran off the end of the ROM (or the block got long); carry on
+            // from there
+            block.lines.push_back("    return " + hex(pc, 4) + ";");
+            successors.push_back(pc);
+            return block;
+        }
+
+        const uint8_t* rom;
+        const unsigned int end;
+        const Quirks& rules;
+        std::map<uint16_t, Block> blocks;
+    };
+
+    void write_source(std::ostream& out, const std::string& name, const std::string& rom_path, const uint8_t* rom, size_t size,
+        QuirkProfile quirks, const std::map<uint16_t, Block>& blocks)
+    {
+        out << "// Generated by chip8_aot from " << rom_path << " (" << quirk_profile_name(quirks) << " quirks); do not edit\n\n"
+            << "#include <cstdint>\n\n"
+            << "#include \"aot.h\"\n\n"
+            << "namespace\n{\n";
+
+        for (const auto& entry : blocks)
+        {
+            const Block& block = entry.second;
+            out << "    uint16_t block_" << hex(block.address, 4).substr(2) << "(AotContext& c)\n    {\n";
+            for (const std::string& line : block.lines)
+            {
+                out << "    " << line << '\n';
+            }
+            out << "    }\n\n";
+        }
+
+        out << "    const AotBlock BLOCKS[] = {\n";
+        for (const auto& entry : blocks)
+        {
+            const Block& block = entry.second;
+            out << "        { " << hex(block.address, 4) << ", " << block.length << ", " << block.size
+                << ", block_" << hex(block.address, 4).substr(2) << " },\n";
+        }
+        out << "    };\n\n";
+
+        out << "    const uint8_t ROM[] = {";
+        for (size_t i = 0; i < size; ++i)
+        {
+            out << (i % 16 == 0 ? "\n        " : " ") << hex(rom[i], 2) << ',';
+        }
+        out << "\n    };\n}\n\n";
+
+        static const char* const profiles[QUIRK_PROFILE_COUNT] = { "QUIRKS_VIP", "QUIRKS_CHIP48", "QUIRKS_SCHIP", "QUIRKS_XOCHIP" };
+
+        out << "extern const AotProgram " << name << ";\n"
+            << "const AotProgram " << name << " = {\n"
+            << "    \"" << name << "\",\n"
+            << "    " << profiles[quirks] << ",\n"
+            << "    ROM,\n"
+            << "    sizeof(ROM),\n"
+            << "    BLOCKS,\n"
+            << "    sizeof(BLOCKS) / sizeof(BLOCKS[0]),\n"
+            << "};\n\n"
+            << "namespace\n{\n"
+            << "    const AotRegistration registration(" << name << ");\n"
+            << "}\n";
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string rom_path;
+    std::string output;
+    std::string name;
+    QuirkProfile quirks = DEFAULT_QUIRK_PROFILE;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--name") == 0 && i + 1 < argc)
+        {
+            name = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+        {
+            if (!parse_quirk_profile(argv[++i], quirks))
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (argv[i][0] != '-' && rom_path.empty())
+        {
+            rom_path = argv[i];
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (rom_path.empty() || output.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    if (name.empty())
+    {
+        name = default_name(rom_path);
+    }
+
+    const RomFile rom(rom_path);
+    if (!rom.is_valid())
+    {
+        std::cerr << rom.get_error() << std::endl;
+        return 1;
+    }
+
+    Translator translator(rom.data(), rom.size(), quirks);
+    translator.run();
+
+    // Written to a string first, so a failed run doesn't leave a truncated
+    // file for the build to pick up
+    std::ostringstream source;
+    write_source(source, name, rom_path, rom.data(), rom.size(), quirks, translator.get_blocks());
+
+    std::ofstream out(output, std::ios::binary);
+    if (!out.is_open() || !(out << source.str()))
+    {
+        std::cerr << "Failed to write " << output << std::endl;
+        return 1;
+    }
+
+    size_t instructions = 0;
+    for (const auto& entry : translator.get_blocks())
+    {
+        instructions += entry.second.length;
+    }
+    std::cout << rom_path << ": " << translator.get_blocks().size() << " blocks, " << instructions << " instructions -> " << output << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,409 @@
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "constants.h"
+#include "rom_store.h"
+#include "save_state.h"
+#include "thread_pool.h"
+
+// Batch runner: executes many independent (ROM, input script, cycle budget)
+// jobs across all cores and writes one result line per job
+//
+// Job file: one job per line, "<rom> <cycles> [input script] [quirks=NAME]";
+// paths with spaces can be double-quoted, lines starting with # are ignored
+// A <rom> ending in .state is a save state (see chip8_headless --save-state)
+// and the job starts from it instead of from power-on
+// quirks=vip|chip48|schip|xochip picks the job's quirk profile (default: --quirks)
+//
+// Input script: one event per line, "<cycle> <down|up> <key 0-F>"
+
+struct KeyEvent
+{
+    uint64_t cycle;
+    uint8_t key;
+    bool down;
+};
+
+struct Job
+{
+    std::string rom;
+    uint64_t cycles;
+    std::string input_script;
+    QuirkProfile quirks;
+
+    // Parsed/mapped once up front and shared (read-only) by all workers
+    const std::vector<KeyEvent>* events;
+    const SaveState* state; // nullptr if the job starts from a ROM
+    const RomImage* image;  // nullptr if the job starts from a save state
+};
+
+struct JobResult
+{
+    uint64_t cycles;
+    uint64_t display_hash;
+    uint16_t program_counter;
+    uint16_t index_register;
+    std::array<uint8_t, NUMBER_OF_REGISTERS> registers;
+};
+
+void print_usage()
+{
+    std::cerr << "Usage: chip8_batch <job file> [-o results.csv] [-j threads] [--jit] [--seed N]\n"
+              << "                   [--quirks vip|chip48|schip|xochip]\n";
+}
+
+// Split a line on whitespace, keeping double-quoted fields together
+std::vector<std::string> tokenize(const std::string& line)
+{
+    std::vector<std::string> fields;
+    size_t i = 0;
+
+    while (i < line.size())
+    {
+        while (i < line.size() && std::isspace(static_cast<unsigned char>(line[i])))
+        {
+            ++i;
+        }
+        if (i >= line.size())
+        {
+            break;
+        }
+
+        std::string field;
+        if (line[i] == '"')
+        {
+            const size_t end = line.find('"', i + 1);
+            field = line.substr(i + 1, end == std::string::npos ? std::string::npos : end - i - 1);
+            i = end == std::string::npos ? line.size() : end + 1;
+        }
+        else
+        {
+            while (i < line.size() && !std::isspace(static_cast<unsigned char>(line[i])))
+            {
+                field += line[i++];
+            }
+        }
+        fields.push_back(field);
+    }
+
+    return fields;
+}
+
+bool ends_with(const std::string& text, const std::string& suffix)
+{
+    return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+bool load_input_script(const std::string& filename, std::vector<KeyEvent>& events)
+{
+    std::ifstream file_in(filename);
+
+    if (!file_in.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file_in, line))
+    {
+        const std::vector<std::string> fields = tokenize(line);
+        if (fields.size() < 3 || fields[0][0] == '#')
+        {
+            continue;
+        }
+
+        KeyEvent event;
+        event.cycle = std::strtoull(fields[0].c_str(), nullptr, 10);
+        event.down = fields[1] == "down";
+        event.key = std::strtoul(fields[2].c_str(), nullptr, 16) & 0xF;
+        events.push_back(event);
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](const KeyEvent& a, const KeyEvent& b)
+    {
+        return a.cycle < b.cycle;
+    });
+
+    return true;
+}
+
+// Run a job on an already-reset instance; timers tick at CPU_HZ / TIMER_HZ
+// (Chip8::run_timed) and key events are applied right before the cycle
+// they're stamped with
+JobResult run_job(Chip8& chip8, const Job& job)
+{
+    if (job.state)
+    {
+        chip8.load_state(*job.state);
+    }
+    else
+    {
+        chip8.load_rom_image(*job.image);
+    }
+
+    // Events are sorted by cycle; any past the budget never happen
+    uint64_t executed = 0;
+    for (const KeyEvent& event : *job.events)
+    {
+        if (event.cycle > job.cycles)
+        {
+            break;
+        }
+
+        if (event.cycle > executed)
+        {
+            chip8.run_timed(event.cycle - executed);
+            executed = event.cycle;
+        }
+
+        if (event.down)
+        {
+            chip8.keydown(event.key);
+        }
+        else
+        {
+            chip8.keyup(event.key);
+        }
+    }
+
+    chip8.run_timed(job.cycles - executed);
+    executed = job.cycles;
+
+    JobResult result;
+    result.cycles = executed;
+    result.display_hash = chip8.get_display_hash();
+    result.program_counter = chip8.get_program_counter();
+    result.index_register = chip8.get_index_register();
+    result.registers = chip8.get_registers();
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string job_file;
+    std::string output_file = "results.csv";
+    size_t thread_count = 0;
+    bool use_jit = false;
+    bool seeded = false;
+    uint64_t seed = 0;
+    QuirkProfile default_quirks = DEFAULT_QUIRK_PROFILE;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+        {
+            output_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            thread_count = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--jit") == 0)
+        {
+            use_jit = true;
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            // Every job starts from the same seed, so results don't depend on
+            // which worker ran the job or in what order
+            seed = std::strtoull(argv[++i], nullptr, 0);
+            seeded = true;
+        }
+        else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+        {
+            if (!parse_quirk_profile(argv[++i], default_quirks))
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (argv[i][0] != '-' && job_file.empty())
+        {
+            job_file = argv[i];
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (job_file.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    std::ifstream jobs_in(job_file);
+    if (!jobs_in.is_open())
+    {
+        std::cerr << "Failed to open job file " << job_file << std::endl;
+        return 1;
+    }
+
+    // Parse jobs and their input scripts; scripts shared by several jobs are
+    // only read once
+    std::vector<Job> jobs;
+    std::map<std::string, std::vector<KeyEvent>> scripts;
+    std::map<std::string, std::unique_ptr<MappedSaveState>> states;
+
+    // Each distinct ROM is read and decoded once, however many jobs use it
+    RomStore roms;
+    std::string line;
+
+    while (std::getline(jobs_in, line))
+    {
+        const std::vector<std::string> fields = tokenize(line);
+        if (fields.size() < 2 || fields[0][0] == '#')
+        {
+            continue;
+        }
+
+        Job job;
+        job.rom = fields[0];
+        job.cycles = std::strtoull(fields[1].c_str(), nullptr, 10);
+        job.input_script = "";
+        job.quirks = default_quirks;
+
+        for (size_t field = 2; field < fields.size(); ++field)
+        {
+            if (fields[field].compare(0, 7, "quirks=") == 0)
+            {
+                if (!parse_quirk_profile(fields[field].c_str() + 7, job.quirks))
+                {
+                    std::cerr << "Unknown quirk profile in job " << line << std::endl;
+                    return 1;
+                }
+            }
+            else
+            {
+                job.input_script = fields[field];
+            }
+        }
+
+        auto it = scripts.find(job.input_script);
+        if (it == scripts.end())
+        {
+            it = scripts.emplace(job.input_script, std::vector<KeyEvent>{}).first;
+            if (!job.input_script.empty() && !load_input_script(job.input_script, it->second))
+            {
+                std::cerr << "Failed to load input script " << job.input_script << std::endl;
+                return 1;
+            }
+        }
+        job.events = &it->second;
+
+        job.state = nullptr;
+        job.image = nullptr;
+        if (ends_with(job.rom, ".state"))
+        {
+            auto state = states.find(job.rom);
+            if (state == states.end())
+            {
+                state = states.emplace(job.rom, std::make_unique<MappedSaveState>(job.rom)).first;
+                if (!state->second->get())
+                {
+                    std::cerr << "Failed to load save state " << job.rom << std::endl;
+                    return 1;
+                }
+            }
+            job.state = state->second->get();
+        }
+        else
+        {
+            job.image = roms.load(job.rom, job.quirks);
+            if (!job.image)
+            {
+                return 1;
+            }
+        }
+
+        jobs.push_back(job);
+    }
+
+    WorkStealingPool pool(thread_count);
+
+    // One reusable instance per worker; reset between jobs instead of
+    // constructing a new machine each time
+    std::vector<std::unique_ptr<Chip8>> instances;
+    for (size_t i = 0; i < pool.get_thread_count(); ++i)
+    {
+        instances.push_back(std::make_unique<Chip8>());
+        if (use_jit)
+        {
+            instances.back()->enable_jit();
+        }
+    }
+
+    std::vector<JobResult> results(jobs.size());
+    const auto start = std::chrono::steady_clock::now();
+
+    pool.run(jobs.size(), [&](size_t job, size_t worker)
+    {
+        Chip8& chip8 = *instances[worker];
+        chip8.reset();
+        chip8.set_quirks(jobs[job].quirks);
+        if (seeded)
+        {
+            chip8.seed(seed);
+        }
+        results[job] = run_job(chip8, jobs[job]);
+    });
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::ofstream out(output_file);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to open output file " << output_file << std::endl;
+        return 1;
+    }
+
+    out << "job,rom,input,cycles,display_hash,pc,i";
+    for (unsigned int v = 0; v < NUMBER_OF_REGISTERS; ++v)
+    {
+        out << ",v" << std::hex << std::uppercase << v << std::dec;
+    }
+    out << '\n';
+
+    uint64_t total_cycles = 0;
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        const JobResult& result = results[i];
+        char hash[17];
+        std::snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(result.display_hash));
+
+        out << i << ",\"" << jobs[i].rom << "\",\"" << jobs[i].input_script << "\","
+            << result.cycles << ',' << hash << ','
+            << result.program_counter << ',' << result.index_register;
+        for (const uint8_t value : result.registers)
+        {
+            out << ',' << static_cast<int>(value);
+        }
+        out << '\n';
+
+        total_cycles += result.cycles;
+    }
+
+    const double seconds = elapsed.count();
+    std::cerr << "jobs: " << jobs.size() << '\n'
+              << "threads: " << pool.get_thread_count() << '\n'
+              << "cycles: " << total_cycles << '\n'
+              << "seconds: " << seconds << '\n'
+              << "cycles/sec: " << (seconds > 0.0 ? total_cycles / seconds : 0.0) << '\n';
+
+    return 0;
+}
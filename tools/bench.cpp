@@ -0,0 +1,485 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "chip8.h"
+#include "constants.h"
+#include "memory.h"
+#include "presenter.h"
+#include "rom_store.h"
+
+// Benchmark suite: microbenchmarks for the hot paths of the core (dispatch,
+// drawing, the memory-heavy FX opcodes, Memory access, ROM loading, the
+// present stage) and
+// macrobenchmarks that run real ROMs headless for a fixed number of cycles
+//
+// Results go to stdout (or --json FILE) as JSON, one benchmark per line. With
+// --baseline, a previous JSON file is compared against and any benchmark
+// slower by more than --threshold percent is flagged (exit code 1)
+
+struct BenchResult
+{
+    std::string name;
+    uint64_t ops; // Instructions (or calls) per run
+    double seconds; // Best of REPETITIONS runs
+};
+
+struct BenchOptions
+{
+    std::string filter;
+    std::string roms_dir = "roms";
+    double scale = 1.0;
+    bool use_jit = false;
+};
+
+const int REPETITIONS = 5;
+
+// Keep results alive so the optimizer can't drop the work being measured
+volatile uint64_t g_sink;
+
+void print_usage()
+{
+    std::cerr << "Usage: chip8_bench [--json FILE] [--baseline FILE] [--threshold PCT]\n"
+              << "                   [--filter TEXT] [--roms DIR] [--scale X] [--jit]\n"
+              << "  --json FILE       Write results to FILE instead of stdout\n"
+              << "  --baseline FILE   Compare against a previous --json output\n"
+              << "  --threshold PCT   Slowdown that counts as a regression (default 5)\n"
+              << "  --filter TEXT     Only run benchmarks whose name contains TEXT\n"
+              << "  --roms DIR        Directory holding tests/*.ch8 and Pong (default roms)\n"
+              << "  --scale X         Multiply every benchmark's work by X\n"
+              << "  --jit             Run machine benchmarks through the JIT\n";
+}
+
+// Run once to warm up, then keep the fastest of REPETITIONS timed runs;
+// skipped if the name doesn't match --filter
+void measure(std::vector<BenchResult>& results, const BenchOptions& options, const std::string& name, uint64_t ops, const std::function<void()>& run)
+{
+    if (name.find(options.filter) == std::string::npos)
+    {
+        return;
+    }
+
+    run();
+
+    double best = 0.0;
+    for (int i = 0; i < REPETITIONS; ++i)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        run();
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        if (i == 0 || elapsed.count() < best)
+        {
+            best = elapsed.count();
+        }
+    }
+
+    results.push_back(BenchResult{ name, ops, best });
+}
+
+std::unique_ptr<Chip8> make_machine(const BenchOptions& options)
+{
+    auto chip8 = std::make_unique<Chip8>();
+    chip8->seed(0);
+
+    // Every benchmark loops, often on something that looks idle; skipping
+    // those cycles would measure nothing
+    chip8->set_idle_skipping(false);
+
+    if (options.use_jit)
+    {
+        chip8->enable_jit();
+    }
+
+    return chip8;
+}
+
+// Run a small hand-assembled program for a fixed number of cycles; the
+// program loops forever so every cycle executes the instructions under test
+void bench_program(std::vector<BenchResult>& results, const BenchOptions& options, const std::string& name, uint64_t cycles, const std::vector<uint16_t>& program)
+{
+    std::vector<uint8_t> bytes;
+    for (const uint16_t opcode : program)
+    {
+        bytes.push_back(opcode >> 8);
+        bytes.push_back(opcode & 0xFF);
+    }
+
+    auto chip8 = make_machine(options);
+    chip8->load_program(bytes.data(), bytes.size());
+
+    measure(results, options, name, cycles, [&]() { chip8->run(cycles); });
+}
+
+void micro_benchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+    const uint64_t cycles = static_cast<uint64_t>(2000000 * options.scale);
+
+    // Dispatch: cheap ALU ops and a jump, so fetch/decode/dispatch dominates
+    bench_program(results, options, "micro/dispatch", cycles, {
+        0x6000, // V0 = 0
+        0x7001, // V0 += 1
+        0x8101, // V1 |= V0
+        0x8213, // V2 ^= V1
+        0x3F01, // Skip if VF == 1 (never taken)
+        0x1202, // Loop
+    });
+
+    // DXYN at different heights; the sprite source doesn't matter, so point
+    // I at the font
+    struct DrawCase
+    {
+        const char* name;
+        uint8_t x;
+        uint8_t y;
+        uint8_t height;
+    };
+    const DrawCase draw_cases[] = {
+        { "micro/dxyn_h1", 10, 10, 1 },
+        { "micro/dxyn_h5", 10, 10, 5 },
+        { "micro/dxyn_h15", 10, 10, 15 },
+        { "micro/dxyn_h15_clip_right", 60, 10, 15 }, // Last 4 columns only
+        { "micro/dxyn_h15_clip_bottom", 10, 28, 15 }, // Last 4 rows only
+    };
+
+    for (const DrawCase& draw : draw_cases)
+    {
+        bench_program(results, options, draw.name, cycles, {
+            static_cast<uint16_t>(0x6000 | draw.x), // V0 = x
+            static_cast<uint16_t>(0x6100 | draw.y), // V1 = y
+            0xA050, // I = font
+            static_cast<uint16_t>(0xD010 | draw.height), // Draw
+            0x1206, // Loop on the draw
+        });
+    }
+
+    bench_program(results, options, "micro/fx33", cycles, {
+        0x60FF, // V0 = 255
+        0xA300, // I = 0x300
+        0xF033, // BCD of V0
+        0x1204, // Loop on the BCD
+    });
+
+    bench_program(results, options, "micro/fx55", cycles, {
+        0xA300, // I = 0x300
+        0xFF55, // Store V0-VF
+        0x1202, // Loop on the store
+    });
+
+    bench_program(results, options, "micro/fx65", cycles, {
+        0xA300, // I = 0x300
+        0xFE65, // Load V0-VE
+        0x7F01, // VF += 1, so no two trips round are the same
+        0x1202, // Loop on the load
+    });
+
+    // Memory access outside the CPU
+    const uint64_t accesses = static_cast<uint64_t>(4000000 * options.scale);
+    Memory memory;
+
+    measure(results, options, "micro/memory_read", accesses, [&]()
+    {
+        uint64_t sum = 0;
+        for (uint64_t i = 0; i < accesses; ++i)
+        {
+            sum += memory.read(i & (MEMORY_SIZE - 1));
+        }
+        g_sink = sum;
+    });
+
+    measure(results, options, "micro/memory_write", accesses, [&]()
+    {
+        for (uint64_t i = 0; i < accesses; ++i)
+        {
+            memory.write(i & (MEMORY_SIZE - 1), static_cast<uint8_t>(i));
+        }
+        g_sink = memory.read(0);
+    });
+
+    // ROM loading, including the file read
+    const uint64_t loads = static_cast<uint64_t>(2000 * options.scale);
+    const std::string rom = options.roms_dir + "/tests/3-corax+.ch8";
+    Chip8 loader;
+
+    measure(results, options, "micro/load_rom", loads, [&]()
+    {
+        for (uint64_t i = 0; i < loads; ++i)
+        {
+            loader.load_rom(rom);
+        }
+        g_sink = loader.get_program_counter();
+    });
+
+    // Starting a machine from a cached, pre-decoded image instead
+    RomStore store;
+    const RomImage* image = store.load(rom, loader.get_quirks());
+
+    measure(results, options, "micro/load_rom_image", loads, [&]()
+    {
+        for (uint64_t i = 0; i < loads; ++i)
+        {
+            loader.load_rom_image(*image);
+        }
+        g_sink = loader.get_program_counter();
+    });
+
+    // The frontend's present stage, one frame per op: blending and palette
+    // alone (native size), then with upscaling to fit 1080p and 4K. The
+    // display changes every frame (a running ROM's screen, alternately with
+    // a sprite toggled)
+    const uint64_t frames = static_cast<uint64_t>(200 * options.scale);
+    auto screen = make_machine(options);
+    screen->load_rom(rom);
+    screen->run(100000);
+
+    Display toggled = screen->get_display();
+    toggled.draw_sprite(8, 8, FONT_SET, BYTES_PER_FONT_SPRITE, false, true);
+
+    const struct
+    {
+        const char* name;
+        unsigned int width;
+        unsigned int height;
+    } outputs[] = {
+        { "micro/present_native", 64, 32 },
+        { "micro/present_1080p", 1920, 1080 },
+        { "micro/present_2160p", 3840, 2160 },
+    };
+
+    for (const auto& output : outputs)
+    {
+        Presenter presenter;
+        PresentedImage image;
+        presenter.set_output_size(output.width, output.height);
+
+        measure(results, options, output.name, frames, [&]()
+        {
+            for (uint64_t i = 0; i < frames; ++i)
+            {
+                presenter.render(i & 1 ? toggled : screen->get_display(), image);
+            }
+            g_sink = image.pixels[0];
+        });
+    }
+}
+
+void macro_benchmarks(const BenchOptions& options, std::vector<BenchResult>& results)
+{
+    const uint64_t cycles = static_cast<uint64_t>(5000000 * options.scale);
+
+    const std::pair<const char*, const char*> roms[] = {
+        { "macro/chip8_logo", "tests/1-chip8-logo.ch8" },
+        { "macro/ibm_logo", "tests/2-ibm-logo.ch8" },
+        { "macro/corax", "tests/3-corax+.ch8" },
+        { "macro/flags", "tests/4-flags.ch8" },
+        { "macro/quirks", "tests/5-quirks.ch8" },
+        { "macro/keypad", "tests/6-keypad.ch8" },
+        { "macro/beep", "tests/7-beep.ch8" },
+        { "macro/pong", "Pong 2 (Pong hack) [David Winter, 1997].ch8" },
+    };
+
+    for (const auto& rom : roms)
+    {
+        auto chip8 = make_machine(options);
+        chip8->load_rom(options.roms_dir + "/" + rom.second);
+
+        // Frames of CPU_HZ / DISPLAY_HZ cycles with a timer tick each, the
+        // same shape of work as the frontend
+        measure(results, options, rom.first, cycles, [&]()
+        {
+            const double cycles_per_frame = CPU_HZ / DISPLAY_HZ;
+            double budget = 0.0;
+            uint64_t executed = 0;
+
+            while (executed < cycles)
+            {
+                budget += cycles_per_frame;
+                const uint64_t frame_cycles = std::min<uint64_t>(static_cast<uint64_t>(budget), cycles - executed);
+                budget -= static_cast<uint64_t>(budget);
+
+                chip8->run(frame_cycles);
+                chip8->decrement_timers();
+                executed += frame_cycles;
+            }
+        });
+    }
+}
+
+double ops_per_sec(const BenchResult& result)
+{
+    return result.seconds > 0.0 ? result.ops / result.seconds : 0.0;
+}
+
+double ns_per_op(const BenchResult& result)
+{
+    return result.ops > 0 ? result.seconds * 1e9 / result.ops : 0.0;
+}
+
+void write_json(std::ostream& out, const std::vector<BenchResult>& results, const BenchOptions& options)
+{
+    out << "{\n"
+        << "  \"engine\": \"" << (options.use_jit ? "jit" : "interpreter") << "\",\n"
+        << "  \"benchmarks\": [\n";
+
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        char line[256];
+        std::snprintf(line, sizeof(line),
+            "    {\"name\": \"%s\", \"ops\": %llu, \"seconds\": %.6f, \"ops_per_sec\": %.0f, \"ns_per_op\": %.3f}%s\n",
+            results[i].name.c_str(), static_cast<unsigned long long>(results[i].ops), results[i].seconds,
+            ops_per_sec(results[i]), ns_per_op(results[i]), i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+
+    out << "  ]\n"
+        << "}\n";
+}
+
+// Pull name -> ns_per_op out of a file written by write_json
+bool read_baseline(const std::string& filename, std::map<std::string, double>& baseline)
+{
+    std::ifstream file_in(filename);
+
+    if (!file_in.is_open())
+    {
+        return false;
+    }
+
+    std::string line;
+    while (std::getline(file_in, line))
+    {
+        const size_t name_at = line.find("\"name\": \"");
+        const size_t ns_at = line.find("\"ns_per_op\": ");
+        if (name_at == std::string::npos || ns_at == std::string::npos)
+        {
+            continue;
+        }
+
+        const size_t name_start = name_at + std::strlen("\"name\": \"");
+        const std::string name = line.substr(name_start, line.find('"', name_start) - name_start);
+        baseline[name] = std::strtod(line.c_str() + ns_at + std::strlen("\"ns_per_op\": "), nullptr);
+    }
+
+    return true;
+}
+
+// Print a comparison table; returns the number of regressions
+int compare(const std::vector<BenchResult>& results, const std::map<std::string, double>& baseline, double threshold)
+{
+    int regressions = 0;
+
+    std::fprintf(stderr, "%-32s %12s %12s %9s\n", "benchmark", "base ns/op", "ns/op", "change");
+
+    for (const BenchResult& result : results)
+    {
+        const auto it = baseline.find(result.name);
+        if (it == baseline.end() || it->second <= 0.0)
+        {
+            std::fprintf(stderr, "%-32s %12s %12.3f %9s\n", result.name.c_str(), "-", ns_per_op(result), "new");
+            continue;
+        }
+
+        const double change = (ns_per_op(result) - it->second) / it->second * 100.0;
+        const bool regressed = change > threshold;
+        regressions += regressed;
+
+        std::fprintf(stderr, "%-32s %12.3f %12.3f %+8.1f%%%s\n", result.name.c_str(), it->second,
+            ns_per_op(result), change, regressed ? "  REGRESSION" : "");
+    }
+
+    return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    std::string json_file;
+    std::string baseline_file;
+    double threshold = 5.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+        {
+            json_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--baseline") == 0 && i + 1 < argc)
+        {
+            baseline_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--threshold") == 0 && i + 1 < argc)
+        {
+            threshold = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--filter") == 0 && i + 1 < argc)
+        {
+            options.filter = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--roms") == 0 && i + 1 < argc)
+        {
+            options.roms_dir = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--scale") == 0 && i + 1 < argc)
+        {
+            options.scale = std::strtod(argv[++i], nullptr);
+        }
+        else if (std::strcmp(argv[i], "--jit") == 0)
+        {
+            options.use_jit = true;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_file.empty() && !read_baseline(baseline_file, baseline))
+    {
+        std::cerr << "Failed to read baseline " << baseline_file << std::endl;
+        return 1;
+    }
+
+    std::vector<BenchResult> results;
+    micro_benchmarks(options, results);
+    macro_benchmarks(options, results);
+
+    if (json_file.empty())
+    {
+        write_json(std::cout, results, options);
+    }
+    else
+    {
+        std::ofstream out(json_file);
+        if (!out.is_open())
+        {
+            std::cerr << "Failed to open output file " << json_file << std::endl;
+            return 1;
+        }
+        write_json(out, results, options);
+    }
+
+    if (!baseline_file.empty())
+    {
+        const int regressions = compare(results, baseline, threshold);
+        if (regressions > 0)
+        {
+            std::cerr << regressions << " regression(s) over " << threshold << "%" << std::endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
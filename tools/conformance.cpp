@@ -0,0 +1,378 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "chip8.h"
+#include "constants.h"
+#include "rom_store.h"
+#include "thread_pool.h"
+
+// Conformance runner: runs every test case (a ROM, a quirk profile and
+// optionally some scripted key presses) for a fixed number of cycles,
+// hashes the display at fixed checkpoints and compares the hashes against
+// the golden values stored with the cases. Cases run in parallel; the whole
+// suite takes a few milliseconds, so it can run on every build
+//
+// Case file: one case per line, "<rom> <quirks> [press=K@CYCLE,...] [: hashes]"
+// ROM paths are relative to the case file; lines starting with # are
+// comments. press=K@CYCLE holds key K (hex) down from CYCLE for PRESS_CYCLES,
+// for ROMs that start with a menu. --update fills in / replaces the hashes
+
+namespace
+{
+    // Cycles between display hashes, and how many are taken
+    const uint64_t CHECKPOINT_CYCLES = 25000;
+    const unsigned int CHECKPOINTS = 8;
+
+    // How long a scripted key press is held
+    const uint64_t PRESS_CYCLES = 1000;
+
+    // Fixed, so ROMs that use CXNN hash the same on every run
+    const uint64_t CONFORMANCE_SEED = 0;
+}
+
+struct KeyPress
+{
+    uint64_t cycle;
+    uint8_t key;
+};
+
+struct Case
+{
+    size_t line; // Index into the case file's lines
+    std::string rom;
+    QuirkProfile quirks;
+    std::string presses_text;
+    std::vector<KeyPress> presses;
+    std::vector<uint64_t> expected;
+
+    const RomImage* image;
+    std::vector<uint64_t> hashes;
+};
+
+void print_usage()
+{
+    std::cerr << "Usage: chip8_conformance [case file] [-j threads] [--jit] [--update]\n"
+              << "  case file  Test cases and golden hashes (default roms/tests/conformance.txt)\n"
+              << "  -j N       Worker threads (default: one per core)\n"
+              << "  --jit      Run the cases through the JIT instead of the interpreter\n"
+              << "  --update   Write the hashes this build produces back to the case file\n";
+}
+
+// "press=1@2000,2@30000"
+bool parse_presses(const std::string& text, std::vector<KeyPress>& presses)
+{
+    std::stringstream list(text.substr(std::strlen("press=")));
+    std::string item;
+
+    while (std::getline(list, item, ','))
+    {
+        const size_t at = item.find('@');
+        if (at == std::string::npos)
+        {
+            return false;
+        }
+
+        KeyPress press;
+        press.key = std::strtoul(item.substr(0, at).c_str(), nullptr, 16) & 0xF;
+        press.cycle = std::strtoull(item.substr(at + 1).c_str(), nullptr, 10);
+        presses.push_back(press);
+    }
+
+    std::sort(presses.begin(), presses.end(), [](const KeyPress& a, const KeyPress& b)
+    {
+        return a.cycle < b.cycle;
+    });
+    return true;
+}
+
+bool parse_case(const std::string& line, const std::string& directory, Case& test)
+{
+    std::istringstream fields(line);
+    std::string rom, quirks, field;
+
+    if (!(fields >> rom >> quirks) || !parse_quirk_profile(quirks.c_str(), test.quirks))
+    {
+        return false;
+    }
+    test.rom = directory + rom;
+
+    bool hashes = false;
+    while (fields >> field)
+    {
+        if (hashes)
+        {
+            test.expected.push_back(std::strtoull(field.c_str(), nullptr, 16));
+        }
+        else if (field == ":")
+        {
+            hashes = true;
+        }
+        else if (field.compare(0, 6, "press=") == 0 && parse_presses(field, test.presses))
+        {
+            test.presses_text = field;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Display hash at every checkpoint
+std::vector<uint64_t> run_case(Chip8& chip8, const Case& test)
+{
+    chip8.load_rom_image(*test.image);
+
+    // Key downs and ups in cycle order
+    struct KeyEvent
+    {
+        uint64_t cycle;
+        uint8_t key;
+        bool down;
+    };
+    std::vector<KeyEvent> events;
+    for (const KeyPress& press : test.presses)
+    {
+        events.push_back({ press.cycle, press.key, true });
+        events.push_back({ press.cycle + PRESS_CYCLES, press.key, false });
+    }
+    std::stable_sort(events.begin(), events.end(), [](const KeyEvent& a, const KeyEvent& b)
+    {
+        return a.cycle < b.cycle;
+    });
+
+    std::vector<uint64_t> hashes;
+    uint64_t executed = 0;
+    size_t next_event = 0;
+
+    for (unsigned int checkpoint = 1; checkpoint <= CHECKPOINTS; ++checkpoint)
+    {
+        const uint64_t target = checkpoint * CHECKPOINT_CYCLES;
+
+        while (executed < target)
+        {
+            const uint64_t stop = next_event < events.size() ? std::min(target, events[next_event].cycle) : target;
+            if (stop > executed)
+            {
+                chip8.run_timed(stop - executed);
+                executed = stop;
+            }
+
+            for (; next_event < events.size() && events[next_event].cycle <= executed; ++next_event)
+            {
+                if (events[next_event].down)
+                {
+                    chip8.keydown(events[next_event].key);
+                }
+                else
+                {
+                    chip8.keyup(events[next_event].key);
+                }
+            }
+        }
+
+        hashes.push_back(chip8.get_display_hash());
+    }
+
+    return hashes;
+}
+
+std::string format_hash(uint64_t hash)
+{
+    char text[17];
+    std::snprintf(text, sizeof(text), "%016llx", static_cast<unsigned long long>(hash));
+    return text;
+}
+
+std::string describe(const Case& test, const std::string& directory)
+{
+    std::string text = test.rom.substr(directory.size()) + " " + quirk_profile_name(test.quirks);
+    if (!test.presses_text.empty())
+    {
+        text += " " + test.presses_text;
+    }
+    return text;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string case_file = "roms/tests/conformance.txt";
+    size_t thread_count = 0;
+    bool use_jit = false;
+    bool update = false;
+    bool case_file_given = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+        {
+            thread_count = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--jit") == 0)
+        {
+            use_jit = true;
+        }
+        else if (std::strcmp(argv[i], "--update") == 0)
+        {
+            update = true;
+        }
+        else if (argv[i][0] != '-' && !case_file_given)
+        {
+            case_file = argv[i];
+            case_file_given = true;
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::ifstream file_in(case_file);
+    if (!file_in.is_open())
+    {
+        std::cerr << "Failed to open case file " << case_file << std::endl;
+        return 1;
+    }
+
+    const size_t slash = case_file.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "" : case_file.substr(0, slash + 1);
+
+    std::vector<std::string> lines;
+    std::vector<Case> cases;
+    RomStore roms;
+
+    std::string line;
+    while (std::getline(file_in, line))
+    {
+        lines.push_back(line);
+
+        const size_t first = line.find_first_not_of(" \t");
+        if (first == std::string::npos || line[first] == '#')
+        {
+            continue;
+        }
+
+        Case test;
+        test.line = lines.size() - 1;
+        if (!parse_case(line, directory, test))
+        {
+            std::cerr << case_file << ":" << lines.size() << ": can't parse \"" << line << "\"" << std::endl;
+            return 1;
+        }
+
+        test.image = roms.load(test.rom, test.quirks);
+        if (!test.image)
+        {
+            return 1;
+        }
+
+        cases.push_back(test);
+    }
+    file_in.close();
+
+    WorkStealingPool pool(thread_count);
+
+    // One reusable instance per worker, as in chip8_batch
+    std::vector<std::unique_ptr<Chip8>> instances;
+    for (size_t i = 0; i < pool.get_thread_count(); ++i)
+    {
+        instances.push_back(std::make_unique<Chip8>());
+        if (use_jit && !instances.back()->enable_jit())
+        {
+            std::cerr << "JIT not available on this host; using the interpreter" << std::endl;
+            use_jit = false;
+        }
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+
+    pool.run(cases.size(), [&](size_t index, size_t worker)
+    {
+        Chip8& chip8 = *instances[worker];
+        chip8.reset();
+        chip8.set_quirks(cases[index].quirks);
+        chip8.seed(CONFORMANCE_SEED);
+        cases[index].hashes = run_case(chip8, cases[index]);
+    });
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    if (update)
+    {
+        for (const Case& test : cases)
+        {
+            std::string updated = describe(test, directory) + " :";
+            for (const uint64_t hash : test.hashes)
+            {
+                updated += " " + format_hash(hash);
+            }
+            lines[test.line] = updated;
+        }
+
+        std::ofstream file_out(case_file, std::ios::trunc);
+        for (const std::string& text : lines)
+        {
+            file_out << text << '\n';
+        }
+        if (!file_out)
+        {
+            std::cerr << "Failed to write case file " << case_file << std::endl;
+            return 1;
+        }
+
+        std::cout << "updated " << cases.size() << " cases in " << case_file << '\n';
+        return 0;
+    }
+
+    size_t passed = 0;
+    for (const Case& test : cases)
+    {
+        // The first checkpoint that differs says roughly when things went
+        // wrong; later ones usually differ too
+        unsigned int failed_at = 0;
+        for (unsigned int i = 0; i < CHECKPOINTS && failed_at == 0; ++i)
+        {
+            if (i >= test.expected.size() || test.hashes[i] != test.expected[i])
+            {
+                failed_at = i + 1;
+            }
+        }
+
+        if (failed_at == 0)
+        {
+            ++passed;
+            std::cout << "PASS " << describe(test, directory) << '\n';
+            continue;
+        }
+
+        std::cout << "FAIL " << describe(test, directory) << ": checkpoint " << failed_at << " (cycle "
+                  << failed_at * CHECKPOINT_CYCLES << ") hash " << format_hash(test.hashes[failed_at - 1]);
+        if (failed_at <= test.expected.size())
+        {
+            std::cout << ", expected " << format_hash(test.expected[failed_at - 1]);
+        }
+        else
+        {
+            std::cout << ", no golden hash (run with --update)";
+        }
+        std::cout << '\n';
+    }
+
+    std::cout << passed << "/" << cases.size() << " passed in " << elapsed.count() << " s ("
+              << pool.get_thread_count() << " threads" << (use_jit ? ", JIT" : "") << ")\n";
+
+    return passed == cases.size() ? 0 : 1;
+}
@@ -0,0 +1,454 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "chip8.h"
+#include "chip8_batch.h"
+#include "constants.h"
+#include "frame_capture.h"
+#include "save_state.h"
+#include "input_log.h"
+#include "rom_store.h"
+#include "tracer.h"
+
+// Headless runner: executes a ROM as fast as the host allows (no CPU_HZ
+// throttle, no window) and reports interpreter throughput
+
+namespace
+{
+    // Unthrottled, the emulation makes frames far faster than any encoder
+    // can write them, and capture drops frames rather than wait. A ring
+    // this big (8 MB) holds over a minute of distinct frames, so typical
+    // clips come out whole
+    const size_t HEADLESS_CAPTURE_CAPACITY = 4096;
+}
+
+void print_usage()
+{
+    std::cerr << "Usage: chip8_headless <rom> [--cycles N | --frames N] [--jit | --aot] [--lanes N] [--dump]\n"
+              << "                      [--load-state FILE] [--save-state FILE]\n"
+              << "                      [--seed N] [--replay FILE] [--profile FILE] [--trace FILE]\n"
+              << "                      [--quirks vip|chip48|schip|xochip] [--capture FILE [--capture-scale N]]\n"
+              << "                      [--skip-idle]\n"
+              << "  --cycles N  Execute N CPU cycles (default 10000000)\n"
+              << "  --frames N  Execute N frames of CPU_HZ / DISPLAY_HZ cycles each,\n"
+              << "              decrementing the timers once per frame\n"
+              << "  --jit       Execute through the x86-64 JIT\n"
+              << "  --aot       Execute through the ahead-of-time translation of the ROM\n"
+              << "              compiled into this binary (see CHIP8_AOT_ROMS)\n"
+              << "  --lanes N   Run N copies of the ROM in lockstep on the batch engine\n"
+              << "              (classic CHIP-8 only); cycles/sec counts every lane's cycles\n"
+              << "  --dump      Print the final display buffer as text\n"
+              << "  --quirks P  Follow the COSMAC VIP, CHIP-48, SUPER-CHIP (default) or\n"
+              << "              XO-CHIP interpreter's behavior\n"
+              << "  --load-state FILE  Start from a save state instead of loading the ROM\n"
+              << "                     (the ROM argument may then be omitted)\n"
+              << "  --save-state FILE  Write a save state after the run\n"
+              << "  --seed N           Seed the random number generator (deterministic run)\n"
+              << "  --replay FILE      Replay a recorded input log instead of running\n"
+              << "                     --cycles / --frames\n"
+              << "  --profile FILE     Write opcode/PC/draw statistics as JSON (or CSV if\n"
+              << "                     FILE ends in .csv); needs a CHIP8_INSTRUMENT build\n"
+              << "  --trace FILE       Record every executed instruction to FILE (read it\n"
+              << "                     with chip8_trace); runs on the interpreter\n"
+              << "  --capture FILE     Record the display every frame (--frames / --replay) as\n"
+              << "                     video: .avi, .y4m, or raw RGB24 for anything else\n"
+              << "  --capture-scale N  Capture at N times 128x64 (default 1)\n"
+              << "  --skip-idle        Skip idle loops (as the frontend does) instead of\n"
+              << "                     executing every cycle; cycles/sec then counts\n"
+              << "                     skipped cycles too\n";
+}
+
+// Low resolution plane 0 rows (the batch engine's display)
+void dump_display(const uint64_t* rows)
+{
+    for (unsigned int y = 0; y < DISPLAY_HEIGHT; ++y)
+    {
+        std::string line;
+        for (unsigned int x = 0; x < DISPLAY_WIDTH; ++x)
+        {
+            line += (rows[y] >> (DISPLAY_WIDTH - 1 - x)) & 1 ? '#' : '.';
+        }
+        std::cout << line << '\n';
+    }
+}
+
+// Any resolution; pixels lit on plane 1 only, or on both planes, print as
+// '+' and '@', so single-plane screens dump exactly as they always have
+void dump_display(const Display& display)
+{
+    static const char symbols[] = { '.', '#', '+', '@' };
+
+    for (unsigned int y = 0; y < display.get_height(); ++y)
+    {
+        std::string line;
+        for (unsigned int x = 0; x < display.get_width(); ++x)
+        {
+            line += symbols[display.get_pixel(x, y)];
+        }
+        std::cout << line << '\n';
+    }
+}
+
+bool write_profile(const Chip8& chip8, const std::string& filename)
+{
+    if (!CpuProbe::ENABLED)
+    {
+        std::cerr << "Built without CHIP8_INSTRUMENT; the profile will be empty" << std::endl;
+    }
+
+    std::ofstream out(filename);
+    if (!out.is_open())
+    {
+        std::cerr << "Failed to open profile file " << filename << std::endl;
+        return false;
+    }
+
+    const bool csv = filename.size() >= 4 && filename.compare(filename.size() - 4, 4, ".csv") == 0;
+    if (csv)
+    {
+        chip8.get_probe().write_csv(out);
+    }
+    else
+    {
+        chip8.get_probe().write_json(out);
+    }
+
+    return true;
+}
+
+// Works for both Chip8 and Chip8Batch; returns the cycles executed per machine
+template <typename Machine>
+uint64_t run_machine(Machine& machine, uint64_t cycles, uint64_t frames)
+{
+    if (frames == 0)
+    {
+        machine.run(cycles);
+        return cycles;
+    }
+
+    // CPU_HZ / DISPLAY_HZ isn't a whole number (700 / 60), so carry the
+    // fractional cycles over to the next frame
+    const double cycles_per_frame = CPU_HZ / DISPLAY_HZ;
+    double budget = 0.0;
+    uint64_t executed = 0;
+
+    for (uint64_t frame = 0; frame < frames; ++frame)
+    {
+        budget += cycles_per_frame;
+        const uint64_t frame_cycles = static_cast<uint64_t>(budget);
+        budget -= frame_cycles;
+
+        machine.run(frame_cycles);
+        machine.decrement_timers();
+        executed += frame_cycles;
+    }
+
+    return executed;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string rom;
+    uint64_t cycles = 10000000;
+    uint64_t frames = 0;
+    bool dump = false;
+    bool use_jit = false;
+    bool use_aot = false;
+    size_t lanes = 0;
+    std::string load_state_file;
+    std::string save_state_file;
+    std::string replay_file;
+    std::string profile_file;
+    std::string trace_file;
+    std::string capture_file;
+    unsigned int capture_scale = FrameCapture::DEFAULT_SCALE;
+    bool skip_idle = false;
+    bool seeded = false;
+    uint64_t seed = 0;
+    QuirkProfile quirks = DEFAULT_QUIRK_PROFILE;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+        {
+            cycles = std::strtoull(argv[++i], nullptr, 10);
+            frames = 0;
+        }
+        else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+        {
+            frames = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--jit") == 0)
+        {
+            use_jit = true;
+        }
+        else if (std::strcmp(argv[i], "--aot") == 0)
+        {
+            use_aot = true;
+        }
+        else if (std::strcmp(argv[i], "--lanes") == 0 && i + 1 < argc)
+        {
+            lanes = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--load-state") == 0 && i + 1 < argc)
+        {
+            load_state_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--save-state") == 0 && i + 1 < argc)
+        {
+            save_state_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--seed") == 0 && i + 1 < argc)
+        {
+            seed = std::strtoull(argv[++i], nullptr, 0);
+            seeded = true;
+        }
+        else if (std::strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+        {
+            replay_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+        {
+            profile_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+        {
+            trace_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+        {
+            capture_file = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--capture-scale") == 0 && i + 1 < argc)
+        {
+            capture_scale = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (std::strcmp(argv[i], "--quirks") == 0 && i + 1 < argc)
+        {
+            if (!parse_quirk_profile(argv[++i], quirks))
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--skip-idle") == 0)
+        {
+            skip_idle = true;
+        }
+        else if (std::strcmp(argv[i], "--dump") == 0)
+        {
+            dump = true;
+        }
+        else if (argv[i][0] != '-' && rom.empty())
+        {
+            rom = argv[i];
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (rom.empty() && load_state_file.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    uint64_t executed = 0;
+    double seconds = 0.0;
+
+    if (lanes > 0)
+    {
+        if (use_jit || use_aot)
+        {
+            std::cerr << "--jit and --aot are ignored with --lanes" << std::endl;
+        }
+        if (!load_state_file.empty() || !save_state_file.empty() || !replay_file.empty() || !profile_file.empty() ||
+            !trace_file.empty() || !capture_file.empty())
+        {
+            std::cerr << "Save states, replays, profiles, traces and captures are not supported with --lanes" << std::endl;
+            return 1;
+        }
+
+        Chip8Batch batch(lanes);
+        batch.set_quirks(quirks);
+        if (!batch.load_rom(rom))
+        {
+            return 1;
+        }
+
+        if (seeded)
+        {
+            batch.seed(seed);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        executed = run_machine(batch, cycles, frames) * lanes;
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        seconds = elapsed.count();
+
+        if (dump)
+        {
+            dump_display(batch.get_display_rows(0));
+        }
+    }
+    else
+    {
+        Chip8 chip8;
+        chip8.set_quirks(quirks);
+
+        // A throughput figure only means something if every cycle counted
+        // really ran
+        chip8.set_idle_skipping(skip_idle);
+
+        if (!load_state_file.empty())
+        {
+            const MappedSaveState state(load_state_file);
+            if (!state.get() || !chip8.load_state(*state.get()))
+            {
+                std::cerr << "Failed to load save state " << load_state_file << std::endl;
+                return 1;
+            }
+        }
+        else if (!chip8.load_rom(rom))
+        {
+            return 1;
+        }
+
+        if (use_jit && !chip8.enable_jit())
+        {
+            std::cerr << "JIT not available on this host; using the interpreter" << std::endl;
+        }
+
+        if (use_aot)
+        {
+            // Programs are matched on the ROM's bytes, so the ROM is needed
+            // even when starting from a save state
+            const RomFile image(rom);
+            const AotProgram* program = image.is_valid() ? find_aot_program(image.data(), image.size()) : nullptr;
+
+            if (!program)
+            {
+                std::cerr << "No ahead-of-time translation of " << (rom.empty() ? "the ROM" : rom)
+                          << " in this binary; using the interpreter" << std::endl;
+            }
+            else if (!chip8.enable_aot(*program))
+            {
+                std::cerr << "Ahead-of-time code not available in this build; using the interpreter" << std::endl;
+            }
+        }
+
+        if (seeded)
+        {
+            chip8.seed(seed);
+        }
+
+        InputLog log;
+        if (!replay_file.empty() && !log.load(replay_file))
+        {
+            std::cerr << "Failed to load input log " << replay_file << std::endl;
+            return 1;
+        }
+
+        // The ring buffer is a few megabytes; only made when tracing
+        std::unique_ptr<Tracer> tracer;
+        if (!trace_file.empty())
+        {
+            tracer = std::make_unique<Tracer>();
+            if (!tracer->open(trace_file))
+            {
+                std::cerr << "Failed to open trace file " << trace_file << std::endl;
+                return 1;
+            }
+            chip8.start_tracing(*tracer);
+        }
+
+        // Frames are timer ticks, so --cycles alone captures nothing
+        std::unique_ptr<FrameCapture> capture;
+        if (!capture_file.empty())
+        {
+            if (frames == 0 && replay_file.empty())
+            {
+                std::cerr << "--capture needs --frames or --replay" << std::endl;
+                return 1;
+            }
+
+            capture = std::make_unique<FrameCapture>(HEADLESS_CAPTURE_CAPACITY);
+            if (!capture->open(capture_file, capture_scale))
+            {
+                std::cerr << "Failed to open capture file " << capture_file << std::endl;
+                return 1;
+            }
+            chip8.start_capture(*capture);
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        if (!replay_file.empty())
+        {
+            chip8.replay(log);
+            executed = log.get_cycle_count();
+        }
+        else
+        {
+            executed = run_machine(chip8, cycles, frames);
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        seconds = elapsed.count();
+
+        if (tracer)
+        {
+            chip8.stop_tracing();
+            tracer->close();
+            std::cerr << "Traced " << tracer->get_record_count() << " instructions ("
+                      << tracer->get_stall_count() << " waits for the writer)" << std::endl;
+        }
+
+        if (capture)
+        {
+            chip8.stop_capture();
+            capture->close();
+            std::cerr << "Captured " << capture->get_frame_count() << " frames at " << capture->get_width() << "x"
+                      << capture->get_height() << " (" << capture->get_repeat_count() << " repeats, "
+                      << capture->get_dropped_count() << " dropped while the writer was behind)" << std::endl;
+            if (capture->is_truncated())
+            {
+                std::cerr << "The AVI file reached its size limit; later frames are missing" << std::endl;
+            }
+        }
+
+        if (dump)
+        {
+            dump_display(chip8.get_display());
+        }
+
+        if (!profile_file.empty() && !write_profile(chip8, profile_file))
+        {
+            return 1;
+        }
+
+        if (!save_state_file.empty())
+        {
+            SaveState state;
+            chip8.save_state(state);
+            if (!write_save_state(save_state_file, state))
+            {
+                std::cerr << "Failed to write save state " << save_state_file << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::cout << "cycles: " << executed << '\n'
+              << "seconds: " << seconds << '\n'
+              << "cycles/sec: " << (seconds > 0.0 ? executed / seconds : 0.0) << '\n';
+
+    return 0;
+}
@@ -0,0 +1,354 @@
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "constants.h"
+#include "decoder.h"
+#include "tracer.h"
+
+// Trace decoder: reads an execution trace written by chip8_headless --trace
+// (or the frontend's --trace), filters it and prints one disassembled line
+// per instruction with the registers it changed:
+//
+//   cycle      addr  opcode  instruction       changes
+//   1042       0x208 7A01    ADD VA, 0x01      VA=06
+
+void print_usage()
+{
+    std::cerr << "Usage: chip8_trace <trace file> [--from CYCLE] [--to CYCLE] [--pc ADDR[-ADDR]]\n"
+              << "                   [--op NAME] [--writes VX] [--limit N] [--stats]\n"
+              << "  --from / --to  Only instructions executed at cycles in this range\n"
+              << "  --pc           Only instructions at this address (or range)\n"
+              << "  --op           Only this operation, by its opcode pattern (e.g. DXYN, FX0A)\n"
+              << "  --writes       Only instructions that changed this register (e.g. VF, I)\n"
+              << "  --limit N      Stop after printing N instructions\n"
+              << "  --stats        Print per-operation counts instead of the listing\n";
+}
+
+// Cowgod-style mnemonics; SUPER-CHIP and XO-CHIP additions use Octo's names
+std::string disassemble(uint16_t opcode)
+{
+    const Instruction instruction = decode(opcode);
+    char text[32];
+
+    const unsigned int X = instruction.X;
+    const unsigned int Y = instruction.Y;
+    const unsigned int N = opcode & 0xF;
+    const unsigned int NN = instruction.NN;
+    const unsigned int NNN = instruction.NNN;
+
+    switch (instruction.op)
+    {
+    case OP_00E0: return "CLS";
+    case OP_00EE: return "RET";
+    case OP_00CN: std::snprintf(text, sizeof(text), "SCD %u", N); break;
+    case OP_00DN: std::snprintf(text, sizeof(text), "SCU %u", N); break;
+    case OP_00FB: return "SCR";
+    case OP_00FC: return "SCL";
+    case OP_00FD: return "EXIT";
+    case OP_00FE: return "LOW";
+    case OP_00FF: return "HIGH";
+    case OP_1NNN: std::snprintf(text, sizeof(text), "JP 0x%03X", NNN); break;
+    case OP_2NNN: std::snprintf(text, sizeof(text), "CALL 0x%03X", NNN); break;
+    case OP_3XNN: std::snprintf(text, sizeof(text), "SE V%X, 0x%02X", X, NN); break;
+    case OP_4XNN: std::snprintf(text, sizeof(text), "SNE V%X, 0x%02X", X, NN); break;
+    case OP_5XY0: std::snprintf(text, sizeof(text), "SE V%X, V%X", X, Y); break;
+    case OP_5XY2: std::snprintf(text, sizeof(text), "SAVE V%X-V%X", X, Y); break;
+    case OP_5XY3: std::snprintf(text, sizeof(text), "LOAD V%X-V%X", X, Y); break;
+    case OP_6XNN: std::snprintf(text, sizeof(text), "LD V%X, 0x%02X", X, NN); break;
+    case OP_7XNN: std::snprintf(text, sizeof(text), "ADD V%X, 0x%02X", X, NN); break;
+    case OP_8XY0: std::snprintf(text, sizeof(text), "LD V%X, V%X", X, Y); break;
+    case OP_8XY1: std::snprintf(text, sizeof(text), "OR V%X, V%X", X, Y); break;
+    case OP_8XY2: std::snprintf(text, sizeof(text), "AND V%X, V%X", X, Y); break;
+    case OP_8XY3: std::snprintf(text, sizeof(text), "XOR V%X, V%X", X, Y); break;
+    case OP_8XY4: std::snprintf(text, sizeof(text), "ADD V%X, V%X", X, Y); break;
+    case OP_8XY5: std::snprintf(text, sizeof(text), "SUB V%X, V%X", X, Y); break;
+    case OP_8XY6: std::snprintf(text, sizeof(text), "SHR V%X, V%X", X, Y); break;
+    case OP_8XY7: std::snprintf(text, sizeof(text), "SUBN V%X, V%X", X, Y); break;
+    case OP_8XYE: std::snprintf(text, sizeof(text), "SHL V%X, V%X", X, Y); break;
+    case OP_9XY0: std::snprintf(text, sizeof(text), "SNE V%X, V%X", X, Y); break;
+    case OP_ANNN: std::snprintf(text, sizeof(text), "LD I, 0x%03X", NNN); break;
+    case OP_BNNN: std::snprintf(text, sizeof(text), "JP V0, 0x%03X", NNN); break;
+    case OP_CXNN: std::snprintf(text, sizeof(text), "RND V%X, 0x%02X", X, NN); break;
+    case OP_DXYN: std::snprintf(text, sizeof(text), "DRW V%X, V%X, %u", X, Y, N); break;
+    case OP_DXY0: std::snprintf(text, sizeof(text), "DRW V%X, V%X, 0", X, Y); break;
+    case OP_EX9E: std::snprintf(text, sizeof(text), "SKP V%X", X); break;
+    case OP_EXA1: std::snprintf(text, sizeof(text), "SKNP V%X", X); break;
+    case OP_F000: return "LD I, long";
+    case OP_FN01: std::snprintf(text, sizeof(text), "PLANE %u", X); break;
+    case OP_F002: return "AUDIO";
+    case OP_FX07: std::snprintf(text, sizeof(text), "LD V%X, DT", X); break;
+    case OP_FX0A: std::snprintf(text, sizeof(text), "LD V%X, K", X); break;
+    case OP_FX15: std::snprintf(text, sizeof(text), "LD DT, V%X", X); break;
+    case OP_FX18: std::snprintf(text, sizeof(text), "LD ST, V%X", X); break;
+    case OP_FX1E: std::snprintf(text, sizeof(text), "ADD I, V%X", X); break;
+    case OP_FX29: std::snprintf(text, sizeof(text), "LD F, V%X", X); break;
+    case OP_FX30: std::snprintf(text, sizeof(text), "LD HF, V%X", X); break;
+    case OP_FX33: std::snprintf(text, sizeof(text), "LD B, V%X", X); break;
+    case OP_FX3A: std::snprintf(text, sizeof(text), "PITCH V%X", X); break;
+    case OP_FX55: std::snprintf(text, sizeof(text), "LD [I], V%X", X); break;
+    case OP_FX65: std::snprintf(text, sizeof(text), "LD V%X, [I]", X); break;
+    case OP_FX75: std::snprintf(text, sizeof(text), "LD R, V%X", X); break;
+    case OP_FX85: std::snprintf(text, sizeof(text), "LD V%X, R", X); break;
+    default: std::snprintf(text, sizeof(text), "DW 0x%04X", opcode); break;
+    }
+
+    return text;
+}
+
+// "0x200-0x2FF", "0x200" or decimal; false if it doesn't parse
+bool parse_range(const char* text, uint64_t& low, uint64_t& high)
+{
+    char* end;
+    low = std::strtoull(text, &end, 0);
+    if (end == text)
+    {
+        return false;
+    }
+
+    high = low;
+    if (*end == '-')
+    {
+        const char* second = end + 1;
+        high = std::strtoull(second, &end, 0);
+        if (end == second)
+        {
+            return false;
+        }
+    }
+    return *end == '\0' && low <= high;
+}
+
+bool parse_op(const char* text, Op& op)
+{
+    std::string name(text);
+    std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return std::toupper(c); });
+
+    for (int i = 0; i < OP_COUNT; ++i)
+    {
+        std::string candidate(op_name(static_cast<Op>(i)));
+        std::transform(candidate.begin(), candidate.end(), candidate.begin(), [](unsigned char c) { return std::toupper(c); });
+
+        if (candidate == name)
+        {
+            op = static_cast<Op>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// "V0".."VF" as a register number, "I" as NUMBER_OF_REGISTERS
+bool parse_register(const char* text, unsigned int& reg)
+{
+    if ((text[0] == 'I' || text[0] == 'i') && text[1] == '\0')
+    {
+        reg = NUMBER_OF_REGISTERS;
+        return true;
+    }
+    if ((text[0] != 'V' && text[0] != 'v') || !std::isxdigit(static_cast<unsigned char>(text[1])) || text[2] != '\0')
+    {
+        return false;
+    }
+    reg = std::strtoul(text + 1, nullptr, 16);
+    return true;
+}
+
+void print_entry(const TraceEntry& entry)
+{
+    char line[128];
+    std::snprintf(line, sizeof(line), "%-10llu 0x%03X %04X    %-17s", static_cast<unsigned long long>(entry.cycle),
+        entry.address, entry.opcode, disassemble(entry.opcode).c_str());
+
+    std::string changes;
+    for (unsigned int r = 0; r < NUMBER_OF_REGISTERS; ++r)
+    {
+        if ((entry.changed >> r) & 1)
+        {
+            char change[16];
+            std::snprintf(change, sizeof(change), " V%X=%02X", r, entry.registers[r]);
+            changes += change;
+        }
+    }
+    if (entry.index_changed)
+    {
+        char change[16];
+        std::snprintf(change, sizeof(change), " I=%03X", entry.index_register);
+        changes += change;
+    }
+
+    if (changes.empty())
+    {
+        std::string bare(line);
+        bare.erase(bare.find_last_not_of(' ') + 1);
+        std::cout << bare << '\n';
+        return;
+    }
+
+    std::cout << line << changes << '\n';
+}
+
+int main(int argc, char* argv[])
+{
+    std::string trace_file;
+    uint64_t from = 0;
+    uint64_t to = UINT64_MAX;
+    uint64_t pc_low = 0;
+    uint64_t pc_high = UINT64_MAX;
+    bool filter_op = false;
+    Op op = OP_INVALID;
+    bool filter_register = false;
+    unsigned int written_register = 0;
+    uint64_t limit = UINT64_MAX;
+    bool stats = false;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--from") == 0 && i + 1 < argc)
+        {
+            from = std::strtoull(argv[++i], nullptr, 0);
+        }
+        else if (std::strcmp(argv[i], "--to") == 0 && i + 1 < argc)
+        {
+            to = std::strtoull(argv[++i], nullptr, 0);
+        }
+        else if (std::strcmp(argv[i], "--pc") == 0 && i + 1 < argc)
+        {
+            if (!parse_range(argv[++i], pc_low, pc_high))
+            {
+                print_usage();
+                return 1;
+            }
+        }
+        else if (std::strcmp(argv[i], "--op") == 0 && i + 1 < argc)
+        {
+            if (!parse_op(argv[++i], op))
+            {
+                std::cerr << "Unknown operation " << argv[i] << std::endl;
+                return 1;
+            }
+            filter_op = true;
+        }
+        else if (std::strcmp(argv[i], "--writes") == 0 && i + 1 < argc)
+        {
+            if (!parse_register(argv[++i], written_register))
+            {
+                print_usage();
+                return 1;
+            }
+            filter_register = true;
+        }
+        else if (std::strcmp(argv[i], "--limit") == 0 && i + 1 < argc)
+        {
+            limit = std::strtoull(argv[++i], nullptr, 0);
+        }
+        else if (std::strcmp(argv[i], "--stats") == 0)
+        {
+            stats = true;
+        }
+        else if (argv[i][0] != '-' && trace_file.empty())
+        {
+            trace_file = argv[i];
+        }
+        else
+        {
+            print_usage();
+            return 1;
+        }
+    }
+
+    if (trace_file.empty())
+    {
+        print_usage();
+        return 1;
+    }
+
+    TraceReader reader;
+    if (!reader.open(trace_file))
+    {
+        std::cerr << "Failed to open trace " << trace_file << " (missing, or not a trace file)" << std::endl;
+        return 1;
+    }
+
+    uint64_t matched = 0;
+    uint64_t op_counts[OP_COUNT] = {};
+    uint64_t first_cycle = 0;
+    uint64_t last_cycle = 0;
+
+    TraceEntry entry;
+    while (matched < limit && reader.next(entry))
+    {
+        // Cycles only go up, so nothing after this can match
+        if (entry.cycle > to)
+        {
+            break;
+        }
+
+        const Op entry_op = decode_op(entry.opcode);
+        const bool wrote = written_register == NUMBER_OF_REGISTERS ? entry.index_changed
+                                                                   : ((entry.changed >> written_register) & 1);
+
+        if (entry.cycle < from || entry.address < pc_low || entry.address > pc_high ||
+            (filter_op && entry_op != op) || (filter_register && !wrote))
+        {
+            continue;
+        }
+
+        if (matched == 0)
+        {
+            first_cycle = entry.cycle;
+        }
+        last_cycle = entry.cycle;
+        ++matched;
+
+        if (stats)
+        {
+            ++op_counts[entry_op];
+        }
+        else
+        {
+            print_entry(entry);
+        }
+    }
+
+    if (reader.is_corrupt())
+    {
+        std::cerr << "Trace ends with a partial record (cut short while writing?)" << std::endl;
+    }
+
+    if (stats)
+    {
+        std::cout << "instructions: " << matched << '\n';
+        if (matched > 0)
+        {
+            std::cout << "cycles: " << first_cycle << "-" << last_cycle << '\n';
+        }
+
+        std::vector<std::pair<uint64_t, int>> counts;
+        for (int i = 0; i < OP_COUNT; ++i)
+        {
+            if (op_counts[i] > 0)
+            {
+                counts.emplace_back(op_counts[i], i);
+            }
+        }
+        std::sort(counts.rbegin(), counts.rend());
+
+        for (const auto& count : counts)
+        {
+            char line[64];
+            std::snprintf(line, sizeof(line), "%-8s %12llu %6.2f%%", op_name(static_cast<Op>(count.second)),
+                static_cast<unsigned long long>(count.first), 100.0 * count.first / matched);
+            std::cout << line << '\n';
+        }
+    }
+
+    return reader.is_corrupt() ? 1 : 0;
+}